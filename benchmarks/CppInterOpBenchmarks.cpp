@@ -0,0 +1,276 @@
+//===- CppInterOpBenchmarks.cpp - Benchmarks of CppInterOp hot paths ------===//
+//
+// Part of the compiler-research project, under the Apache License v2.0 with
+// LLVM Exceptions.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Run with --benchmark_out=<file> --benchmark_out_format=json to keep the
+// results; the run-cppinterop-benchmarks target does that for the build.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CppInterOp/CppInterOp.h"
+
+#include "../unittests/CppInterOp/ScopedEnv.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kClasses = 10000;     ///< Classes in the synthetic header.
+constexpr int kOverloads = 64;      ///< Candidates for overload resolution.
+constexpr int kColdFunctions = 512; ///< Functions wrapped once each.
+constexpr int kMaxDepth = 64;       ///< Depth of the class hierarchy.
+
+/// Synthetic code shared by the reflection benchmarks, declared once in an
+/// interpreter of its own.
+struct ReflectionFixture {
+  Cpp::TInterp_t Interp = nullptr;
+  Cpp::TCppScope_t Bench = nullptr;
+  std::vector<std::string> ClassNames;
+  std::vector<Cpp::TCppScope_t> Classes;
+  std::vector<Cpp::TCppFunction_t> Overloads;
+  std::vector<Cpp::TemplateArgInfo> OverloadArg;
+  std::vector<Cpp::TCppFunction_t> ColdFunctions;
+  /// The first function in ColdFunctions that has not been wrapped and the
+  /// first class in Classes that Box has not been instantiated with. They
+  /// carry over between runs, so repetitions never measure a cached result.
+  size_t NextColdFunction = 0;
+  size_t NextBoxArg = 0;
+  Cpp::TCppFunction_t Add = nullptr;
+  Cpp::TCppScope_t Box = nullptr;
+  std::vector<Cpp::TCppScope_t> Hierarchy;
+  Cpp::TCppScope_t BaseMember = nullptr;
+
+  ReflectionFixture() {
+    Interp = Cpp::CreateInterpreter({"-include", "new"});
+
+    std::string Code = "namespace bench {\n";
+    for (int i = 0; i < kClasses; ++i)
+      Code += "struct C" + std::to_string(i) + " { int m; void f(); };\n";
+    for (int i = 0; i < kOverloads; ++i) {
+      Code += "struct A" + std::to_string(i) + " {};\n";
+      Code += "int over(A" + std::to_string(i) + ") { return " +
+              std::to_string(i) + "; }\n";
+    }
+    for (int i = 0; i < kColdFunctions; ++i)
+      Code += "int cold" + std::to_string(i) + "(int x) { return x + " +
+              std::to_string(i) + "; }\n";
+    Code += "int add(int a, int b) { return a + b; }\n";
+    Code += "template <typename T> struct Box { T value; };\n";
+    Code += "struct D0 { int m0; };\n";
+    for (int i = 1; i <= kMaxDepth; ++i)
+      Code += "struct D" + std::to_string(i) + " : D" + std::to_string(i - 1) +
+              " { int m" + std::to_string(i) + "; };\n";
+    Code += "}\n";
+    Cpp::Declare(Code.c_str());
+
+    Bench = Cpp::GetScope("bench");
+    for (int i = 0; i < kClasses; ++i) {
+      ClassNames.push_back("C" + std::to_string(i));
+      Classes.push_back(Cpp::GetScope(ClassNames.back(), Bench));
+    }
+    Overloads = Cpp::GetFunctionsUsingName(Bench, "over");
+    OverloadArg.emplace_back(Cpp::GetTypeFromScope(
+        Cpp::GetScope("A" + std::to_string(kOverloads - 1), Bench)));
+    for (int i = 0; i < kColdFunctions; ++i)
+      ColdFunctions.push_back(
+          Cpp::GetNamed("cold" + std::to_string(i), Bench));
+    Add = Cpp::GetNamed("add", Bench);
+    Box = Cpp::GetNamed("Box", Bench);
+    for (int i = 0; i <= kMaxDepth; ++i)
+      Hierarchy.push_back(Cpp::GetScope("D" + std::to_string(i), Bench));
+    BaseMember = Cpp::LookupDatamember("m0", Hierarchy[0]);
+  }
+};
+
+ReflectionFixture& GetFixture() {
+  static ReflectionFixture Fixture;
+  // Other benchmarks create interpreters of their own.
+  Cpp::ActivateInterpreter(Fixture.Interp);
+  return Fixture;
+}
+
+} // namespace
+
+//===----------------------------------------------------------------------===//
+// Interpreter
+//===----------------------------------------------------------------------===//
+
+static void BM_CreateInterpreter(benchmark::State& State) {
+  // Keep the one-time LLVM initialization out of the measurement.
+  GetFixture();
+  for (auto _ : State) {
+    Cpp::TInterp_t I = Cpp::CreateInterpreter();
+    benchmark::DoNotOptimize(I);
+    Cpp::DeleteInterpreter(I);
+  }
+}
+BENCHMARK(BM_CreateInterpreter)->Unit(benchmark::kMillisecond);
+
+//===----------------------------------------------------------------------===//
+// Name lookup on a 10k-class header
+//===----------------------------------------------------------------------===//
+
+static void BM_GetScope(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  size_t I = 0;
+  for (auto _ : State) {
+    benchmark::DoNotOptimize(Cpp::GetScope(F.ClassNames[I], F.Bench));
+    I = (I + 1) % F.ClassNames.size();
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+BENCHMARK(BM_GetScope);
+
+static void BM_GetNamed(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  size_t I = 0;
+  for (auto _ : State) {
+    benchmark::DoNotOptimize(Cpp::GetNamed(F.ClassNames[I], F.Bench));
+    I = (I + 1) % F.ClassNames.size();
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+BENCHMARK(BM_GetNamed);
+
+//===----------------------------------------------------------------------===//
+// Overload resolution
+//===----------------------------------------------------------------------===//
+
+static void BM_BestOverloadFunctionMatch(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  for (auto _ : State)
+    benchmark::DoNotOptimize(
+        Cpp::BestOverloadFunctionMatch(F.Overloads, {}, F.OverloadArg));
+  State.counters["candidates"] = static_cast<double>(F.Overloads.size());
+}
+BENCHMARK(BM_BestOverloadFunctionMatch);
+
+//===----------------------------------------------------------------------===//
+// Wrappers and calls
+//===----------------------------------------------------------------------===//
+
+// Every iteration wraps a function that has not been wrapped before, so
+// this includes generating and compiling the wrapper.
+static void BM_MakeFunctionCallable_Cold(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  for (auto _ : State) {
+    if (F.NextColdFunction == F.ColdFunctions.size()) {
+      State.SkipWithError("ran out of unwrapped functions");
+      break;
+    }
+    benchmark::DoNotOptimize(
+        Cpp::MakeFunctionCallable(F.ColdFunctions[F.NextColdFunction++]));
+  }
+}
+BENCHMARK(BM_MakeFunctionCallable_Cold)
+    ->Iterations(kColdFunctions)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_MakeFunctionCallable_Warm(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  Cpp::MakeFunctionCallable(F.Add);
+  for (auto _ : State)
+    benchmark::DoNotOptimize(Cpp::MakeFunctionCallable(F.Add));
+}
+BENCHMARK(BM_MakeFunctionCallable_Warm);
+
+static void BM_JitCallInvoke(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  Cpp::JitCall JC = Cpp::MakeFunctionCallable(F.Add);
+  int A = 1, B = 2, Result = 0;
+  void* Args[] = {&A, &B};
+  for (auto _ : State) {
+    JC.Invoke(&Result, {Args, 2});
+    benchmark::DoNotOptimize(Result);
+  }
+}
+BENCHMARK(BM_JitCallInvoke);
+
+// The same JIT-compiled function, called through its address.
+static void BM_DirectCall(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  auto* Add =
+      reinterpret_cast<int (*)(int, int)>(Cpp::GetFunctionAddress(F.Add));
+  int A = 1, B = 2;
+  for (auto _ : State) {
+    benchmark::DoNotOptimize(A);
+    benchmark::DoNotOptimize(Add(A, B));
+  }
+}
+BENCHMARK(BM_DirectCall);
+
+//===----------------------------------------------------------------------===//
+// Templates and layout
+//===----------------------------------------------------------------------===//
+
+// Every iteration instantiates Box with a class it has not seen yet.
+static void BM_InstantiateTemplate(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  for (auto _ : State) {
+    if (F.NextBoxArg == F.Classes.size()) {
+      State.SkipWithError("ran out of template arguments");
+      break;
+    }
+    Cpp::TemplateArgInfo Arg(Cpp::GetTypeFromScope(F.Classes[F.NextBoxArg++]));
+    benchmark::DoNotOptimize(Cpp::InstantiateTemplate(F.Box, &Arg, 1));
+  }
+}
+BENCHMARK(BM_InstantiateTemplate)->Iterations(kClasses / 2);
+
+// The offset of the root's member, seen from a class Depth levels below.
+static void BM_GetVariableOffset(benchmark::State& State) {
+  ReflectionFixture& F = GetFixture();
+  Cpp::TCppScope_t Derived = F.Hierarchy[State.range(0)];
+  for (auto _ : State)
+    benchmark::DoNotOptimize(Cpp::GetVariableOffset(F.BaseMember, Derived));
+}
+BENCHMARK(BM_GetVariableOffset)->Arg(1)->Arg(8)->Arg(kMaxDepth);
+
+//===----------------------------------------------------------------------===//
+// Dyld
+//===----------------------------------------------------------------------===//
+
+// An interpreter searching the generated libraries with the given bloom
+// filter. Dyld reads CPPINTEROP_DYLD_BLOOM when the interpreter is created.
+static void ActivateDyldInterpreter(const std::string& Bloom) {
+  static std::map<std::string, Cpp::TInterp_t> Interps;
+  Cpp::TInterp_t& I = Interps[Bloom];
+  if (!I) {
+    TestUtils::ScopedEnv BloomEnv("CPPINTEROP_DYLD_BLOOM", Bloom.c_str());
+    // Keep the directory checks out of the per-search numbers.
+    TestUtils::ScopedEnv RescanEnv("CPPINTEROP_DYLD_RESCAN", "0");
+    I = Cpp::CreateInterpreter();
+    Cpp::AddSearchPath(CPPINTEROP_BENCH_LIB_DIR);
+    // The first search scans the libraries.
+    Cpp::SearchLibrariesForSymbol("bench_lib0_fn0", /*search_system=*/false);
+  }
+  Cpp::ActivateInterpreter(I);
+}
+
+static void BM_DyldSearch(benchmark::State& State, const char* Bloom,
+                          const char* Symbol) {
+  ActivateDyldInterpreter(Bloom);
+  for (auto _ : State)
+    benchmark::DoNotOptimize(
+        Cpp::SearchLibrariesForSymbol(Symbol, /*search_system=*/false));
+}
+
+// The last library defines the hit; nothing defines the miss, so every
+// library's bloom filter is probed.
+#define DYLD_LAST_SYMBOL                                                       \
+  "bench_lib" CPPINTEROP_BENCH_LIBS_LAST "_fn" CPPINTEROP_BENCH_FNS_LAST
+BENCHMARK_CAPTURE(BM_DyldSearch, blocked_hit, "blocked", DYLD_LAST_SYMBOL);
+BENCHMARK_CAPTURE(BM_DyldSearch, blocked_miss, "blocked", "bench_missing");
+BENCHMARK_CAPTURE(BM_DyldSearch, classic_hit, "classic", DYLD_LAST_SYMBOL);
+BENCHMARK_CAPTURE(BM_DyldSearch, classic_miss, "classic", "bench_missing");
+
+BENCHMARK_MAIN();
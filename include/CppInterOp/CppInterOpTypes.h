@@ -18,6 +18,8 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -179,6 +181,9 @@ enum class ValueKind : std::uint8_t {
   RValue,
 };
 
+/// Invocation counters of one wrapper, see SetJitCallProfiling.
+struct JitCallCounters;
+
 /// A class modeling function calls for functions produced by the interpreter
 /// in compiled code. It provides an information if we are calling a standard
 /// function, constructor or destructor.
@@ -208,6 +213,9 @@ public:
   using ConstructorCall = void (*)(void*, size_t, size_t, void**, void*);
   // (self, nary, withFree)
   using DestructorCall = void (*)(void*, size_t, int);
+  // (call, result, nary, args, self or is_arena)
+  using ProfiledCall = void (*)(const JitCall&, void*, unsigned long, ArgList,
+                                void*);
 
 private:
   union {
@@ -217,6 +225,12 @@ private:
   };
   Kind m_Kind;
   TCppConstFunction_t m_FD;
+  // Set for calls made while profiling is on. Invoked instead of the wrapper
+  // through a pointer, so that this header needs no symbols from the library.
+  ProfiledCall m_ProfiledCall = nullptr;
+  // Shared with the interpreter's wrapper cache, so the counters stay valid
+  // for as long as the JitCall does, even if the cache goes away first.
+  std::shared_ptr<JitCallCounters> m_Counters;
   JitCall() : m_GenericCall(nullptr), m_Kind(kUnknown), m_FD(nullptr) {}
   JitCall(Kind K, GenericCall C, TCppConstFunction_t FD)
       : m_GenericCall(C), m_Kind(K), m_FD(FD) {}
@@ -237,6 +251,10 @@ private:
                                         int withFree) const;
   void ReportInvokeEnd() const;
 
+  /// Calls the wrapper and adds the call and its duration to m_Counters.
+  static void InvokeProfiled(const JitCall& JC, void* result,
+                             unsigned long nary, ArgList args, void* self);
+
 public:
   [[nodiscard]] Kind getKind() const { return m_Kind; }
   bool isValid() const { return getKind() != kUnknown; }
@@ -272,7 +290,10 @@ public:
       assert(AreArgumentsValid(result, args, self, 1UL) && "Invalid args!");
       ReportInvokeStart(result, args, self);
 #endif // NDEBUG
-      m_GenericCall(self, args.m_ArgSize, args.m_Args, result);
+      if (m_ProfiledCall)
+        m_ProfiledCall(*this, result, /*nary=*/1UL, args, self);
+      else
+        m_GenericCall(self, args.m_ArgSize, args.m_Args, result);
       break;
 
     case kConstructorCall:
@@ -321,7 +342,10 @@ public:
            "Invalid args!");
     ReportInvokeStart(result, args, nullptr);
 #endif // NDEBUG
-    m_ConstructorCall(result, nary, args.m_ArgSize, args.m_Args, is_arena);
+    if (m_ProfiledCall)
+      m_ProfiledCall(*this, result, nary, args, is_arena);
+    else
+      m_ConstructorCall(result, nary, args.m_ArgSize, args.m_Args, is_arena);
   }
 };
 
@@ -333,6 +357,131 @@ struct TemplateArgInfo {
       : m_Type(type), m_IntegralValue(integral_value) {}
 };
 
+/// Kinds of named declarations reported by VisitCppNames. The values can be
+/// ORed to select several kinds.
+enum NamedDeclKind : unsigned {
+  kNamespace = 1 << 0,    ///< Namespaces and namespace aliases.
+  kClass = 1 << 1,        ///< Classes, structs and unions.
+  kEnum = 1 << 2,
+  kEnumConstant = 1 << 3,
+  kFunction = 1 << 4,     ///< Functions and methods.
+  kVariable = 1 << 5,     ///< Variables and data members.
+  kTypedef = 1 << 6,      ///< Typedefs and alias declarations.
+  kTemplate = 1 << 7,
+  kOtherDecl = 1 << 8,
+  kAnyDecl = (1 << 9) - 1
+};
+
+/// Called by VisitCppNames for every matching declaration. \c name is not
+/// null-terminated and is only valid for the duration of the call. Return
+/// false to stop the enumeration.
+using CppNameVisitor_t = bool (*)(const char* name, size_t name_size,
+                                  NamedDeclKind kind, TCppScope_t decl,
+                                  void* data);
+
+/// Maps symbol names to the libraries defining them, see
+/// SearchLibrariesForSymbols.
+using SymbolLibraryMap_t = std::map<std::string, std::string>;
+
+/// A symbol found by SearchLibrariesForQualifiedName.
+struct LibrarySymbol {
+  std::string MangledName;
+  std::string Library;
+};
+
+/// Call count and latency distribution of one API, see GetApiStatistics.
+/// Latencies are in nanoseconds and cover only the sampled calls. So do the
+/// allocation totals, which stay zero unless allocation accounting is on
+/// (CPPINTEROP_ALLOCS); divide them by Sampled for a per-call figure.
+struct ApiStatistics {
+  std::string Name;
+  std::uint64_t Calls = 0;   ///< Every call made while statistics were on.
+  std::uint64_t Sampled = 0; ///< Calls that were timed.
+  std::uint64_t MinNs = 0;
+  std::uint64_t MaxNs = 0;
+  double MeanNs = 0;
+  std::uint64_t P50Ns = 0;
+  std::uint64_t P99Ns = 0;
+  std::uint64_t P999Ns = 0;
+  std::uint64_t Allocs = 0;     ///< Heap allocations made by the API itself.
+  std::uint64_t AllocBytes = 0; ///< Bytes of those allocations.
+  std::uint64_t ArenaBytes = 0; ///< Bytes taken from the AST arena.
+};
+
+/// Where wrapper compilation spends its time, see GetWrapperCompilationStats.
+/// Times are cumulative nanoseconds. The JIT compiles and links a wrapper
+/// while it is executed or looked up, so JitCompileNs and JitLinkNs are part
+/// of ExecuteNs and LookupNs, which in turn are part of CompileNs. The JIT
+/// times are only measured in interpreters created while API statistics or
+/// tracing were on.
+struct WrapperCompilationStats {
+  std::uint64_t Wrappers = 0;     ///< Wrappers compiled.
+  std::uint64_t SourceBytes = 0;  ///< Size of their generated source.
+  std::uint64_t ObjectBytes = 0;  ///< Size of the objects the JIT emitted.
+  std::uint64_t SourceNs = 0;     ///< Generating the wrapper source.
+  std::uint64_t CompileNs = 0;    ///< Turning the source into an address.
+  std::uint64_t FrontendNs = 0;   ///< Parsing, Sema and CodeGen to LLVM IR.
+  std::uint64_t ExecuteNs = 0;    ///< Adding the module to the JIT.
+  std::uint64_t LookupNs = 0;     ///< Resolving the wrapper's address.
+  std::uint64_t JitCompileNs = 0; ///< LLVM optimisation and object emission.
+  std::uint64_t JitLinkNs = 0;    ///< Linking the object into the process.
+};
+
+/// How often a wrapper was invoked through JitCalls and for how long, see
+/// GetJitCallProfile. The time includes everything the function called.
+struct JitCallProfile {
+  /// Qualified name with template arguments and parameter types, e.g.
+  /// "N::f<int>(int, const char *)".
+  std::string Name;
+  std::uint64_t Calls = 0;
+  std::uint64_t TotalNs = 0;
+  /// The same time in timestamp counter cycles (the TSC on x86).
+  std::uint64_t Cycles = 0;
+};
+
+/// Classifies the type of a field for direct memory access. Enumerations are
+/// reported with the kind of their underlying integer type.
+enum class FieldKind : std::uint8_t {
+  Other, ///< Records, arrays and any other non-scalar type.
+  Bool,
+  Char_S,
+  Char_U,
+  SChar,
+  UChar,
+  WChar,
+  Char8,
+  Char16,
+  Char32,
+  Short,
+  UShort,
+  Int,
+  UInt,
+  Long,
+  ULong,
+  LongLong,
+  ULongLong,
+  Int128,
+  UInt128,
+  Half,
+  Float,
+  Double,
+  LongDouble,
+  Float128,
+  Pointer, ///< Object, function and member pointers.
+  Reference,
+};
+
+/// Describes the storage of a non-static data member, see GetRecordLayout.
+struct FieldLayout {
+  TCppScope_t m_Field;       ///< The data member.
+  std::uint64_t m_Offset;    ///< Byte offset from the start of the record.
+  std::uint64_t m_Size;      ///< Size of the field type in bytes.
+  std::uint32_t m_Align;     ///< Alignment of the field type in bytes.
+  std::uint16_t m_BitOffset; ///< Bit offset within the byte at m_Offset.
+  std::uint16_t m_BitWidth;  ///< Width of a bit-field, 0 otherwise.
+  FieldKind m_Kind;
+};
+
 // FIXME: Rework GetDimensions to make this enum redundant.
 namespace DimensionValue {
 enum : long int {
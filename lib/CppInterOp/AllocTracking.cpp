@@ -0,0 +1,116 @@
+//===--- AllocTracking.cpp - Counting operator new --------------*- C++ -*-===//
+//
+// Part of the compiler-research project, under the Apache License v2.0 with
+// LLVM Exceptions.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Replaces the global allocation functions so that AllocTracker can charge
+// heap allocations to the traced API that made them. Only built with
+// CPPINTEROP_ENABLE_ALLOC_TRACKING. The replacement covers the whole
+// process, including clang and LLVM, whose BumpPtrAllocators get their slabs
+// from the aligned operator new. Counting costs a relaxed load per
+// allocation until CPPINTEROP_ALLOCS turns it on.
+//
+// The replacement only takes effect if the dynamic linker binds operator new
+// to it. A program that links the library does; one that dlopens it after
+// loading the C++ runtime keeps the runtime's operator new for the whole
+// process, this library included, and nothing is counted. Enabling the
+// tracker probes with one allocation and warns when it was not counted.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Tracing.h"
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+using CppInterOp::Tracing::AllocTracker;
+
+static void* Allocate(std::size_t Size, bool NoThrow) {
+  if (!Size)
+    Size = 1;
+  void* P;
+  while (!(P = std::malloc(Size))) {
+    std::new_handler Handler = std::get_new_handler();
+    if (!Handler) {
+      if (NoThrow)
+        return nullptr;
+      llvm::report_bad_alloc_error("Allocation failed");
+    }
+    Handler();
+  }
+  AllocTracker::noteAlloc(Size);
+  return P;
+}
+
+static void* AllocateAligned(std::size_t Size, std::align_val_t Align,
+                             bool NoThrow) {
+  if (!Size)
+    Size = 1;
+  auto Alignment = std::max(static_cast<std::size_t>(Align), sizeof(void*));
+  void* P;
+  while (posix_memalign(&P, Alignment, Size)) {
+    std::new_handler Handler = std::get_new_handler();
+    if (!Handler) {
+      if (NoThrow)
+        return nullptr;
+      llvm::report_bad_alloc_error("Allocation failed");
+    }
+    Handler();
+  }
+  AllocTracker::noteAlloc(Size);
+  return P;
+}
+
+void* operator new(std::size_t Size) { return Allocate(Size, false); }
+void* operator new[](std::size_t Size) { return Allocate(Size, false); }
+void* operator new(std::size_t Size, const std::nothrow_t&) noexcept {
+  return Allocate(Size, true);
+}
+void* operator new[](std::size_t Size, const std::nothrow_t&) noexcept {
+  return Allocate(Size, true);
+}
+void* operator new(std::size_t Size, std::align_val_t Align) {
+  return AllocateAligned(Size, Align, false);
+}
+void* operator new[](std::size_t Size, std::align_val_t Align) {
+  return AllocateAligned(Size, Align, false);
+}
+void* operator new(std::size_t Size, std::align_val_t Align,
+                   const std::nothrow_t&) noexcept {
+  return AllocateAligned(Size, Align, true);
+}
+void* operator new[](std::size_t Size, std::align_val_t Align,
+                     const std::nothrow_t&) noexcept {
+  return AllocateAligned(Size, Align, true);
+}
+
+void operator delete(void* P) noexcept { std::free(P); }
+void operator delete[](void* P) noexcept { std::free(P); }
+void operator delete(void* P, std::size_t) noexcept { std::free(P); }
+void operator delete[](void* P, std::size_t) noexcept { std::free(P); }
+void operator delete(void* P, const std::nothrow_t&) noexcept { std::free(P); }
+void operator delete[](void* P, const std::nothrow_t&) noexcept {
+  std::free(P);
+}
+void operator delete(void* P, std::align_val_t) noexcept { std::free(P); }
+void operator delete[](void* P, std::align_val_t) noexcept { std::free(P); }
+void operator delete(void* P, std::size_t, std::align_val_t) noexcept {
+  std::free(P);
+}
+void operator delete[](void* P, std::size_t, std::align_val_t) noexcept {
+  std::free(P);
+}
+void operator delete(void* P, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  std::free(P);
+}
+void operator delete[](void* P, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  std::free(P);
+}
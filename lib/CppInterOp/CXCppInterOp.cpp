@@ -300,15 +300,26 @@ TInterp_t clang_Interpreter_takeInterpreterAsPtr(CXInterpreter I) {
   return static_cast<CXInterpreterImpl*>(I)->Interp.release();
 }
 
+namespace CppImpl {
+void InvalidateCaches(compat::Interpreter& I);
+} // namespace CppImpl
+
 enum CXErrorCode clang_Interpreter_undo(CXInterpreter I, unsigned int N) {
-#ifdef CPPINTEROP_USE_CLING
   auto* interp = getInterpreter(I);
+  enum CXErrorCode Result = CXError_Success;
+#ifdef CPPINTEROP_USE_CLING
   cling::Interpreter::PushTransactionRAII RAII(interp);
   interp->unload(N);
-  return CXError_Success;
 #else
-  return getInterpreter(I)->Undo(N) ? CXError_Failure : CXError_Success;
+  if (llvm::Error Err = interp->Undo(N)) {
+    llvm::consumeError(std::move(Err));
+    Result = CXError_Failure;
+  }
 #endif // CPPINTEROP_USE_CLING
+  // The interpreter may also be known to the C++ API, which caches
+  // declarations the undo removed.
+  Cpp::InvalidateCaches(*interp);
+  return Result;
 }
 
 void clang_Interpreter_dispose(CXInterpreter I) {
@@ -10,6 +10,7 @@
 #include "CppInterOp/CppInterOp.h"
 
 #include "Compatibility.h"
+#include "Probes.h"
 #include "Sins.h" // for access to private members
 #include "Tracing.h"
 
@@ -49,6 +50,9 @@
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/TemplateDeduction.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
@@ -65,6 +69,7 @@
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
@@ -74,6 +79,7 @@
 #include "llvm/TargetParser/Triple.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -142,6 +148,69 @@ namespace CppImpl {
 using namespace clang;
 using namespace llvm;
 
+// Offset of a (direct or indirect) base class subobject in a derived class.
+struct BaseOffset {
+  int64_t Offset;
+  // Whether the base is reached through a virtual base.
+  bool IsVirtual;
+};
+using BaseOffsetTable = llvm::DenseMap<const CXXRecordDecl*, BaseOffset>;
+
+// Incrementally maintained index of the identifiers declared at namespace
+// scope, used to answer completion-style queries. Each input of an incremental
+// session is parsed into its own part of the translation unit. The parts added
+// since the last query are indexed on the next query, and Undo removes only
+// the entries of the parts it undid.
+class NameIndex {
+public:
+  struct Entry {
+    StringRef Name; // Owned by the IdentifierTable.
+    NamedDeclKind Kind;
+    NamedDecl* D;
+  };
+
+  void update(TranslationUnitDecl* TU);
+  void removeUndone();
+  void clear();
+
+  template <typename Callback>
+  void forEachWithPrefix(StringRef Prefix, unsigned Kinds, Callback CB) const;
+  template <typename Callback>
+  void forEach(unsigned Kinds, Callback CB) const;
+
+private:
+  struct Part {
+    TranslationUnitDecl* TU;
+    // An indexed declaration of the part, nullptr if there is none. Tells
+    // whether the part was undone.
+    NamedDecl* Witness;
+  };
+
+  void indexPart(TranslationUnitDecl* TU);
+  void indexContext(DeclContext* DC, SmallVectorImpl<DeclContext*>& Worklist);
+  void addContext(DeclContext* DC, SmallVectorImpl<DeclContext*>& Worklist);
+  void add(NamedDecl* ND);
+
+  // Sorted by name.
+  std::vector<Entry> m_Entries;
+  // Entries found since the last query, merged into m_Entries in update.
+  std::vector<Entry> m_Pending;
+  // The last declaration indexed in each visited context, nullptr if none.
+  llvm::DenseMap<DeclContext*, Decl*> m_Cursors;
+  // The parts of the translation unit indexed so far, oldest first.
+  std::vector<Part> m_Parts;
+};
+
+// Invocations of one wrapper, see SetJitCallProfiling. Updated without locks
+// by every thread calling the wrapper through a profiled JitCall.
+struct JitCallCounters {
+  std::atomic<uint64_t> Calls{0};
+  std::atomic<uint64_t> Ticks{0}; // ReadTimestamp() ticks spent in the calls.
+};
+
+// Whether MakeFunctionCallable returns profiled JitCalls.
+static std::atomic<bool> JitCallProfiling{false};
+
 struct InterpreterInfo {
   compat::Interpreter* Interpreter = nullptr;
   bool isOwned = true;
@@ -149,15 +218,38 @@ struct InterpreterInfo {
   llvm::StringMap<QualType> BuiltinMap;
   // Per-interpreter wrapper caches. Keyed on AST nodes that belong to this
   // interpreter, so the caches must be destroyed together with it.
-  std::map<const FunctionDecl*, void*> WrapperStore;
+  struct WrapperInfo {
+    void* Address = nullptr;
+    // Allocated by the first profiled JitCall and shared with all of them.
+    std::shared_ptr<JitCallCounters> Counters;
+  };
+  // Keyed on the canonical declaration.
+  std::map<const FunctionDecl*, WrapperInfo> WrapperStore;
   std::map<const Decl*, void*> DtorWrapperStore;
+  // Memoized template instantiations keyed on the profile of the template
+  // and its canonical argument list. Invalidated on Undo.
+  struct TemplateInstance {
+    Decl* D = nullptr;
+    bool BodyInstantiated = false;
+  };
+  std::map<llvm::FoldingSetNodeID, TemplateInstance> TemplateInstanceStore;
+  // Flattened base offset tables of complete classes, see GetBaseOffsetTable.
+  std::map<const CXXRecordDecl*, BaseOffsetTable> BaseOffsetTables;
+  // Index of the names declared at namespace scope, see NameIndex.
+  NameIndex Names;
 
   InterpreterInfo(compat::Interpreter* I, bool Owned)
       : Interpreter(I), isOwned(Owned) {}
 
   // Enable move constructors.
   InterpreterInfo(InterpreterInfo&& other) noexcept
-      : Interpreter(other.Interpreter), isOwned(other.isOwned) {
+      : Interpreter(other.Interpreter), isOwned(other.isOwned),
+        BuiltinMap(std::move(other.BuiltinMap)),
+        WrapperStore(std::move(other.WrapperStore)),
+        DtorWrapperStore(std::move(other.DtorWrapperStore)),
+        TemplateInstanceStore(std::move(other.TemplateInstanceStore)),
+        BaseOffsetTables(std::move(other.BaseOffsetTables)),
+        Names(std::move(other.Names)) {
     other.Interpreter = nullptr;
     other.isOwned = false;
   }
@@ -169,6 +261,14 @@ struct InterpreterInfo {
 
       Interpreter = other.Interpreter;
       isOwned = other.isOwned;
+      // The caches are keyed on AST nodes of the interpreter, keep them
+      // together.
+      BuiltinMap = std::move(other.BuiltinMap);
+      WrapperStore = std::move(other.WrapperStore);
+      DtorWrapperStore = std::move(other.DtorWrapperStore);
+      TemplateInstanceStore = std::move(other.TemplateInstanceStore);
+      BaseOffsetTables = std::move(other.BaseOffsetTables);
+      Names = std::move(other.Names);
 
       other.Interpreter = nullptr;
       other.isOwned = false;
@@ -205,8 +305,42 @@ GetInterpreters(bool SetCrashHandler = true) {
     if (SetCrashHandler)
       llvm::sys::PrintStackTraceOnErrorSignal("CppInterOp");
 
-    if (getenv("CPPINTEROP_LOG") != nullptr)
-      CppInterOp::Tracing::InitTracing();
+    // CPPINTEROP_LOG=binary keeps fixed-size records in per-thread rings
+    // and formats them only when a reproducer is written.
+    if (const char* Log = getenv("CPPINTEROP_LOG"))
+      CppInterOp::Tracing::InitTracing(
+          llvm::StringRef(Log) == "binary"
+              ? CppInterOp::Tracing::TraceMode::Binary
+              : CppInterOp::Tracing::TraceMode::Text);
+
+    // CPPINTEROP_LOG_FILE=<path> writes the reproducer while the session
+    // runs instead of holding it in memory until exit.
+    if (const char* LogFile = getenv("CPPINTEROP_LOG_FILE"))
+      CppInterOp::Tracing::StartStreaming(LogFile);
+
+    // CPPINTEROP_ALLOCS charges heap allocations (in builds with
+    // CPPINTEROP_ENABLE_ALLOC_TRACKING) and AST arena growth to the innermost
+    // traced call. The arena is read from the current interpreter directly,
+    // since a traced getter would open another region.
+    if (getenv("CPPINTEROP_ALLOCS")) {
+      CppInterOp::Tracing::AllocTracker::setArenaProbe([]() -> uint64_t {
+        if (!sInterpreters.isConstructed() || sInterpreters->empty())
+          return 0;
+        compat::Interpreter* I = sInterpreters->back().Interpreter;
+        return I->getCI()->getASTContext().getAllocator().getBytesAllocated();
+      });
+      CppInterOp::Tracing::AllocTracker::setEnabled(true);
+    }
+
+    // CPPINTEROP_JITCALL_PROFILE counts and times the calls made through
+    // JitCalls, see GetJitCallProfile.
+    if (getenv("CPPINTEROP_JITCALL_PROFILE"))
+      JitCallProfiling.store(true, std::memory_order_relaxed);
+
+    unsigned SampleEvery = 0;
+    if (const char* Stats = getenv("CPPINTEROP_STATS"))
+      if (!llvm::StringRef(Stats).getAsInteger(10, SampleEvery))
+        CppInterOp::Tracing::ApiCallSite::setSampling(SampleEvery);
 
     // Initialize all targets (required for device offloading)
     llvm::InitializeAllTargetInfos();
@@ -270,6 +404,15 @@ static void RegisterInterpreter(compat::Interpreter* I, bool Owned) {
   Interps.emplace_back(I, Owned);
 }
 
+// The InterpreterInfo of I, or nullptr if I was not created or adopted
+// through this API, as the interpreters of the C API are.
+static InterpreterInfo* findInterpInfo(const compat::Interpreter& I) {
+  for (auto& Info : GetInterpreters())
+    if (Info.Interpreter == &I)
+      return &Info;
+  return nullptr;
+}
+
 static InterpreterInfo& getInterpInfo(compat::Interpreter* I = nullptr) {
   auto& Interps = GetInterpreters();
   assert(!Interps.empty() &&
@@ -464,6 +607,20 @@ void JitCall::ReportInvokeStart(void* object, unsigned long nary,
   }
 }
 
+void JitCall::InvokeProfiled(const JitCall& JC, void* result,
+                             unsigned long nary, ArgList args, void* self) {
+  uint64_t Start = CppInterOp::Tracing::ReadTimestamp();
+  // NOLINTBEGIN(*-type-union-access)
+  if (JC.m_Kind == kConstructorCall)
+    JC.m_ConstructorCall(result, nary, args.m_ArgSize, args.m_Args, self);
+  else
+    JC.m_GenericCall(self, args.m_ArgSize, args.m_Args, result);
+  // NOLINTEND(*-type-union-access)
+  uint64_t Ticks = CppInterOp::Tracing::ReadTimestamp() - Start;
+  JC.m_Counters->Calls.fetch_add(1, std::memory_order_relaxed);
+  JC.m_Counters->Ticks.fetch_add(Ticks, std::memory_order_relaxed);
+}
+
 #undef DEBUG_TYPE
 
 std::string GetVersion() {
@@ -481,6 +638,36 @@ std::string GetVersion() {
                         "])\n");
 }
 
+void SetApiStatisticsSampling(unsigned sample_every /*1*/) {
+  INTEROP_TRACE(sample_every);
+  CppInterOp::Tracing::ApiCallSite::setSampling(sample_every);
+  return INTEROP_VOID_RETURN();
+}
+
+void GetApiStatistics(std::vector<ApiStatistics>& stats) {
+  INTEROP_TRACE(INTEROP_OUT(stats));
+  CppInterOp::Tracing::CollectApiStatistics(stats);
+  return INTEROP_VOID_RETURN();
+}
+
+void ResetApiStatistics() {
+  INTEROP_TRACE();
+  CppInterOp::Tracing::ResetApiStatistics();
+  return INTEROP_VOID_RETURN();
+}
+
+void GetWrapperCompilationStats(WrapperCompilationStats& stats) {
+  INTEROP_TRACE(INTEROP_OUT(stats));
+  CppInterOp::Tracing::CollectWrapperStats(stats);
+  return INTEROP_VOID_RETURN();
+}
+
+void ResetWrapperCompilationStats() {
+  INTEROP_TRACE();
+  CppInterOp::Tracing::ResetWrapperStats();
+  return INTEROP_VOID_RETURN();
+}
+
 std::string Demangle(const std::string& mangled_name) {
   INTEROP_TRACE(mangled_name);
   // Both itaniumDemangle and microsoftDemangle return a malloc'd buffer
@@ -507,14 +694,15 @@ bool IsDebugOutputEnabled() {
   return INTEROP_RETURN(llvm::DebugFlag);
 }
 
-static void InstantiateFunctionDefinition(Decl* D) {
-  compat::SynthesizingCodeRAII RAII(&getInterp());
+static void InstantiateFunctionDefinition(Decl* D, compat::Interpreter& I) {
+  compat::SynthesizingCodeRAII RAII(&I);
   if (auto* FD = llvm::dyn_cast_or_null<FunctionDecl>(D)) {
-    getSema().InstantiateFunctionDefinition(SourceLocation(), FD,
-                                            /*Recursive=*/true,
-                                            /*DefinitionRequired=*/true);
+    Sema& S = I.getSema();
+    S.InstantiateFunctionDefinition(SourceLocation(), FD,
+                                    /*Recursive=*/true,
+                                    /*DefinitionRequired=*/true);
     // FIXME: this can go into a RAII object
-    clang::DiagnosticsEngine& Diags = getSema().getDiagnostics();
+    clang::DiagnosticsEngine& Diags = S.getDiagnostics();
     if (!FD->isDefined() && Diags.hasErrorOccurred()) {
       // instantiation failed, need to reset DiagnosticsEngine
       Diags.Reset(/*soft=*/true);
@@ -523,6 +711,10 @@ static void InstantiateFunctionDefinition(Decl* D) {
   }
 }
 
+static void InstantiateFunctionDefinition(Decl* D) {
+  InstantiateFunctionDefinition(D, getInterp());
+}
+
 bool IsAggregate(TCppScope_t scope) {
   INTEROP_TRACE(scope);
   Decl* D = static_cast<Decl*>(scope);
@@ -1108,52 +1300,67 @@ bool IsSubclass(TCppScope_t derived, TCppScope_t base) {
       IsTypeDerivedFrom(GetTypeFromScope(Derived), GetTypeFromScope(Base)));
 }
 
-// Copied from VTableBuilder.cpp
-// This is an internal helper function for the CppInterOp library (as evident
-// by the 'static' declaration), while the similar GetBaseClassOffset()
-// function below is exposed to library users.
-static unsigned ComputeBaseOffset(const ASTContext& Context,
-                                  const CXXRecordDecl* DerivedRD,
-                                  const CXXBasePath& Path) {
-  CharUnits NonVirtualOffset = CharUnits::Zero();
-
-  unsigned NonVirtualStart = 0;
-  const CXXRecordDecl* VirtualBase = nullptr;
-
-  // First, look for the virtual base class.
-  for (int I = Path.size(), E = 0; I != E; --I) {
-    const CXXBasePathElement& Element = Path[I - 1];
+// Collects the offsets of all (direct and indirect) bases of RD, which is
+// a subobject of Derived at RDOffset. The first path in depth-first order wins,
+// which matches what CXXBasePaths would find first.
+static void CollectBaseOffsets(const ASTContext& C,
+                               const CXXRecordDecl* Derived,
+                               const CXXRecordDecl* RD, CharUnits RDOffset,
+                               bool IsVirtualPath, BaseOffsetTable& Table) {
+  const ASTRecordLayout& Layout = C.getASTRecordLayout(RD);
+  for (const CXXBaseSpecifier& Base : RD->bases()) {
+    const CXXRecordDecl* BaseRD = Base.getType()->getAsCXXRecordDecl();
+    if (!BaseRD || !BaseRD->hasDefinition())
+      continue;
 
-    if (Element.Base->isVirtual()) {
-      NonVirtualStart = I;
-      QualType VBaseType = Element.Base->getType();
-      VirtualBase = VBaseType->getAsCXXRecordDecl();
-      break;
-    }
+    // Virtual bases are laid out by the most derived class.
+    CharUnits Offset =
+        Base.isVirtual()
+            ? C.getASTRecordLayout(Derived).getVBaseClassOffset(BaseRD)
+            : RDOffset + Layout.getBaseClassOffset(BaseRD);
+    bool IsVirtual = IsVirtualPath || Base.isVirtual();
+    bool Inserted =
+        Table
+            .try_emplace(BaseRD->getCanonicalDecl(),
+                         BaseOffset{Offset.getQuantity(), IsVirtual})
+            .second;
+    // A virtual base is shared, its own bases are already in the table.
+    if (!Inserted && Base.isVirtual())
+      continue;
+    CollectBaseOffsets(C, Derived, BaseRD, Offset, IsVirtual, Table);
   }
+}
 
-  // Now compute the non-virtual offset.
-  for (unsigned I = NonVirtualStart, E = Path.size(); I != E; ++I) {
-    const CXXBasePathElement& Element = Path[I];
-
-    // Check the base class offset.
-    const ASTRecordLayout& Layout = Context.getASTRecordLayout(Element.Class);
+// Returns the flattened table of base offsets of a complete class, building
+// it on first use.
+static const BaseOffsetTable* GetBaseOffsetTable(compat::Interpreter& I,
+                                                 const CXXRecordDecl* RD) {
+  RD = RD->getDefinition();
+  if (!RD || RD->isBeingDefined() || RD->isDependentContext() ||
+      RD->isInvalidDecl())
+    return nullptr;
 
-    const CXXRecordDecl* Base = Element.Base->getType()->getAsCXXRecordDecl();
+  auto& BaseOffsetTables = getInterpInfo(&I).BaseOffsetTables;
+  auto R = BaseOffsetTables.find(RD->getCanonicalDecl());
+  if (R != BaseOffsetTables.end())
+    return &R->second;
 
-    NonVirtualOffset += Layout.getBaseClassOffset(Base);
-  }
+  BaseOffsetTable& Table = BaseOffsetTables[RD->getCanonicalDecl()];
+  CollectBaseOffsets(I.getSema().getASTContext(), RD, RD, CharUnits::Zero(),
+                     /*IsVirtualPath=*/false, Table);
+  return &Table;
+}
 
-  // FIXME: This should probably use CharUnits or something. Maybe we should
-  // even change the base offsets in ASTRecordLayout to be specified in
-  // CharUnits.
-  // return BaseOffset(DerivedRD, VirtuaBose, aBlnVirtualOffset);
-  if (VirtualBase) {
-    const ASTRecordLayout& Layout = Context.getASTRecordLayout(DerivedRD);
-    CharUnits VirtualOffset = Layout.getVBaseClassOffset(VirtualBase);
-    return (NonVirtualOffset + VirtualOffset).getQuantity();
-  }
-  return NonVirtualOffset.getQuantity();
+static const BaseOffset* LookupBaseOffset(compat::Interpreter& I,
+                                          const CXXRecordDecl* Derived,
+                                          const CXXRecordDecl* Base) {
+  const BaseOffsetTable* Table = GetBaseOffsetTable(I, Derived);
+  if (!Table)
+    return nullptr;
+  auto R = Table->find(Base->getCanonicalDecl());
+  if (R == Table->end())
+    return nullptr;
+  return &R->second;
 }
 
 int64_t GetBaseClassOffset(TCppScope_t derived, TCppScope_t base) {
@@ -1169,27 +1376,10 @@ int64_t GetBaseClassOffset(TCppScope_t derived, TCppScope_t base) {
     return INTEROP_RETURN(-1);
   CXXRecordDecl* DCXXRD = cast<CXXRecordDecl>(DD);
   CXXRecordDecl* BCXXRD = cast<CXXRecordDecl>(BD);
-  // GCC's -Wmaybe-uninitialized false-positives here only under ASan:
-  // -fsanitize=address keeps the SmallDenseMap's union storage live across
-  // poison/unpoison calls and blocks the SROA pass that normally folds away
-  // the LargeRep read on the Small==true branch. The load survives into the
-  // IR the uninit pass sees, and it can no longer prove the `Small` guard.
-  // Clang's analyzer does not false-positive here; plain-O2 GCC does not
-  // either. Narrow the suppression to GCC + ASan.
-#if defined(__GNUC__) && !defined(__clang__) && defined(__SANITIZE_ADDRESS__)
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-#endif
-  CXXBasePaths Paths(/*FindAmbiguities=*/false, /*RecordPaths=*/true,
-                     /*DetectVirtual=*/false);
-#if defined(__GNUC__) && !defined(__clang__) && defined(__SANITIZE_ADDRESS__)
-#pragma GCC diagnostic pop
-#endif
-  DCXXRD->isDerivedFrom(BCXXRD, Paths);
 
-  // FIXME: We might want to cache these requests as they seem expensive.
-  return INTEROP_RETURN(
-      ComputeBaseOffset(getSema().getASTContext(), DCXXRD, Paths.front()));
+  if (const BaseOffset* BO = LookupBaseOffset(getInterp(), DCXXRD, BCXXRD))
+    return INTEROP_RETURN(BO->Offset);
+  return INTEROP_RETURN(-1);
 }
 
 template <typename DeclType>
@@ -1917,42 +2107,19 @@ intptr_t GetVariableOffset(compat::Interpreter& I, Decl* D,
       }
       offset += C.toCharUnitsFromBits(C.getFieldOffset(FD)).getQuantity();
     }
-    if (BaseCXXRD && BaseCXXRD != FieldParentRecordDecl->getCanonicalDecl()) {
+    if (BaseCXXRD && BaseCXXRD->getCanonicalDecl() !=
+                         FieldParentRecordDecl->getCanonicalDecl()) {
       // FieldDecl FD belongs to some class C, but the base class BaseCXXRD is
       // not C. That means BaseCXXRD derives from C. Offset needs to be
       // calculated for Derived class
 
-      // Depth first Search is performed to the class that declares FD from
-      // the base class
-      std::vector<CXXRecordDecl*> stack;
-      std::map<CXXRecordDecl*, CXXRecordDecl*> direction;
-      stack.push_back(BaseCXXRD);
-      while (!stack.empty()) {
-        CXXRecordDecl* RD = stack.back();
-        stack.pop_back();
-        size_t num_bases = GetNumBases(RD);
-        bool flag = false;
-        for (size_t i = 0; i < num_bases; i++) {
-          auto* CRD = static_cast<CXXRecordDecl*>(GetBaseClass(RD, i));
-          direction[CRD] = RD;
-          if (CRD == FieldParentRecordDecl) {
-            flag = true;
-            break;
-          }
-          stack.push_back(CRD);
-        }
-        if (flag)
-          break;
-      }
+      // The offset of the declaring class in BaseCXXRD comes from the
+      // flattened base offset table of BaseCXXRD.
       if (auto* RD = llvm::dyn_cast<CXXRecordDecl>(FieldParentRecordDecl)) {
-        // add in the offsets for the (multi level) base classes
-        RD = RD->getCanonicalDecl();
-        while (BaseCXXRD != RD) {
-          CXXRecordDecl* Parent = direction.at(RD);
-          offset +=
-              C.getASTRecordLayout(Parent).getBaseClassOffset(RD).getQuantity();
-          RD = Parent;
-        }
+        const BaseOffset* BO = LookupBaseOffset(I, BaseCXXRD, RD);
+        assert(BO && "Field not declared in a base class");
+        if (BO)
+          offset += BO->Offset;
       } else {
         assert(false && "Unreachable");
       }
@@ -2008,6 +2175,169 @@ intptr_t GetVariableOffset(TCppScope_t var, TCppScope_t parent) {
   return INTEROP_RETURN(GetVariableOffset(getInterp(), D, RD));
 }
 
+static FieldKind GetFieldKind(QualType QT) {
+  QT = QT.getCanonicalType();
+  if (QT->isReferenceType())
+    return FieldKind::Reference;
+  if (QT->isAnyPointerType() || QT->isMemberPointerType())
+    return FieldKind::Pointer;
+  if (const auto* ET = QT->getAs<EnumType>())
+    QT = ET->getDecl()->getIntegerType().getCanonicalType();
+
+  const auto* BT = dyn_cast<BuiltinType>(QT);
+  if (!BT)
+    return FieldKind::Other;
+  switch (BT->getKind()) {
+  case BuiltinType::Bool:
+    return FieldKind::Bool;
+  case BuiltinType::Char_S:
+    return FieldKind::Char_S;
+  case BuiltinType::Char_U:
+    return FieldKind::Char_U;
+  case BuiltinType::SChar:
+    return FieldKind::SChar;
+  case BuiltinType::UChar:
+    return FieldKind::UChar;
+  case BuiltinType::WChar_S:
+  case BuiltinType::WChar_U:
+    return FieldKind::WChar;
+  case BuiltinType::Char8:
+    return FieldKind::Char8;
+  case BuiltinType::Char16:
+    return FieldKind::Char16;
+  case BuiltinType::Char32:
+    return FieldKind::Char32;
+  case BuiltinType::Short:
+    return FieldKind::Short;
+  case BuiltinType::UShort:
+    return FieldKind::UShort;
+  case BuiltinType::Int:
+    return FieldKind::Int;
+  case BuiltinType::UInt:
+    return FieldKind::UInt;
+  case BuiltinType::Long:
+    return FieldKind::Long;
+  case BuiltinType::ULong:
+    return FieldKind::ULong;
+  case BuiltinType::LongLong:
+    return FieldKind::LongLong;
+  case BuiltinType::ULongLong:
+    return FieldKind::ULongLong;
+  case BuiltinType::Int128:
+    return FieldKind::Int128;
+  case BuiltinType::UInt128:
+    return FieldKind::UInt128;
+  case BuiltinType::Half:
+  case BuiltinType::Float16:
+    return FieldKind::Half;
+  case BuiltinType::Float:
+    return FieldKind::Float;
+  case BuiltinType::Double:
+    return FieldKind::Double;
+  case BuiltinType::LongDouble:
+    return FieldKind::LongDouble;
+  case BuiltinType::Float128:
+    return FieldKind::Float128;
+  case BuiltinType::NullPtr:
+    return FieldKind::Pointer;
+  default:
+    return FieldKind::Other;
+  }
+}
+
+// Appends the fields of RD, located OffsetInBits into the enclosing record,
+// looking through anonymous structs and unions.
+static void AppendFieldLayouts(const ASTContext& C, const RecordDecl* RD,
+                               uint64_t OffsetInBits,
+                               std::vector<FieldLayout>& fields) {
+  const ASTRecordLayout& Layout = C.getASTRecordLayout(RD);
+  for (const FieldDecl* FD : RD->fields()) {
+    if (FD->isInvalidDecl())
+      continue;
+    uint64_t FieldOffset =
+        OffsetInBits + Layout.getFieldOffset(FD->getFieldIndex());
+    if (FD->isAnonymousStructOrUnion()) {
+      if (const auto* RT = FD->getType()->getAs<RecordType>()) {
+        AppendFieldLayouts(C, RT->getDecl(), FieldOffset, fields);
+        continue;
+      }
+    }
+
+    QualType QT = FD->getType();
+    uint64_t Size = 0;
+    uint64_t Align = 1;
+    // Flexible array members have no size.
+    if (!QT->isIncompleteType()) {
+      TypeInfoChars TI = C.getTypeInfoInChars(QT);
+      Size = TI.Width.getQuantity();
+      Align = TI.Align.getQuantity();
+    }
+
+    uint64_t CharWidth = C.getCharWidth();
+    FieldLayout FL;
+    FL.m_Field = const_cast<FieldDecl*>(FD);
+    FL.m_Offset = FieldOffset / CharWidth;
+    FL.m_Size = Size;
+    FL.m_Align = static_cast<uint32_t>(Align);
+    FL.m_BitOffset = static_cast<uint16_t>(FieldOffset % CharWidth);
+    FL.m_BitWidth = 0;
+    if (FD->isBitField())
+      FL.m_BitWidth = static_cast<uint16_t>(
+          FD->getBitWidth()->EvaluateKnownConstInt(C).getZExtValue());
+    FL.m_Kind = GetFieldKind(QT);
+    fields.push_back(FL);
+  }
+}
+
+// Appends the fields of the bases of RD, which is located OffsetInBits into
+// a complete object of Derived. Each base is followed by its own fields and
+// preceded by those of its bases. Repeated non-virtual bases are distinct
+// subobjects and are reported each time; virtual bases are reported once.
+static void
+AppendBaseFieldLayouts(const ASTContext& C, const CXXRecordDecl* Derived,
+                       const CXXRecordDecl* RD, uint64_t OffsetInBits,
+                       llvm::SmallPtrSetImpl<const Decl*>& VisitedVBases,
+                       std::vector<FieldLayout>& fields) {
+  const ASTRecordLayout& Layout = C.getASTRecordLayout(RD);
+  for (const CXXBaseSpecifier& Base : RD->bases()) {
+    const CXXRecordDecl* BaseRD = Base.getType()->getAsCXXRecordDecl();
+    if (!BaseRD || !(BaseRD = BaseRD->getDefinition()))
+      continue;
+    uint64_t BaseOffset;
+    if (Base.isVirtual()) {
+      if (!VisitedVBases.insert(BaseRD->getCanonicalDecl()).second)
+        continue;
+      BaseOffset =
+          C.toBits(C.getASTRecordLayout(Derived).getVBaseClassOffset(BaseRD));
+    } else {
+      BaseOffset = OffsetInBits + C.toBits(Layout.getBaseClassOffset(BaseRD));
+    }
+    AppendBaseFieldLayouts(C, Derived, BaseRD, BaseOffset, VisitedVBases,
+                           fields);
+    AppendFieldLayouts(C, BaseRD, BaseOffset, fields);
+  }
+}
+
+bool GetRecordLayout(TCppScope_t scope, std::vector<FieldLayout>& fields) {
+  INTEROP_TRACE(scope, INTEROP_OUT(fields));
+  auto* RD = llvm::dyn_cast_or_null<RecordDecl>(static_cast<Decl*>(scope));
+  if (!RD)
+    return INTEROP_RETURN(false);
+  RD = RD->getDefinition();
+  if (!RD || RD->isBeingDefined() || RD->isDependentContext() ||
+      RD->isInvalidDecl())
+    return INTEROP_RETURN(false);
+
+  const ASTContext& C = getInterp().getSema().getASTContext();
+  if (auto* CXXRD = dyn_cast<CXXRecordDecl>(RD)) {
+    llvm::SmallPtrSet<const Decl*, 8> VisitedVBases;
+    AppendBaseFieldLayouts(C, CXXRD, CXXRD, /*OffsetInBits=*/0, VisitedVBases,
+                           fields);
+  }
+  AppendFieldLayouts(C, RD, /*OffsetInBits=*/0, fields);
+  return INTEROP_RETURN(true);
+}
+
 // Check if the Access Specifier of the variable matches the provided value.
 bool CheckVariableAccess(TCppScope_t var, AccessSpecifier AS) {
   auto* D = (Decl*)var;
@@ -2432,8 +2762,18 @@ void* compile_wrapper(compat::Interpreter& I, const std::string& wrapper_name,
                       const std::string& wrapper,
                       bool withAccessControl = true) {
   LLVM_DEBUG(dbgs() << "Compiling '" << wrapper_name << "'\n");
-  return I.compileFunction(wrapper_name, wrapper, false /*ifUnique*/,
-                           withAccessControl);
+  CPPINTEROP_PROBE2(wrapper__compile__start, wrapper_name.c_str(),
+                    wrapper.size());
+  CppInterOp::Tracing::RecordWrapperSource(wrapper.size());
+  void* Addr = nullptr;
+  {
+    CppInterOp::Tracing::WrapperPhaseScope Phase(
+        CppInterOp::Tracing::WrapperPhase::Compile);
+    Addr = I.compileFunction(wrapper_name, wrapper, false /*ifUnique*/,
+                             withAccessControl);
+  }
+  CPPINTEROP_PROBE2(wrapper__compile__done, wrapper_name.c_str(), Addr);
+  return Addr;
 }
 
 void get_type_as_string(QualType QT, std::string& type_name, ASTContext& C,
@@ -3012,6 +3352,8 @@ void make_narg_call_with_return(compat::Interpreter& I, const FunctionDecl* FD,
 int get_wrapper_code(compat::Interpreter& I, const FunctionDecl* FD,
                      std::string& wrapper_name, std::string& wrapper) {
   assert(FD && "generate_wrapper called without a function decl!");
+  CppInterOp::Tracing::WrapperPhaseScope Phase(
+      CppInterOp::Tracing::WrapperPhase::Source);
   ASTContext& Context = FD->getASTContext();
   //
   //  Get the class or namespace name.
@@ -3433,9 +3775,9 @@ JitCall::GenericCall make_wrapper(compat::Interpreter& I,
                                   const FunctionDecl* FD) {
   auto& WrapperStore = getInterpInfo(&I).WrapperStore;
 
-  auto R = WrapperStore.find(FD);
+  auto R = WrapperStore.find(FD->getCanonicalDecl());
   if (R != WrapperStore.end())
-    return (JitCall::GenericCall)R->second;
+    return (JitCall::GenericCall)R->second.Address;
 
   std::string wrapper_name;
   std::string wrapper_code;
@@ -3471,7 +3813,7 @@ JitCall::GenericCall make_wrapper(compat::Interpreter& I,
   void* wrapper =
       compile_wrapper(I, wrapper_name, wrapper_code, withAccessControl);
   if (wrapper) {
-    WrapperStore.insert(std::make_pair(FD, wrapper));
+    WrapperStore[FD->getCanonicalDecl()].Address = wrapper;
   } else {
     llvm::errs() << "TClingCallFunc::make_wrapper"
                  << ":"
@@ -3486,6 +3828,85 @@ JitCall::GenericCall make_wrapper(compat::Interpreter& I,
   return (JitCall::GenericCall)wrapper;
 }
 
+// The counters of FD's wrapper if JitCalls are profiled, nullptr otherwise.
+// The wrapper must be in the WrapperStore already.
+std::shared_ptr<JitCallCounters>
+get_wrapper_counters(compat::Interpreter& I, const FunctionDecl* FD) {
+  if (!JitCallProfiling.load(std::memory_order_relaxed))
+    return nullptr;
+  auto& Info = getInterpInfo(&I).WrapperStore[FD->getCanonicalDecl()];
+  if (!Info.Counters)
+    Info.Counters = std::make_shared<JitCallCounters>();
+  return Info.Counters;
+}
+
+// The name of FD in JitCall profiles: qualified, with template arguments and
+// the parameter types, so that overloads and specializations stay apart.
+std::string get_profile_name(const FunctionDecl* FD) {
+  std::string Name;
+  llvm::raw_string_ostream OS(Name);
+  const PrintingPolicy& Policy = FD->getASTContext().getPrintingPolicy();
+  FD->getNameForDiagnostic(OS, Policy, /*Qualified=*/true);
+  OS << '(';
+  for (unsigned i = 0, e = FD->getNumParams(); i != e; ++i)
+    OS << (i ? ", " : "") << FD->getParamDecl(i)->getType().getAsString(Policy);
+  if (FD->isVariadic())
+    OS << (FD->getNumParams() ? ", ..." : "...");
+  OS << ')';
+  if (const auto* MD = dyn_cast<CXXMethodDecl>(FD)) {
+    if (MD->isConst())
+      OS << " const";
+    if (MD->getRefQualifier() == RQ_LValue)
+      OS << " &";
+    else if (MD->getRefQualifier() == RQ_RValue)
+      OS << " &&";
+  }
+  return Name;
+}
+
+// The scope part of a profile name: "A::B<C::D>" for "A::B<C::D>::f(int)".
+StringRef get_profile_scope(StringRef Name) {
+  size_t Split = 0;
+  int Depth = 0;
+  for (size_t i = 0, e = Name.size(); i != e; ++i) {
+    char C = Name[i];
+    if (!Depth && C == '(')
+      break;
+    // Operator names may contain any of the brackets.
+    if (!Depth && (!i || Name.substr(0, i).ends_with("::")) &&
+        Name.substr(i).starts_with("operator"))
+      break;
+    if (C == '<' || C == '(')
+      ++Depth;
+    else if (C == '>' || C == ')')
+      --Depth;
+    else if (!Depth && Name.substr(i).starts_with("::"))
+      Split = i++;
+  }
+  return Name.substr(0, Split);
+}
+
+// Adds the functions declared in DC, and the instantiated specializations of
+// its function templates, to Functions under their profile names.
+void collect_profile_names(DeclContext* DC,
+                           llvm::StringMap<const FunctionDecl*>& Functions) {
+  SmallVector<DeclContext*, 4> Contexts;
+  DC->getPrimaryContext()->collectAllContexts(Contexts);
+  for (DeclContext* Ctx : Contexts) {
+    for (Decl* D : Ctx->decls()) {
+      if (auto* LS = dyn_cast<LinkageSpecDecl>(D)) {
+        collect_profile_names(LS, Functions);
+      } else if (auto* FTD = dyn_cast<FunctionTemplateDecl>(D)) {
+        for (FunctionDecl* Spec : FTD->specializations())
+          Functions.try_emplace(get_profile_name(Spec),
+                                Spec->getCanonicalDecl());
+      } else if (auto* FD = dyn_cast<FunctionDecl>(D)) {
+        Functions.try_emplace(get_profile_name(FD), FD->getCanonicalDecl());
+      }
+    }
+  }
+}
+
 // FIXME: Sink in the code duplication from get_wrapper_code.
 static std::string PrepareStructorWrapper(const Decl* D,
                                           const char* wrapper_prefix,
@@ -3695,15 +4116,22 @@ CPPINTEROP_API JitCall MakeFunctionCallable(TInterp_t I,
   }
 
   if (const auto* Ctor = dyn_cast<CXXConstructorDecl>(D)) {
-    if (auto Wrapper = make_wrapper(*interp, cast<FunctionDecl>(D)))
-      return INTEROP_RETURN(JitCall(JitCall::kConstructorCall, Wrapper, Ctor));
+    if (auto Wrapper = make_wrapper(*interp, Ctor)) {
+      JitCall JC(JitCall::kConstructorCall, Wrapper, Ctor);
+      if ((JC.m_Counters = get_wrapper_counters(*interp, Ctor)))
+        JC.m_ProfiledCall = &JitCall::InvokeProfiled;
+      return INTEROP_RETURN(JC);
+    }
     // FIXME: else error we failed to compile the wrapper.
     return INTEROP_RETURN(JitCall{});
   }
 
-  if (auto Wrapper = make_wrapper(*interp, cast<FunctionDecl>(D))) {
-    return INTEROP_RETURN(
-        JitCall(JitCall::kGenericCall, Wrapper, cast<FunctionDecl>(D)));
+  const auto* FD = cast<FunctionDecl>(D);
+  if (auto Wrapper = make_wrapper(*interp, FD)) {
+    JitCall JC(JitCall::kGenericCall, Wrapper, FD);
+    if ((JC.m_Counters = get_wrapper_counters(*interp, FD)))
+      JC.m_ProfiledCall = &JitCall::InvokeProfiled;
+    return INTEROP_RETURN(JC);
   }
   // FIXME: else error we failed to compile the wrapper.
   return INTEROP_RETURN(JitCall{});
@@ -3714,6 +4142,128 @@ CPPINTEROP_API JitCall MakeFunctionCallable(TCppConstFunction_t func) {
   return INTEROP_RETURN(MakeFunctionCallable(&getInterp(), func));
 }
 
+void SetJitCallProfiling(bool enable) {
+  INTEROP_TRACE(enable);
+  JitCallProfiling.store(enable, std::memory_order_relaxed);
+  return INTEROP_VOID_RETURN();
+}
+
+void GetJitCallProfile(std::vector<JitCallProfile>& profile) {
+  INTEROP_TRACE(INTEROP_OUT(profile));
+  profile.clear();
+  const double NsPerTick = CppInterOp::Tracing::NanosecondsPerTick();
+  for (const auto& [FD, Info] : getInterpInfo().WrapperStore) {
+    if (!Info.Counters)
+      continue;
+    JitCallProfile P;
+    P.Calls = Info.Counters->Calls.load(std::memory_order_relaxed);
+    if (!P.Calls)
+      continue;
+    P.Name = get_profile_name(FD);
+    P.Cycles = Info.Counters->Ticks.load(std::memory_order_relaxed);
+    P.TotalNs = static_cast<uint64_t>(double(P.Cycles) * NsPerTick);
+    profile.push_back(std::move(P));
+  }
+  std::sort(profile.begin(), profile.end(),
+            [](const JitCallProfile& A, const JitCallProfile& B) {
+              if (A.TotalNs != B.TotalNs)
+                return A.TotalNs > B.TotalNs;
+              return A.Name < B.Name;
+            });
+  return INTEROP_VOID_RETURN();
+}
+
+void ResetJitCallProfile() {
+  INTEROP_TRACE();
+  // Profiled JitCalls keep pointing to the counters, only clear them.
+  for (auto& Entry : getInterpInfo().WrapperStore) {
+    if (JitCallCounters* C = Entry.second.Counters.get()) {
+      C->Calls.store(0, std::memory_order_relaxed);
+      C->Ticks.store(0, std::memory_order_relaxed);
+    }
+  }
+  return INTEROP_VOID_RETURN();
+}
+
+bool WriteJitCallProfile(const char* path) {
+  INTEROP_TRACE(path);
+  std::vector<JitCallProfile> Profile;
+  GetJitCallProfile(Profile);
+
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(path, EC, llvm::sys::fs::OF_Text);
+  if (EC)
+    return INTEROP_RETURN(false);
+  OS << "# CppInterOp JitCall profile: calls, total ns, cycles, function\n";
+  for (const JitCallProfile& P : Profile)
+    OS << P.Calls << '\t' << P.TotalNs << '\t' << P.Cycles << '\t' << P.Name
+       << '\n';
+  OS.close();
+  bool Ok = !OS.has_error();
+  OS.clear_error();
+  return INTEROP_RETURN(Ok);
+}
+
+bool LoadJitCallProfile(const char* path,
+                        std::vector<JitCallProfile>& profile) {
+  INTEROP_TRACE(path, INTEROP_OUT(profile));
+  profile.clear();
+  auto Buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/true);
+  if (!Buffer)
+    return INTEROP_RETURN(false);
+
+  StringRef Rest = (*Buffer)->getBuffer();
+  while (!Rest.empty()) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    Line = Line.rtrim('\r');
+    if (Line.empty() || Line.starts_with("#"))
+      continue;
+    SmallVector<StringRef, 4> Fields;
+    Line.split(Fields, '\t', /*MaxSplit=*/3);
+    JitCallProfile P;
+    if (Fields.size() != 4 || Fields[0].getAsInteger(10, P.Calls) ||
+        Fields[1].getAsInteger(10, P.TotalNs) ||
+        Fields[2].getAsInteger(10, P.Cycles) || Fields[3].empty()) {
+      profile.clear();
+      return INTEROP_RETURN(false);
+    }
+    P.Name = Fields[3].str();
+    profile.push_back(std::move(P));
+  }
+  return INTEROP_RETURN(true);
+}
+
+size_t PrewarmJitCalls(const std::vector<JitCallProfile>& profile,
+                       size_t limit /*=0*/) {
+  INTEROP_TRACE(profile, limit);
+  compat::Interpreter& I = getInterp();
+  size_t Count = profile.size();
+  if (limit && limit < Count)
+    Count = limit;
+
+  // The functions of every scope named in the profile, by profile name.
+  std::map<std::string, llvm::StringMap<const FunctionDecl*>> Scopes;
+  size_t Prewarmed = 0;
+  for (size_t i = 0; i < Count; ++i) {
+    StringRef Name = profile[i].Name;
+    StringRef ScopeName = get_profile_scope(Name);
+    auto [Scope, Inserted] = Scopes.try_emplace(ScopeName.str());
+    if (Inserted) {
+      auto* D = ScopeName.empty()
+                    ? getASTContext().getTranslationUnitDecl()
+                    : static_cast<Decl*>(
+                          GetScopeFromCompleteName(ScopeName.str()));
+      if (auto* DC = dyn_cast_or_null<DeclContext>(D))
+        collect_profile_names(DC, Scope->second);
+    }
+    auto FD = Scope->second.find(Name);
+    if (FD != Scope->second.end() && make_wrapper(I, FD->second))
+      ++Prewarmed;
+  }
+  return INTEROP_RETURN(Prewarmed);
+}
+
 namespace {
 #if !defined(CPPINTEROP_USE_CLING) && !defined(EMSCRIPTEN)
 bool DefineAbsoluteSymbol(compat::Interpreter& I,
@@ -3736,6 +4286,54 @@ bool DefineAbsoluteSymbol(compat::Interpreter& I,
   }
   return false;
 }
+
+/// Lets the JIT load the library defining a missing symbol on demand instead
+/// of failing the lookup. Loading code nobody asked for is opt-in:
+/// CPPINTEROP_AUTOLOAD=1 searches the user's library paths and
+/// CPPINTEROP_AUTOLOAD=system the system ones as well.
+void InstallLibraryAutoloader(compat::Interpreter& I) {
+  auto Env = llvm::sys::Process::GetEnv("CPPINTEROP_AUTOLOAD");
+  if (!Env || (*Env != "1" && *Env != "system"))
+    return;
+  bool SearchSystem = *Env == "system";
+  // The libraries would have to be loaded into the executor process.
+  if (I.isOutOfProcess())
+    return;
+
+  llvm::orc::LLJIT& Jit = *compat::getExecutionEngine(I);
+  // The process symbols are searched first; the generator only sees the
+  // symbols which no loaded library defines.
+  Jit.getProcessSymbolsJITDylib()->addGenerator(
+      CppInternal::DynamicLibraryManager::createAutoloadGenerator(
+          [&I] { return I.getDynamicLibraryManager(); },
+          Jit.getDataLayout().getGlobalPrefix(), SearchSystem));
+}
+
+/// Splits the JIT's share of wrapper compilation into compiling IR to an
+/// object and linking it, see Cpp::GetWrapperCompilationStats. Both
+/// transforms pass their input through unchanged. ORC cannot hand out the
+/// transform a layer has, so they are only installed when statistics or
+/// tracing are on, right after the JIT is created. A transform installed
+/// later by a client replaces them and only turns the split off.
+void InstallWrapperPhaseHooks(compat::Interpreter& I) {
+  if (!CppInterOp::Tracing::ApiCallSite::getSampling() &&
+      !CppInterOp::Tracing::TraceInfo::isEnabled())
+    return;
+  llvm::orc::LLJIT& Jit = *compat::getExecutionEngine(I);
+  Jit.getIRTransformLayer().setTransform(
+      [](llvm::orc::ThreadSafeModule TSM,
+         llvm::orc::MaterializationResponsibility&)
+          -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+        CppInterOp::Tracing::NotifyWrapperJitCompile();
+        return std::move(TSM);
+      });
+  Jit.getObjTransformLayer().setTransform(
+      [](std::unique_ptr<llvm::MemoryBuffer> Obj)
+          -> llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> {
+        CppInterOp::Tracing::NotifyWrapperObject(Obj->getBufferSize());
+        return std::move(Obj);
+      });
+}
 #endif
 
 static std::string MakeResourcesPath() {
@@ -3922,6 +4520,9 @@ TInterp_t CreateInterpreter(const std::vector<const char*>& Args /*={}*/,
   DefineAbsoluteSymbol(
       *I, "__clang_Interpreter_SetValueNoAlloc",
       reinterpret_cast<uint64_t>(&__clang_Interpreter_SetValueNoAlloc));
+
+  InstallLibraryAutoloader(*I);
+  InstallWrapperPhaseHooks(*I);
 #endif
   return INTEROP_RETURN(I);
 }
@@ -4126,13 +4727,48 @@ void UnloadLibrary(const char* lib_stem) {
 }
 
 std::string SearchLibrariesForSymbol(const char* mangled_name,
-                                     bool search_system /*true*/) {
-  INTEROP_TRACE(mangled_name, search_system);
-  auto* DLM = getInterp().getDynamicLibraryManager();
+                                     bool search_system /*true*/,
+                                     TInterp_t I /*=nullptr*/) {
+  INTEROP_TRACE(mangled_name, search_system, I);
+  auto* DLM = getInterp(I).getDynamicLibraryManager();
   return INTEROP_RETURN(
       DLM->searchLibrariesForSymbol(mangled_name, search_system));
 }
 
+SymbolLibraryMap_t
+SearchLibrariesForSymbols(const std::vector<std::string>& mangled_names,
+                          bool search_system /*true*/,
+                          TInterp_t I /*=nullptr*/) {
+  INTEROP_TRACE(mangled_names, search_system, I);
+  auto* DLM = getInterp(I).getDynamicLibraryManager();
+#ifdef CPPINTEROP_USE_CLING
+  SymbolLibraryMap_t Result;
+  for (const std::string& Name : mangled_names) {
+    std::string Lib = DLM->searchLibrariesForSymbol(Name, search_system);
+    if (!Lib.empty())
+      Result.emplace(Name, std::move(Lib));
+  }
+  return INTEROP_RETURN(Result);
+#else
+  return INTEROP_RETURN(
+      DLM->searchLibrariesForSymbols(mangled_names, search_system));
+#endif // CPPINTEROP_USE_CLING
+}
+
+void SearchLibrariesForQualifiedName(const char* qualified_name,
+                                     std::vector<LibrarySymbol>& results,
+                                     bool search_system /*true*/,
+                                     TInterp_t I /*=nullptr*/) {
+  INTEROP_TRACE(qualified_name, INTEROP_OUT(results), search_system, I);
+#ifndef CPPINTEROP_USE_CLING
+  auto* DLM = getInterp(I).getDynamicLibraryManager();
+  for (auto& Match :
+       DLM->searchLibrariesForQualifiedName(qualified_name, search_system))
+    results.push_back({std::move(Match.first), std::move(Match.second)});
+#endif // CPPINTEROP_USE_CLING
+  return INTEROP_VOID_RETURN();
+}
+
 bool InsertOrReplaceJitSymbol(compat::Interpreter& I,
                               const char* linker_mangled_name,
                               uint64_t address) {
@@ -4225,8 +4861,10 @@ std::string ObjToString(const char* type, void* obj) {
 }
 
 static Decl* InstantiateTemplate(TemplateDecl* TemplateD,
-                                 TemplateArgumentListInfo& TLI, Sema& S,
+                                 TemplateArgumentListInfo& TLI,
+                                 compat::Interpreter& I,
                                  bool instantiate_body) {
+  Sema& S = I.getSema();
   // This is not right but we don't have a lot of options to choose from as a
   // template instantiation requires a valid source location.
   SourceLocation fakeLoc = GetValidSLoc(S);
@@ -4241,7 +4879,7 @@ static Decl* InstantiateTemplate(TemplateDecl* TemplateD,
       (void)Result;
     }
     if (instantiate_body)
-      InstantiateFunctionDefinition(Specialization);
+      InstantiateFunctionDefinition(Specialization, I);
     return Specialization;
   }
 
@@ -4286,26 +4924,22 @@ static Decl* InstantiateTemplate(TemplateDecl* TemplateD,
 }
 
 Decl* InstantiateTemplate(TemplateDecl* TemplateD,
-                          ArrayRef<TemplateArgument> TemplateArgs, Sema& S,
-                          bool instantiate_body) {
+                          ArrayRef<TemplateArgument> TemplateArgs,
+                          compat::Interpreter& I, bool instantiate_body) {
   // Create a list of template arguments.
   TemplateArgumentListInfo TLI{};
   for (auto TA : TemplateArgs)
-    TLI.addArgument(
-        S.getTrivialTemplateArgumentLoc(TA, QualType(), SourceLocation()));
+    TLI.addArgument(I.getSema().getTrivialTemplateArgumentLoc(
+        TA, QualType(), SourceLocation()));
 
-  return InstantiateTemplate(TemplateD, TLI, S, instantiate_body);
+  return InstantiateTemplate(TemplateD, TLI, I, instantiate_body);
 }
 
-TCppScope_t InstantiateTemplate(compat::Interpreter& I, TCppScope_t tmpl,
+static void ConvertTemplateArgs(ASTContext& C,
                                 const TemplateArgInfo* template_args,
                                 size_t template_args_size,
-                                bool instantiate_body) {
-  auto& S = I.getSema();
-  auto& C = S.getASTContext();
-
-  llvm::SmallVector<TemplateArgument> TemplateArgs;
-  TemplateArgs.reserve(template_args_size);
+                                SmallVectorImpl<TemplateArgument>& Result) {
+  Result.reserve(template_args_size);
   for (size_t i = 0; i < template_args_size; ++i) {
     QualType ArgTy = QualType::getFromOpaquePtr(template_args[i].m_Type);
     if (template_args[i].m_IntegralValue) {
@@ -4313,16 +4947,80 @@ TCppScope_t InstantiateTemplate(compat::Interpreter& I, TCppScope_t tmpl,
       // the string representation.
       auto Res = llvm::APSInt(template_args[i].m_IntegralValue);
       Res = Res.extOrTrunc(C.getIntWidth(ArgTy));
-      TemplateArgs.push_back(TemplateArgument(C, Res, ArgTy));
+      Result.push_back(TemplateArgument(C, Res, ArgTy));
     } else {
-      TemplateArgs.push_back(ArgTy);
+      Result.push_back(ArgTy);
     }
   }
+}
+
+using TemplateInstanceIt =
+    decltype(InterpreterInfo::TemplateInstanceStore)::iterator;
+
+static TemplateInstanceIt
+GetTemplateInstance(InterpreterInfo& Info, const TemplateDecl* TmplD,
+                    ArrayRef<TemplateArgument> TemplateArgs,
+                    const ASTContext& C) {
+  llvm::FoldingSetNodeID ID;
+  ID.AddPointer(TmplD->getCanonicalDecl());
+  for (const TemplateArgument& TA : TemplateArgs)
+    C.getCanonicalTemplateArgument(TA).Profile(ID, C);
+  return Info.TemplateInstanceStore.try_emplace(ID).first;
+}
+
+static bool IsInstanceComplete(const InterpreterInfo::TemplateInstance& Inst,
+                               bool instantiate_body) {
+  return Inst.D && (Inst.BodyInstantiated || !instantiate_body);
+}
+
+// Requires the caller to have pushed a transaction.
+static Decl* InstantiateTemplate(InterpreterInfo::TemplateInstance& Inst,
+                                 TemplateDecl* TmplD,
+                                 ArrayRef<TemplateArgument> TemplateArgs,
+                                 compat::Interpreter& I,
+                                 bool instantiate_body) {
+  if (!Inst.D) {
+    Inst.D = InstantiateTemplate(TmplD, TemplateArgs, I, instantiate_body);
+    // Only function templates have a body to instantiate on demand.
+    Inst.BodyInstantiated =
+        instantiate_body || !isa_and_nonnull<FunctionDecl>(Inst.D);
+  } else if (instantiate_body && !Inst.BodyInstantiated) {
+    InstantiateFunctionDefinition(Inst.D, I);
+    Inst.BodyInstantiated = true;
+  }
+  return Inst.D;
+}
+
+TCppScope_t InstantiateTemplate(compat::Interpreter& I, TCppScope_t tmpl,
+                                const TemplateArgInfo* template_args,
+                                size_t template_args_size,
+                                bool instantiate_body) {
+  auto& C = I.getSema().getASTContext();
+
+  llvm::SmallVector<TemplateArgument> TemplateArgs;
+  ConvertTemplateArgs(C, template_args, template_args_size, TemplateArgs);
 
   TemplateDecl* TmplD = static_cast<TemplateDecl*>(tmpl);
+  InterpreterInfo* Info = findInterpInfo(I);
+  if (!Info) {
+    // Without an InterpreterInfo there is nowhere to cache the instance
+    // that goes away with the interpreter.
+    compat::SynthesizingCodeRAII RAII(&I);
+    return InstantiateTemplate(TmplD, TemplateArgs, I, instantiate_body);
+  }
+
+  auto It = GetTemplateInstance(*Info, TmplD, TemplateArgs, C);
+  if (IsInstanceComplete(It->second, instantiate_body))
+    return It->second.D;
+
   // We will create a new decl, push a transaction.
-  compat::SynthesizingCodeRAII RAII(&getInterp());
-  return InstantiateTemplate(TmplD, TemplateArgs, S, instantiate_body);
+  compat::SynthesizingCodeRAII RAII(&I);
+  Decl* D =
+      InstantiateTemplate(It->second, TmplD, TemplateArgs, I, instantiate_body);
+  // Declarations made later may let a failed instantiation succeed.
+  if (!D)
+    Info->TemplateInstanceStore.erase(It);
+  return D;
 }
 
 TCppScope_t InstantiateTemplate(TCppScope_t tmpl,
@@ -4334,6 +5032,75 @@ TCppScope_t InstantiateTemplate(TCppScope_t tmpl,
       getInterp(), tmpl, template_args, template_args_size, instantiate_body));
 }
 
+static void InstantiateTemplates(
+    compat::Interpreter& I, TCppScope_t tmpl,
+    const std::vector<std::vector<TemplateArgInfo>>& template_args_list,
+    std::vector<TCppScope_t>& instances, bool instantiate_body) {
+  auto& C = I.getSema().getASTContext();
+  TemplateDecl* TmplD = static_cast<TemplateDecl*>(tmpl);
+  InterpreterInfo* Info = findInterpInfo(I);
+  instances.reserve(instances.size() + template_args_list.size());
+
+  std::vector<llvm::SmallVector<TemplateArgument>> TemplateArgsList;
+  TemplateArgsList.reserve(template_args_list.size());
+  for (const auto& template_args : template_args_list)
+    ConvertTemplateArgs(C, template_args.data(), template_args.size(),
+                        TemplateArgsList.emplace_back());
+
+  if (!Info) {
+    // Nowhere to cache the instances, see InstantiateTemplate.
+    compat::SynthesizingCodeRAII RAII(&I);
+    for (const auto& TemplateArgs : TemplateArgsList)
+      instances.push_back(
+          InstantiateTemplate(TmplD, TemplateArgs, I, instantiate_body));
+    return;
+  }
+
+  // Resolve the cached instances first so that we do not open a transaction
+  // when there is nothing new to synthesize.
+  std::vector<TemplateInstanceIt> Insts;
+  Insts.reserve(TemplateArgsList.size());
+  bool NeedsTransaction = false;
+  for (const auto& TemplateArgs : TemplateArgsList) {
+    auto It = GetTemplateInstance(*Info, TmplD, TemplateArgs, C);
+    NeedsTransaction |= !IsInstanceComplete(It->second, instantiate_body);
+    Insts.push_back(It);
+  }
+
+  if (!NeedsTransaction) {
+    for (auto It : Insts)
+      instances.push_back(It->second.D);
+    return;
+  }
+
+  // All the new specializations go in a single transaction, so that their
+  // bodies are emitted together.
+  compat::SynthesizingCodeRAII RAII(&I);
+  for (size_t i = 0, e = Insts.size(); i < e; ++i)
+    instances.push_back(InstantiateTemplate(
+        Insts[i]->second, TmplD, TemplateArgsList[i], I, instantiate_body));
+
+  // Forget the failures, as InstantiateTemplate does. The same arguments may
+  // appear more than once, so erase by key once all results are in.
+  std::vector<llvm::FoldingSetNodeID> Failed;
+  for (auto It : Insts)
+    if (!It->second.D)
+      Failed.push_back(It->first);
+  for (const auto& ID : Failed)
+    Info->TemplateInstanceStore.erase(ID);
+}
+
+void InstantiateTemplates(
+    TCppScope_t tmpl,
+    const std::vector<std::vector<TemplateArgInfo>>& template_args_list,
+    std::vector<TCppScope_t>& instances, bool instantiate_body) {
+  INTEROP_TRACE(tmpl, template_args_list, INTEROP_OUT(instances),
+                instantiate_body);
+  InstantiateTemplates(getInterp(), tmpl, template_args_list, instances,
+                       instantiate_body);
+  return INTEROP_VOID_RETURN();
+}
+
 void GetClassTemplateInstantiationArgs(TCppScope_t templ_instance,
                                        std::vector<TemplateArgInfo>& args) {
   INTEROP_TRACE(templ_instance, INTEROP_OUT(args));
@@ -4379,13 +5146,37 @@ InstantiateTemplateFunctionFromString(const char* function_template) {
   return INTEROP_RETURN(nullptr);
 }
 
-void GetAllCppNames(TCppScope_t scope, std::set<std::string>& names) {
-  INTEROP_TRACE(scope, INTEROP_OUT(names));
+static NamedDeclKind GetNamedDeclKind(const NamedDecl* ND) {
+  if (isa<NamespaceDecl, NamespaceAliasDecl>(ND))
+    return kNamespace;
+  if (isa<TemplateDecl>(ND))
+    return kTemplate;
+  if (isa<EnumDecl>(ND))
+    return kEnum;
+  if (isa<RecordDecl>(ND))
+    return kClass;
+  if (isa<EnumConstantDecl>(ND))
+    return kEnumConstant;
+  if (isa<FunctionDecl>(ND))
+    return kFunction;
+  if (isa<VarDecl, FieldDecl, IndirectFieldDecl>(ND))
+    return kVariable;
+  if (isa<TypedefNameDecl>(ND))
+    return kTypedef;
+  return kOtherDecl;
+}
+
+// Calls Visitor for every named declaration in scope. Identifiers are
+// referenced in place, only special names (operators, conversions) are
+// printed into a buffer which is reused across the calls.
+template <typename VisitorT>
+static void VisitCppNames(compat::Interpreter& I, TCppScope_t scope,
+                          unsigned kinds, VisitorT Visitor) {
   auto* D = (clang::Decl*)scope;
   clang::DeclContext* DC;
   clang::DeclContext::decl_iterator decl;
 
-  compat::SynthesizingCodeRAII RAII(&getInterp());
+  compat::SynthesizingCodeRAII RAII(&I);
 
   if (auto* TD = dyn_cast_or_null<TagDecl>(D)) {
     DC = clang::TagDecl::castToDeclContext(TD);
@@ -4398,14 +5189,52 @@ void GetAllCppNames(TCppScope_t scope, std::set<std::string>& names) {
     DC = clang::TranslationUnitDecl::castToDeclContext(TUD);
     decl = DC->decls_begin();
   } else {
-    return INTEROP_VOID_RETURN();
+    return;
   }
 
+  llvm::SmallString<64> Buffer;
   for (/* decl set above */; decl != DC->decls_end(); decl++) {
-    if (auto* ND = llvm::dyn_cast_or_null<NamedDecl>(*decl)) {
-      names.insert(ND->getNameAsString());
+    auto* ND = llvm::dyn_cast_or_null<NamedDecl>(*decl);
+    if (!ND)
+      continue;
+    NamedDeclKind Kind = GetNamedDeclKind(ND);
+    if (!(Kind & kinds))
+      continue;
+    StringRef Name;
+    if (const IdentifierInfo* II = ND->getIdentifier()) {
+      Name = II->getName();
+    } else {
+      Buffer.clear();
+      llvm::raw_svector_ostream OS(Buffer);
+      OS << ND->getDeclName();
+      Name = Buffer.str();
     }
+    if (!Visitor(Name, Kind, ND))
+      return;
   }
+}
+
+void GetAllCppNames(TCppScope_t scope, std::set<std::string>& names) {
+  INTEROP_TRACE(scope, INTEROP_OUT(names));
+  VisitCppNames(getInterp(), scope, kAnyDecl,
+                [&names](StringRef Name, NamedDeclKind, const NamedDecl*) {
+                  names.insert(Name.str());
+                  return true;
+                });
+  return INTEROP_VOID_RETURN();
+}
+
+void VisitCppNames(TCppScope_t scope, CppNameVisitor_t visitor, void* data,
+                   unsigned kinds) {
+  INTEROP_TRACE(scope, visitor, data, kinds);
+  if (!visitor)
+    return INTEROP_VOID_RETURN();
+  VisitCppNames(getInterp(), scope, kinds,
+                [visitor, data](StringRef Name, NamedDeclKind Kind,
+                                const NamedDecl* ND) {
+                  return visitor(Name.data(), Name.size(), Kind,
+                                 const_cast<NamedDecl*>(ND), data);
+                });
   return INTEROP_VOID_RETURN();
 }
 
@@ -4421,14 +5250,216 @@ void GetEnums(TCppScope_t scope, std::vector<std::string>& Result) {
   llvm::SmallVector<clang::DeclContext*, 4> DCs;
   DC->collectAllContexts(DCs);
 
-  // FIXME: We should use a lookup based approach instead of brute force
-  for (auto* DC : DCs) {
-    for (auto decl = DC->decls_begin(); decl != DC->decls_end(); decl++) {
-      if (auto* ND = llvm::dyn_cast_or_null<EnumDecl>(*decl)) {
-        Result.push_back(ND->getNameAsString());
-      }
-    }
+  // The declarations are walked rather than the lookup table so that the
+  // enums are reported in declaration order. Anonymous enums have no name.
+  for (auto* DC : DCs)
+    for (Decl* Child : DC->decls())
+      if (auto* ED = llvm::dyn_cast<EnumDecl>(Child))
+        if (ED->getIdentifier())
+          Result.push_back(ED->getNameAsString());
+  return INTEROP_VOID_RETURN();
+}
+
+void NameIndex::clear() {
+  m_Entries.clear();
+  m_Pending.clear();
+  m_Cursors.clear();
+  m_Parts.clear();
+}
+
+// Undone declarations are removed from the lookup tables but may remain in
+// the lexical declaration chain of their context.
+static bool IsVisibleInContext(NamedDecl* ND) {
+  DeclContext* DC = ND->getDeclContext()->getRedeclContext();
+  for (NamedDecl* Found : DC->lookup(ND->getDeclName()))
+    if (Found->getCanonicalDecl() == ND->getCanonicalDecl())
+      return true;
+  return false;
+}
+
+// Undo removes the declarations of the most recent parts from the lookup
+// tables, the parts themselves stay in the redeclaration chain.
+void NameIndex::removeUndone() {
+  llvm::SmallPtrSet<TranslationUnitDecl*, 4> Undone;
+  while (!m_Parts.empty() && (!m_Parts.back().Witness ||
+                              !IsVisibleInContext(m_Parts.back().Witness))) {
+    Undone.insert(m_Parts.back().TU);
+    m_Parts.pop_back();
+  }
+  if (Undone.empty())
+    return;
+
+  llvm::erase_if(m_Entries, [&Undone](const Entry& E) {
+    return Undone.count(E.D->getTranslationUnitDecl());
+  });
+  for (auto I = m_Cursors.begin(), E = m_Cursors.end(); I != E;) {
+    auto Cur = I++;
+    Decl* D = Decl::castFromDeclContext(Cur->first);
+    if (Undone.count(D->getTranslationUnitDecl()))
+      m_Cursors.erase(Cur);
   }
+}
+
+void NameIndex::add(NamedDecl* ND) {
+  // Operators, constructors and the like cannot be completed.
+  const IdentifierInfo* II = ND->getIdentifier();
+  if (!II || II->getName().empty() || !IsVisibleInContext(ND))
+    return;
+  m_Pending.push_back({II->getName(), GetNamedDeclKind(ND), ND});
+  if (!m_Parts.back().Witness)
+    m_Parts.back().Witness = ND;
+}
+
+void NameIndex::addContext(DeclContext* DC,
+                           SmallVectorImpl<DeclContext*>& Worklist) {
+  if (m_Cursors.try_emplace(DC, nullptr).second)
+    Worklist.push_back(DC);
+}
+
+void NameIndex::indexContext(DeclContext* DC,
+                             SmallVectorImpl<DeclContext*>& Worklist) {
+  Decl* Last = m_Cursors.lookup(DC);
+  Decl* D = Last ? Last->getNextDeclInContext() : nullptr;
+  if (!Last && DC->decls_begin() != DC->decls_end())
+    D = *DC->decls_begin();
+
+  for (; D; D = D->getNextDeclInContext()) {
+    Last = D;
+    if (D->isImplicit() || D->isInvalidDecl())
+      continue;
+    // Look through extern "C" blocks and similar.
+    if (isa<LinkageSpecDecl, ExportDecl>(D)) {
+      addContext(cast<DeclContext>(D), Worklist);
+      continue;
+    }
+    if (auto* NSD = dyn_cast<NamespaceDecl>(D)) {
+      addContext(NSD, Worklist);
+      if (NSD->isFirstDecl())
+        add(NSD);
+      continue;
+    }
+    // Specializations share the name of their template.
+    if (isa<ClassTemplateSpecializationDecl, VarTemplateSpecializationDecl>(D))
+      continue;
+    auto* ND = dyn_cast<NamedDecl>(D);
+    if (!ND || !ND->isFirstDecl())
+      continue;
+    if (auto* FD = dyn_cast<FunctionDecl>(ND))
+      if (FD->isFunctionTemplateSpecialization())
+        continue;
+    add(ND);
+    // Unscoped enumerators are visible in the enclosing scope.
+    if (auto* ED = dyn_cast<EnumDecl>(ND))
+      if (!ED->isScoped())
+        for (EnumConstantDecl* ECD : ED->enumerators())
+          add(ECD);
+  }
+  m_Cursors[DC] = Last;
+}
+
+void NameIndex::indexPart(TranslationUnitDecl* TU) {
+  if (m_Parts.empty() || m_Parts.back().TU != TU)
+    m_Parts.push_back({TU, /*Witness=*/nullptr});
+  SmallVector<DeclContext*, 8> Worklist;
+  m_Cursors.try_emplace(TU, nullptr);
+  Worklist.push_back(TU);
+  while (!Worklist.empty())
+    indexContext(Worklist.pop_back_val(), Worklist);
+}
+
+void NameIndex::update(TranslationUnitDecl* TU) {
+  // The part indexed last may have grown since, as the single translation
+  // unit of cling does. The contexts nested in it were complete already.
+  TranslationUnitDecl* Last = m_Parts.empty() ? nullptr : m_Parts.back().TU;
+  SmallVector<TranslationUnitDecl*, 4> Added;
+  for (TranslationUnitDecl* Part = TU->getMostRecentDecl();
+       Part && Part != Last; Part = Part->getPreviousDecl())
+    Added.push_back(Part);
+  if (Last)
+    indexPart(Last);
+  for (TranslationUnitDecl* Part : llvm::reverse(Added))
+    indexPart(Part);
+
+  if (m_Pending.empty())
+    return;
+  auto ByName = [](const Entry& L, const Entry& R) { return L.Name < R.Name; };
+  llvm::sort(m_Pending, ByName);
+  size_t Middle = m_Entries.size();
+  m_Entries.insert(m_Entries.end(), m_Pending.begin(), m_Pending.end());
+  std::inplace_merge(m_Entries.begin(), m_Entries.begin() + Middle,
+                     m_Entries.end(), ByName);
+  m_Pending.clear();
+}
+
+template <typename Callback>
+void NameIndex::forEachWithPrefix(StringRef Prefix, unsigned Kinds,
+                                  Callback CB) const {
+  auto I = llvm::lower_bound(m_Entries, Prefix,
+                             [](const Entry& E, StringRef P) {
+                               return E.Name < P;
+                             });
+  for (auto E = m_Entries.end(); I != E && I->Name.starts_with(Prefix); ++I)
+    if (I->Kind & Kinds)
+      CB(*I);
+}
+
+template <typename Callback>
+void NameIndex::forEach(unsigned Kinds, Callback CB) const {
+  for (const Entry& E : m_Entries)
+    if (E.Kind & Kinds)
+      CB(E);
+}
+
+static NameIndex& GetNameIndex(compat::Interpreter& I) {
+  NameIndex& Index = getInterpInfo(&I).Names;
+  Index.update(I.getSema().getASTContext().getTranslationUnitDecl());
+  return Index;
+}
+
+void FindNamesWithPrefix(const std::string& prefix,
+                         std::vector<TCppScope_t>& results, unsigned kinds) {
+  INTEROP_TRACE(prefix, INTEROP_OUT(results), kinds);
+  GetNameIndex(getInterp())
+      .forEachWithPrefix(prefix, kinds, [&results](const NameIndex::Entry& E) {
+        results.push_back(E.D);
+      });
+  return INTEROP_VOID_RETURN();
+}
+
+void FindNamesContaining(const std::string& substring,
+                         std::vector<TCppScope_t>& results, unsigned kinds) {
+  INTEROP_TRACE(substring, INTEROP_OUT(results), kinds);
+  GetNameIndex(getInterp())
+      .forEach(kinds, [&results, &substring](const NameIndex::Entry& E) {
+        if (E.Name.contains(substring))
+          results.push_back(E.D);
+      });
+  return INTEROP_VOID_RETURN();
+}
+
+void FindSimilarNames(const std::string& name,
+                      std::vector<TCppScope_t>& results, unsigned max_distance,
+                      unsigned kinds) {
+  INTEROP_TRACE(name, INTEROP_OUT(results), max_distance, kinds);
+  StringRef Name(name);
+  std::vector<std::pair<unsigned, NamedDecl*>> Matches;
+  GetNameIndex(getInterp()).forEach(kinds, [&](const NameIndex::Entry& E) {
+    // The edit distance is at least the difference in length.
+    size_t Longer = std::max(E.Name.size(), Name.size());
+    size_t Shorter = std::min(E.Name.size(), Name.size());
+    if (Longer - Shorter > max_distance)
+      return;
+    unsigned Distance = E.Name.edit_distance(Name, /*AllowReplacements=*/true,
+                                             max_distance);
+    if (Distance <= max_distance)
+      Matches.emplace_back(Distance, E.D);
+  });
+  // Closest first, ties stay in name order.
+  std::stable_sort(
+      Matches.begin(), Matches.end(),
+      [](const auto& L, const auto& R) { return L.first < R.first; });
+  for (const auto& M : Matches)
+    results.push_back(M.second);
   return INTEROP_VOID_RETURN();
 }
 
@@ -4822,14 +5853,31 @@ void CodeComplete(std::vector<std::string>& Results, const char* code,
   return INTEROP_VOID_RETURN();
 }
 
+void InvalidateCaches(compat::Interpreter& I) {
+  // The undone transactions may contain memoized instantiations and classes.
+  if (InterpreterInfo* Info = findInterpInfo(I)) {
+    Info->TemplateInstanceStore.clear();
+    Info->BaseOffsetTables.clear();
+#ifdef CPPINTEROP_USE_CLING
+    // Unloading removes the declarations from their contexts.
+    Info->Names.clear();
+#else
+    Info->Names.removeUndone();
+#endif
+  }
+}
+
 int Undo(unsigned N) {
   INTEROP_TRACE(N);
   compat::SynthesizingCodeRAII RAII(&getInterp());
 #ifdef CPPINTEROP_USE_CLING
   getInterp().unload(N);
+  InvalidateCaches(getInterp());
   return INTEROP_RETURN(compat::Interpreter::kSuccess);
 #else
-  return INTEROP_RETURN(getInterp().undo(N));
+  int Result = getInterp().undo(N);
+  InvalidateCaches(getInterp());
+  return INTEROP_RETURN(Result);
 #endif
 }
 
@@ -9,6 +9,7 @@
 #include "Compatibility.h"
 #include "DynamicLibraryManager.h"
 #include "Paths.h"
+#include "Tracing.h"
 
 #include "clang/Interpreter/Interpreter.h"
 #include "clang/Interpreter/PartialTranslationUnit.h"
@@ -44,6 +45,7 @@
 #include <algorithm>
 #include <cstdio>
 #include <memory>
+#include <mutex>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -193,6 +195,11 @@ private:
     return std::make_tuple(stdin_fd, stdout_fd, stderr_fd);
   }
 
+  /// Created on first use. Declared before the interpreter so that it
+  /// outlives the JIT, whose library autoloader refers to it.
+  mutable std::unique_ptr<DynamicLibraryManager> m_DLM;
+  mutable std::once_flag m_DLMOnce;
+
   std::unique_ptr<clang::Interpreter> inner;
   std::unique_ptr<IOContext> io_context;
   bool outOfProcess;
@@ -440,15 +447,33 @@ public:
     bool SavedAccessControl = LO.AccessControl;
     LO.AccessControl = withAccessControl;
 
-    if (auto Err = ParseAndExecute(code)) {
+    auto Fail = [&](llvm::Error Err) -> void* {
       LO.AccessControl = SavedAccessControl;
       llvm::logAllUnhandledErrors(std::move(Err), llvm::errs(),
                                   "Failed to compileFunction: ");
       return nullptr;
+    };
+
+    // What ParseAndExecute does, split up for the wrapper statistics.
+    using CppInterOp::Tracing::WrapperPhase;
+    using CppInterOp::Tracing::WrapperPhaseScope;
+    clang::PartialTranslationUnit* PTU = nullptr;
+    {
+      WrapperPhaseScope Phase(WrapperPhase::Frontend);
+      auto PTUOrErr = Parse(code);
+      if (!PTUOrErr)
+        return Fail(PTUOrErr.takeError());
+      PTU = &*PTUOrErr;
+    }
+    if (PTU->TheModule) {
+      WrapperPhaseScope Phase(WrapperPhase::Execute);
+      if (auto Err = Execute(*PTU))
+        return Fail(std::move(Err));
     }
 
     LO.AccessControl = SavedAccessControl;
 
+    WrapperPhaseScope Phase(WrapperPhase::Lookup);
     return getAddressOfGlobal(name);
   }
 
@@ -458,12 +483,13 @@ public:
 
   const DynamicLibraryManager* getDynamicLibraryManager() const {
     assert(compat::getExecutionEngine(*inner) && "We must have an executor");
-    static std::unique_ptr<DynamicLibraryManager> DLM = nullptr;
-    if (!DLM) {
-      DLM.reset(new DynamicLibraryManager());
-      DLM->initializeDyld([](llvm::StringRef) { /*ignore*/ return false; });
-    }
-    return DLM.get();
+    // Each interpreter has its own search paths and loaded libraries. What
+    // Dyld reads from the library files is shared across the process.
+    std::call_once(m_DLMOnce, [this] {
+      m_DLM = std::make_unique<DynamicLibraryManager>();
+      m_DLM->initializeDyld([](llvm::StringRef) { /*ignore*/ return false; });
+    });
+    return m_DLM.get();
     // TODO: Add DLM to InternalExecutor and use executor->getDML()
     //      return inner->getExecutionEngine()->getDynamicLibraryManager();
   }
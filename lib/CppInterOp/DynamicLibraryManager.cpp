@@ -10,6 +10,7 @@
 #include "DynamicLibraryManager.h"
 #include "Compatibility.h"
 #include "Paths.h"
+#include "Probes.h"
 
 #include "llvm/ADT/StringSet.h"
 #include "llvm/BinaryFormat/Magic.h"
@@ -285,6 +286,7 @@ std::string DynamicLibraryManager::lookupLibrary(
     SmallVector<llvm::StringRef, 2> RunPath /*={}*/,
     StringRef libLoader /*=""*/, bool variateLibStem /*=true*/) const {
 #define DEBUG_TYPE "Dyld::lookupLibrary:"
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   LLVM_DEBUG(dbgs() << "Dyld::lookupLibrary: " << libStem.str() << ", "
                     << RPathToStr2(RPath) << ", " << RPathToStr2(RunPath)
                     << ", " << libLoader.str() << "\n");
@@ -345,6 +347,7 @@ DynamicLibraryManager::LoadLibResult
 DynamicLibraryManager::loadLibrary(StringRef libStem, bool permanent,
                                    bool resolved) {
 #define DEBUG_TYPE "Dyld::loadLibrary:"
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   LLVM_DEBUG(dbgs() << "Dyld::loadLibrary: " << libStem.str() << ", "
                     << (permanent ? "permanent" : "not-permanent") << ", "
                     << (resolved ? "resolved" : "not-resolved") << "\n");
@@ -364,7 +367,10 @@ DynamicLibraryManager::loadLibrary(StringRef libStem, bool permanent,
   // TODO: !permanent case
 
   std::string errMsg;
+  CPPINTEROP_PROBE1(library__load__start, canonicalLoadedLib.c_str());
   DyLibHandle dyLibHandle = platform::DLOpen(canonicalLoadedLib, &errMsg);
+  CPPINTEROP_PROBE2(library__load__done, canonicalLoadedLib.c_str(),
+                    dyLibHandle);
   if (!dyLibHandle) {
     // We emit callback to LibraryLoadingFailed when we get error with error
     // message.
@@ -386,6 +392,7 @@ DynamicLibraryManager::loadLibrary(StringRef libStem, bool permanent,
 
 void DynamicLibraryManager::unloadLibrary(StringRef libStem) {
 #define DEBUG_TYPE "Dyld::unloadLibrary:"
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   std::string canonicalLoadedLib = lookupLibrary(libStem);
   if (!isLibraryLoaded(canonicalLoadedLib))
     return;
@@ -416,6 +423,7 @@ void DynamicLibraryManager::unloadLibrary(StringRef libStem) {
 }
 
 bool DynamicLibraryManager::isLibraryLoaded(StringRef fullPath) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   std::string canonPath = normalizePath(fullPath);
   if (m_LoadedLibraries.find(canonPath) != m_LoadedLibraries.end())
     return true;
@@ -423,6 +431,7 @@ bool DynamicLibraryManager::isLibraryLoaded(StringRef fullPath) const {
 }
 
 void DynamicLibraryManager::dump(llvm::raw_ostream* S /*= nullptr*/) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   llvm::raw_ostream& OS = S ? *S : llvm::outs();
 
   // FIXME: print in a stable order the contents of m_SearchPaths
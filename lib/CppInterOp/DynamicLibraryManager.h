@@ -17,6 +17,20 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Path.h"
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+namespace orc {
+class DefinitionGenerator;
+} // namespace orc
+} // namespace llvm
+
 namespace CppInternal {
 class Dyld;
 class InterpreterCallbacks;
@@ -63,10 +77,19 @@ private:
   ///
   SearchPathInfos m_SearchPaths;
 
+  ///\brief Incremented whenever a search path is added.
+  ///
+  unsigned m_SearchPathsGeneration = 0;
+
   InterpreterCallbacks* m_Callbacks = nullptr;
 
   Dyld* m_Dyld = nullptr;
 
+  ///\brief Serializes the callers of the public interface. Recursive because
+  /// the library search calls back into the lookup of the dependencies.
+  ///
+  mutable std::recursive_mutex m_Mutex;
+
   ///\brief Concatenates current include paths and the system include paths
   /// and performs a lookup for the filename.
   /// See more information for RPATH and RUNPATH:
@@ -120,20 +143,28 @@ public:
   const InterpreterCallbacks* getCallbacks() const { return m_Callbacks; }
   void setCallbacks(InterpreterCallbacks* C) { m_Callbacks = C; }
 
-  ///\brief Returns the system include paths.
+  ///\brief Returns the system include paths. Not synchronized; the library
+  /// search uses it while it holds the lock of the manager.
   ///
   ///\returns System include paths.
   ///
   const SearchPathInfos& getSearchPaths() const { return m_SearchPaths; }
 
+  ///\brief Changes whenever a search path is added, telling the library
+  /// search that it has to scan again.
+  ///
+  unsigned getSearchPathsGeneration() const { return m_SearchPathsGeneration; }
+
   void addSearchPath(llvm::StringRef dir, bool isUser = true,
                      bool prepend = false) {
+    std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
     if (!dir.empty()) {
       for (auto& item : m_SearchPaths)
         if (dir == item.Path)
           return;
       auto pos = prepend ? m_SearchPaths.begin() : m_SearchPaths.end();
       m_SearchPaths.insert(pos, SearchPathInfo{dir.str(), isUser});
+      ++m_SearchPathsGeneration;
     }
   }
 
@@ -197,6 +228,48 @@ public:
   std::string searchLibrariesForSymbol(llvm::StringRef mangledName,
                                        bool searchSystem = true) const;
 
+  /// Find the not-yet-loaded shared objects containing a batch of symbols in
+  /// one pass over the libraries.
+  ///
+  ///\param[in] mangledNames - the mangled names to look for.
+  ///\param[in] searchSystem - whether to descend into system libraries.
+  ///
+  ///\returns a map from each symbol found to the library holding it, the
+  ///          one searchLibrariesForSymbol would return for that symbol.
+  ///
+  std::map<std::string, std::string>
+  searchLibrariesForSymbols(llvm::ArrayRef<std::string> mangledNames,
+                            bool searchSystem = true) const;
+
+  /// Find the not-yet-loaded shared objects defining C++ symbols with the
+  /// given demangled qualified name, such as `ns::Foo::bar`. Functions match
+  /// by name regardless of their parameters. The libraries are demangled on
+  /// first use and the result is kept.
+  ///
+  ///\param[in] qualifiedName - the qualified name to look for.
+  ///\param[in] searchSystem - whether to descend into system libraries.
+  ///
+  ///\returns the mangled names of the matching symbols, each with the
+  ///          library defining it.
+  ///
+  std::vector<std::pair<std::string, std::string>>
+  searchLibrariesForQualifiedName(llvm::StringRef qualifiedName,
+                                  bool searchSystem = true) const;
+
+  /// Creates an ORC definition generator which resolves the symbols missing
+  /// in a JITDylib by loading the libraries defining them.
+  ///
+  ///\param[in] GetDLM - returns the manager searching for the libraries. It
+  ///            is called on the first lookup reaching the generator.
+  ///\param[in] GlobalPrefix - the global prefix of the symbol names, which
+  ///            the generator strips before resolving them in the process.
+  ///\param[in] searchSystem - whether to load libraries from the system
+  ///            paths too, not only from the user's.
+  ///
+  static std::unique_ptr<llvm::orc::DefinitionGenerator>
+  createAutoloadGenerator(std::function<DynamicLibraryManager*()> GetDLM,
+                          char GlobalPrefix, bool searchSystem);
+
   void dump(llvm::raw_ostream* S = nullptr) const;
 
   /// On a success returns to full path to a shared object that holds the
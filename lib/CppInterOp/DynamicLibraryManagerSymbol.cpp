@@ -10,13 +10,21 @@
 
 #include "DynamicLibraryManager.h"
 #include "Paths.h"
+#include "Probes.h"
 
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/BinaryFormat/MachO.h"
+#include "llvm/Demangle/Demangle.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/Shared/ExecutorSymbolDef.h"
+#include "llvm/Object/BuildID.h"
 #include "llvm/Object/COFF.h"
 #include "llvm/Object/ELF.h"
 #include "llvm/Object/ELFObjectFile.h"
@@ -27,16 +35,35 @@
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/GlobPattern.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/Program.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/WithColor.h"
+#include "llvm/Support/xxhash.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #ifdef LLVM_ON_UNIX
 #include <dlfcn.h>
 #include <sys/stat.h>
@@ -129,6 +156,434 @@ struct BloomFilter {
   }
 };
 
+/// The bloom filter implementations Dyld can use, selected at runtime.
+enum class BloomKind : uint32_t {
+  /// BloomFilter, keyed by GNUHash.
+  Classic = 0,
+  /// BlockedBloomFilter, keyed by SymbolTable::Hash.
+  Blocked = 1,
+};
+
+/// A bloom filter which keeps all bits of a key in one 64-byte block. A probe
+/// touches a single cache line instead of one per bit, and the eight bits of
+/// a key are derived from one multiplication each so that they are tested
+/// together; with AVX2 in two vector operations.
+///
+/// The layout follows the split block bloom filters of Apache Parquet, with
+/// one bit in each of the eight 64-bit words of a block.
+struct BlockedBloomFilter {
+  struct alignas(64) Block {
+    uint64_t Words[8];
+  };
+
+  /// About 1% false positives for eight bits per key in 512-bit blocks.
+  static constexpr unsigned kBitsPerKey = 10;
+  static constexpr uint32_t kSalt[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+                                        0xa2b7289dU, 0x705495c7U, 0x2df1424bU,
+                                        0x9efc4947U, 0x5c6bfb31U};
+
+  std::vector<Block> m_Blocks;
+
+  void ResizeTable(uint32_t SymbolsCount) {
+    uint64_t Bits = uint64_t(SymbolsCount) * kBitsPerKey;
+    size_t NumBlocks = std::max<uint64_t>(1, (Bits + 511) / 512);
+    m_Blocks.assign(NumBlocks, Block{});
+  }
+
+  /// Adopts the blocks stored as consecutive words.
+  bool Assign(ArrayRef<uint64_t> Words) {
+    if (Words.empty() || Words.size() % 8)
+      return false;
+    m_Blocks.resize(Words.size() / 8);
+    memcpy(m_Blocks.data(), Words.data(), Words.size() * sizeof(uint64_t));
+    return true;
+  }
+
+  ArrayRef<uint64_t> GetWords() const {
+    return {reinterpret_cast<const uint64_t*>(m_Blocks.data()),
+            m_Blocks.size() * 8};
+  }
+
+  size_t GetBlockIndex(uint64_t Hash) const {
+    // Maps the upper half of the hash onto [0, size) without a division.
+    return ((Hash >> 32) * m_Blocks.size()) >> 32;
+  }
+
+  static uint64_t BitMask(uint32_t Hash, unsigned I) {
+    return 1ULL << ((Hash * kSalt[I]) >> 26);
+  }
+
+  void AddHash(uint64_t Hash) {
+    Block& B = m_Blocks[GetBlockIndex(Hash)];
+    for (unsigned I = 0; I < 8; ++I)
+      B.Words[I] |= BitMask(Hash, I);
+  }
+
+  bool TestHash(uint64_t Hash) const {
+    const Block& B = m_Blocks[GetBlockIndex(Hash)];
+#ifdef __AVX2__
+    const __m256i Salt = _mm256_loadu_si256((const __m256i*)kSalt);
+    __m256i Bits = _mm256_srli_epi32(
+        _mm256_mullo_epi32(_mm256_set1_epi32(uint32_t(Hash)), Salt), 26);
+    const __m256i One = _mm256_set1_epi64x(1);
+    __m256i Lo = _mm256_sllv_epi64(
+        One, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(Bits)));
+    __m256i Hi = _mm256_sllv_epi64(
+        One, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(Bits, 1)));
+    // testc(A, B) is set if all bits of B are set in A.
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i*)B.Words), Lo) &
+           _mm256_testc_si256(_mm256_load_si256((const __m256i*)B.Words + 1),
+                              Hi);
+#else
+    // No early exit, which lets the compiler vectorize the loop.
+    uint64_t Missing = 0;
+    for (unsigned I = 0; I < 8; ++I)
+      Missing |= BitMask(Hash, I) & ~B.Words[I];
+    return !Missing;
+#endif
+  }
+
+  /// Tests a batch of hashes, fetching the block of the next hash while the
+  /// current one is tested.
+  void TestHashes(ArrayRef<uint64_t> Hashes,
+                  MutableArrayRef<bool> Results) const {
+    assert(Hashes.size() == Results.size());
+    for (size_t I = 0, E = Hashes.size(); I < E; ++I) {
+#if defined(__GNUC__)
+      if (I + 1 < E)
+        __builtin_prefetch(&m_Blocks[GetBlockIndex(Hashes[I + 1])]);
+#endif
+      Results[I] = TestHash(Hashes[I]);
+    }
+  }
+};
+
+/// A view of a symbol table which holds no copies of the names. m_Hashes are
+/// the sorted 64-bit hashes of the names and m_Offsets the offset of each
+/// name in the object file, which is where a match gets confirmed.
+struct SymbolTable {
+  /// The offset of names which are not a NUL-terminated string in the file.
+  static constexpr uint32_t kNoOffset = ~0U;
+
+  ArrayRef<uint64_t> m_Hashes;
+  ArrayRef<uint32_t> m_Offsets;
+
+  static uint64_t Hash(StringRef Name) { return xxh3_64bits(Name); }
+
+  static void HashBatch(ArrayRef<StringRef> Names,
+                        MutableArrayRef<uint64_t> Hashes) {
+    assert(Names.size() == Hashes.size());
+    for (size_t I = 0, E = Names.size(); I < E; ++I)
+      Hashes[I] = Hash(Names[I]);
+  }
+
+  /// Returns the offset of \p Name in \p FileData, or kNoOffset.
+  static uint32_t GetOffset(StringRef FileData, StringRef Name) {
+    uintptr_t Begin = reinterpret_cast<uintptr_t>(FileData.data());
+    uintptr_t Ptr = reinterpret_cast<uintptr_t>(Name.data());
+    if (Ptr < Begin || Ptr - Begin >= FileData.size() ||
+        FileData.size() - (Ptr - Begin) <= Name.size())
+      return kNoOffset;
+    uint64_t Offset = Ptr - Begin;
+    if (Offset >= kNoOffset || FileData[Offset + Name.size()] != '\0')
+      return kNoOffset;
+    return Offset;
+  }
+
+  bool MayContain(uint64_t Hash) const {
+    return std::binary_search(m_Hashes.begin(), m_Hashes.end(), Hash);
+  }
+
+  /// Looks \p Name up and confirms it against \p FileData, the contents of
+  /// the object file the table was built from. Returns std::nullopt if a
+  /// candidate cannot be confirmed from the file data alone.
+  std::optional<bool> Contains(StringRef Name, StringRef FileData) const {
+    auto Range = std::equal_range(m_Hashes.begin(), m_Hashes.end(), Hash(Name));
+    bool Unknown = false;
+    for (auto It = Range.first; It != Range.second; ++It) {
+      uint64_t Offset = m_Offsets[It - m_Hashes.begin()];
+      if (Offset == kNoOffset) {
+        Unknown = true;
+        continue;
+      }
+      if (Offset + Name.size() < FileData.size() &&
+          FileData.substr(Offset, Name.size()) == Name &&
+          FileData[Offset + Name.size()] == '\0')
+        return true;
+    }
+    if (Unknown)
+      return std::nullopt;
+    return false;
+  }
+};
+
+/// The on-disk layout of the persistent symbol index. The file starts with a
+/// Header followed by the sections Lib[NumLibs], Str Lists[NumLists],
+/// uint64_t Bloom[NumBloomWords], uint64_t SymbolHashes[NumSymbols],
+/// uint32_t SymbolOffsets[NumSymbols] and char Strings[StringsSize]. It is
+/// written in host byte order and mapped as is. The symbol tables have the
+/// layout of SymbolTable.
+namespace IndexFormat {
+constexpr char kMagic[8] = {'C', 'P', 'P', 'I', 'D', 'Y', 'L', 'D'};
+constexpr uint32_t kVersion = 2;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+/// A string in the Strings section.
+struct Str {
+  uint64_t Offset;
+  uint32_t Size;
+  uint32_t Reserved;
+};
+
+struct Header {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t ByteOrder;
+  /// The object format of the executable which wrote the index.
+  Str Format;
+  uint32_t NumLibs;
+  uint32_t NumLists;
+  uint64_t NumBloomWords;
+  uint64_t NumSymbols;
+  uint64_t StringsSize;
+};
+
+enum LibFlags : uint32_t {
+  kIgnore = 1 << 0,
+  kAskCallback = 1 << 1,
+  kPIEExecutable = 1 << 2,
+  kHasFilter = 1 << 3,
+};
+
+struct Lib {
+  Str Path;
+  Str BuildID;
+  uint64_t Size;
+  int64_t MTime;
+  uint32_t Flags;
+  uint32_t IgnoreSymbolFlags;
+  /// Ranges in the Lists section.
+  uint32_t Deps, NumDeps;
+  uint32_t RPath, NumRPath;
+  uint32_t RunPath, NumRunPath;
+  /// The bloom filter parameters.
+  uint32_t BloomSymbolsCount;
+  uint32_t BloomShift;
+  uint32_t BloomSize;
+  /// A BloomKind.
+  uint32_t BloomKind;
+  /// Ranges in the Bloom and the SymbolHashes and SymbolOffsets sections.
+  uint64_t Bloom;
+  uint64_t Symbols, NumSymbols;
+};
+
+static_assert(sizeof(Header) % alignof(uint64_t) == 0, "Misaligned sections");
+static_assert(sizeof(Lib) % alignof(uint64_t) == 0, "Misaligned sections");
+} // namespace IndexFormat
+
+/// A read-only view of a persistent symbol index. The index remembers what
+/// Dyld learnt about each library, keyed by path and validated by size and
+/// modification time, so that a new process neither rereads unchanged
+/// libraries nor rebuilds their bloom filters and symbol tables.
+class SymbolIndex {
+  std::unique_ptr<MemoryBuffer> m_Buffer;
+  ArrayRef<IndexFormat::Lib> m_Libs;
+  ArrayRef<IndexFormat::Str> m_Lists;
+  ArrayRef<uint64_t> m_Bloom;
+  ArrayRef<uint64_t> m_SymbolHashes;
+  ArrayRef<uint32_t> m_SymbolOffsets;
+  StringRef m_Strings;
+  StringMap<const IndexFormat::Lib*> m_ByPath;
+
+  template <typename T>
+  static ArrayRef<T> slice(ArrayRef<T> A, uint64_t First, uint64_t N) {
+    if (First > A.size() || N > A.size() - First)
+      return {};
+    return A.slice(First, N);
+  }
+
+public:
+  /// Maps \p FileName. Returns false and stays empty if the file is missing,
+  /// corrupt or was written for a different object format.
+  bool load(StringRef FileName, StringRef Format) {
+    using namespace IndexFormat;
+    auto BufOrErr = MemoryBuffer::getFile(FileName, /*IsText=*/false,
+                                          /*RequiresNullTerminator=*/false);
+    if (!BufOrErr)
+      return false;
+
+    StringRef Data = (*BufOrErr)->getBuffer();
+    if (Data.size() < sizeof(Header))
+      return false;
+    const auto* H = reinterpret_cast<const Header*>(Data.data());
+    if (memcmp(H->Magic, kMagic, sizeof(kMagic)) || H->Version != kVersion ||
+        H->ByteOrder != kByteOrderMark)
+      return false;
+
+    uint64_t Offset = sizeof(Header);
+    auto Take = [&](uint64_t Count, size_t EltSize) -> const char* {
+      if (Count > (Data.size() - Offset) / EltSize)
+        return nullptr;
+      const char* Ptr = Data.data() + Offset;
+      Offset += Count * EltSize;
+      return Ptr;
+    };
+    const char* Libs = Take(H->NumLibs, sizeof(Lib));
+    const char* Lists = Libs ? Take(H->NumLists, sizeof(Str)) : nullptr;
+    const char* Bloom = Lists ? Take(H->NumBloomWords, 8) : nullptr;
+    const char* Hashes = Bloom ? Take(H->NumSymbols, 8) : nullptr;
+    const char* Offsets = Hashes ? Take(H->NumSymbols, 4) : nullptr;
+    const char* Strings = Offsets ? Take(H->StringsSize, 1) : nullptr;
+    if (!Strings)
+      return false;
+
+    m_Libs = ArrayRef<Lib>(reinterpret_cast<const Lib*>(Libs), H->NumLibs);
+    m_Lists = ArrayRef<Str>(reinterpret_cast<const Str*>(Lists), H->NumLists);
+    m_Bloom = ArrayRef<uint64_t>(reinterpret_cast<const uint64_t*>(Bloom),
+                                 H->NumBloomWords);
+    m_SymbolHashes = ArrayRef<uint64_t>(
+        reinterpret_cast<const uint64_t*>(Hashes), H->NumSymbols);
+    m_SymbolOffsets = ArrayRef<uint32_t>(
+        reinterpret_cast<const uint32_t*>(Offsets), H->NumSymbols);
+    m_Strings = StringRef(Strings, H->StringsSize);
+    if (str(H->Format) != Format) {
+      *this = SymbolIndex();
+      return false;
+    }
+
+    for (const Lib& L : m_Libs)
+      m_ByPath[str(L.Path)] = &L;
+    m_Buffer = std::move(*BufOrErr);
+    return true;
+  }
+
+  const IndexFormat::Lib* find(StringRef Path) const {
+    auto It = m_ByPath.find(Path);
+    return It == m_ByPath.end() ? nullptr : It->second;
+  }
+
+  ArrayRef<IndexFormat::Lib> libs() const { return m_Libs; }
+
+  StringRef str(const IndexFormat::Str& S) const {
+    if (S.Offset > m_Strings.size() || S.Size > m_Strings.size() - S.Offset)
+      return {};
+    return m_Strings.substr(S.Offset, S.Size);
+  }
+
+  ArrayRef<IndexFormat::Str> list(uint32_t First, uint32_t N) const {
+    return slice(m_Lists, First, N);
+  }
+
+  ArrayRef<uint64_t> bloom(const IndexFormat::Lib& L) const {
+    return slice(m_Bloom, L.Bloom, L.BloomSize);
+  }
+
+  ArrayRef<uint64_t> symbolHashes(const IndexFormat::Lib& L) const {
+    return slice(m_SymbolHashes, L.Symbols, L.NumSymbols);
+  }
+
+  ArrayRef<uint32_t> symbolOffsets(const IndexFormat::Lib& L) const {
+    return slice(m_SymbolOffsets, L.Symbols, L.NumSymbols);
+  }
+};
+
+/// Builds a persistent symbol index in memory and writes it out.
+class SymbolIndexWriter {
+  std::vector<IndexFormat::Lib> m_Libs;
+  std::vector<IndexFormat::Str> m_Lists;
+  std::vector<uint64_t> m_Bloom;
+  std::vector<uint64_t> m_SymbolHashes;
+  std::vector<uint32_t> m_SymbolOffsets;
+  std::string m_Strings;
+
+public:
+  IndexFormat::Str addString(StringRef S) {
+    IndexFormat::Str Result = {m_Strings.size(),
+                               static_cast<uint32_t>(S.size()), 0};
+    m_Strings.append(S.data(), S.size());
+    return Result;
+  }
+
+  /// Returns the index of the first element and sets \p N to the size.
+  template <typename RangeT>
+  uint32_t addList(const RangeT& Items, uint32_t& N) {
+    uint32_t First = m_Lists.size();
+    for (StringRef Item : Items)
+      m_Lists.push_back(addString(Item));
+    N = m_Lists.size() - First;
+    return First;
+  }
+
+  /// Stores the bloom filter and the symbol table of \p L.
+  void addFilter(IndexFormat::Lib& L, BloomKind Kind, uint32_t SymbolsCount,
+                 uint32_t BloomShift, ArrayRef<uint64_t> Words,
+                 const SymbolTable& Symbols, unsigned IgnoreSymbolFlags) {
+    L.Flags |= IndexFormat::kHasFilter;
+    L.BloomKind = static_cast<uint32_t>(Kind);
+    L.IgnoreSymbolFlags = IgnoreSymbolFlags;
+    L.BloomSymbolsCount = SymbolsCount;
+    L.BloomShift = BloomShift;
+    L.BloomSize = Words.size();
+    L.Bloom = m_Bloom.size();
+    m_Bloom.insert(m_Bloom.end(), Words.begin(), Words.end());
+    L.Symbols = m_SymbolHashes.size();
+    L.NumSymbols = Symbols.m_Hashes.size();
+    m_SymbolHashes.insert(m_SymbolHashes.end(), Symbols.m_Hashes.begin(),
+                          Symbols.m_Hashes.end());
+    m_SymbolOffsets.insert(m_SymbolOffsets.end(), Symbols.m_Offsets.begin(),
+                           Symbols.m_Offsets.end());
+  }
+
+  void addLib(const IndexFormat::Lib& L) { m_Libs.push_back(L); }
+
+  /// Writes the index to a temporary file next to \p FileName and renames it
+  /// so that concurrent readers never map a partially written index.
+  bool write(StringRef FileName, StringRef Format) {
+    using namespace IndexFormat;
+    Header H = {};
+    memcpy(H.Magic, kMagic, sizeof(kMagic));
+    H.Version = kVersion;
+    H.ByteOrder = kByteOrderMark;
+    H.Format = addString(Format);
+    H.NumLibs = m_Libs.size();
+    H.NumLists = m_Lists.size();
+    H.NumBloomWords = m_Bloom.size();
+    H.NumSymbols = m_SymbolHashes.size();
+    H.StringsSize = m_Strings.size();
+
+    int FD;
+    SmallString<256> TmpPath;
+    if (sys::fs::createUniqueFile(FileName + "-%%%%%%.tmp", FD, TmpPath))
+      return false;
+
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS.write(reinterpret_cast<const char*>(&H), sizeof(H));
+    OS.write(reinterpret_cast<const char*>(m_Libs.data()),
+             m_Libs.size() * sizeof(Lib));
+    OS.write(reinterpret_cast<const char*>(m_Lists.data()),
+             m_Lists.size() * sizeof(Str));
+    OS.write(reinterpret_cast<const char*>(m_Bloom.data()),
+             m_Bloom.size() * sizeof(uint64_t));
+    OS.write(reinterpret_cast<const char*>(m_SymbolHashes.data()),
+             m_SymbolHashes.size() * sizeof(uint64_t));
+    OS.write(reinterpret_cast<const char*>(m_SymbolOffsets.data()),
+             m_SymbolOffsets.size() * sizeof(uint32_t));
+    OS.write(m_Strings.data(), m_Strings.size());
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TmpPath);
+      return false;
+    }
+
+    if (sys::fs::rename(TmpPath, FileName)) {
+      sys::fs::remove(TmpPath);
+      return false;
+    }
+    return true;
+  }
+};
+
 /// An efficient representation of a full path to a library which does not
 /// duplicate common path patterns reducing the overall memory footprint.
 ///
@@ -140,8 +595,20 @@ struct BloomFilter {
 struct LibraryPath {
   const BasePath& m_Path;
   std::string m_LibName;
+  /// Tracks the initialization and the symbol count for both filter kinds,
+  /// and holds the filter if m_BloomKind is Classic.
   BloomFilter m_Filter;
-  StringSet<> m_Symbols;
+  BlockedBloomFilter m_BlockedFilter;
+  BloomKind m_BloomKind = BloomKind::Classic;
+  /// The storage of the SymbolTable, see GetSymbolTable.
+  std::vector<uint64_t> m_SymbolHashes;
+  std::vector<uint32_t> m_SymbolOffsets;
+  /// The symbol flags ignored when the filter was built.
+  unsigned m_IgnoreSymbolFlags = 0;
+  /// Set when the filter comes from the persistent index. The symbol table
+  /// then stays in the mapped index.
+  const SymbolIndex* m_Index = nullptr;
+  const IndexFormat::Lib* m_IndexEntry = nullptr;
   // std::vector<const LibraryPath*> m_LibDeps;
 
   LibraryPath(const BasePath& Path, const std::string& LibName)
@@ -158,11 +625,35 @@ struct LibraryPath {
     return Vec.str().str();
   }
 
-  void AddBloom(StringRef symbol) { m_Filter.AddHash(GNUHash(symbol)); }
+  /// \p hash is SymbolTable::Hash(symbol).
+  void AddBloom(StringRef symbol, uint64_t hash) {
+    if (m_BloomKind == BloomKind::Blocked)
+      m_BlockedFilter.AddHash(hash);
+    else
+      m_Filter.AddHash(GNUHash(symbol));
+  }
+
+  ArrayRef<uint64_t> GetBloomWords() const {
+    if (m_BloomKind == BloomKind::Blocked)
+      return m_BlockedFilter.GetWords();
+    return m_Filter.m_BloomTable;
+  }
+
+  /// Sets the symbol table from the hash and the name offset of each symbol.
+  void SetSymbolTable(std::vector<std::pair<uint64_t, uint32_t>>& Symbols) {
+    llvm::sort(Symbols);
+    Symbols.erase(std::unique(Symbols.begin(), Symbols.end()), Symbols.end());
+    m_SymbolHashes.resize(Symbols.size());
+    m_SymbolOffsets.resize(Symbols.size());
+    for (size_t I = 0, E = Symbols.size(); I < E; ++I)
+      std::tie(m_SymbolHashes[I], m_SymbolOffsets[I]) = Symbols[I];
+  }
 
-  StringRef AddSymbol(const std::string& symbol) {
-    auto it = m_Symbols.insert(symbol);
-    return it.first->getKey();
+  SymbolTable GetSymbolTable() const {
+    if (m_Index)
+      return {m_Index->symbolHashes(*m_IndexEntry),
+              m_Index->symbolOffsets(*m_IndexEntry)};
+    return {m_SymbolHashes, m_SymbolOffsets};
   }
 
   bool hasBloomFilter() const { return m_Filter.m_IsInitialized; }
@@ -172,23 +663,106 @@ struct LibraryPath {
     return m_Filter.m_SymbolsCount == 0;
   }
 
-  void InitializeBloomFilter(uint32_t newSymbolsCount) {
+  void InitializeBloomFilter(uint32_t newSymbolsCount, BloomKind Kind) {
     assert(!m_Filter.m_IsInitialized &&
            "Cannot re-initialize non-empty filter!");
     m_Filter.m_IsInitialized = true;
-    m_Filter.ResizeTable(newSymbolsCount);
+    m_BloomKind = Kind;
+    if (Kind == BloomKind::Blocked) {
+      m_Filter.m_SymbolsCount = newSymbolsCount;
+      m_BlockedFilter.ResizeTable(newSymbolsCount);
+    } else {
+      m_Filter.ResizeTable(newSymbolsCount);
+    }
+  }
+
+  /// Adopts the filter and the symbol table stored for this library in
+  /// \p Index. Returns false if the stored data is inconsistent.
+  bool InitializeFromIndex(const SymbolIndex& Index,
+                           const IndexFormat::Lib& L) {
+    assert(!m_Filter.m_IsInitialized &&
+           "Cannot re-initialize non-empty filter!");
+    ArrayRef<uint64_t> Words = Index.bloom(L);
+    if (Words.size() != L.BloomSize || (L.BloomSymbolsCount && !L.BloomSize))
+      return false;
+    if (Index.symbolHashes(L).size() != L.NumSymbols ||
+        Index.symbolOffsets(L).size() != L.NumSymbols)
+      return false;
+
+    m_BloomKind = static_cast<BloomKind>(L.BloomKind);
+    if (m_BloomKind == BloomKind::Blocked) {
+      if (!m_BlockedFilter.Assign(Words))
+        return false;
+    } else {
+      m_Filter.m_BloomSize = L.BloomSize;
+      m_Filter.m_BloomShift = L.BloomShift;
+      m_Filter.m_BloomTable.assign(Words.begin(), Words.end());
+    }
+    m_Filter.m_IsInitialized = true;
+    m_Filter.m_SymbolsCount = L.BloomSymbolsCount;
+    m_IgnoreSymbolFlags = L.IgnoreSymbolFlags;
+    m_Index = &Index;
+    m_IndexEntry = &L;
+    return true;
+  }
+
+  bool isFromIndex() const { return m_Index; }
+
+  /// Drops the filter and the symbol table, for example when the data of the
+  /// persistent index turns out to be stale.
+  void ResetBloomFilter() {
+    m_Filter.m_IsInitialized = false;
+    m_Filter.m_SymbolsCount = 0;
+    m_Filter.m_BloomSize = 0;
+    m_Filter.m_BloomShift = 0;
+    m_Filter.m_BloomTable.clear();
+    m_BlockedFilter.m_Blocks.clear();
+    m_SymbolHashes.clear();
+    m_SymbolOffsets.clear();
+    m_Index = nullptr;
+    m_IndexEntry = nullptr;
   }
 
-  bool MayExistSymbol(uint32_t hash) const {
+  /// \p hash is the GNUHash and \p hash64 the SymbolTable::Hash of the
+  /// symbol; the filter kind decides which one is used.
+  bool MayExistSymbol(uint32_t hash, uint64_t hash64) const {
     // The library had no symbols and the bloom filter is empty.
     if (isBloomFilterEmpty())
       return false;
 
+    if (m_BloomKind == BloomKind::Blocked)
+      return m_BlockedFilter.TestHash(hash64);
     return m_Filter.TestHash(hash);
   }
 
-  bool ExistSymbol(StringRef symbol) const {
-    return m_Symbols.find(symbol) != m_Symbols.end();
+  /// Tests a batch of symbols against the bloom filter, see MayExistSymbol.
+  void MayExistSymbols(ArrayRef<uint32_t> hashes, ArrayRef<uint64_t> hashes64,
+                       MutableArrayRef<bool> results) const {
+    assert(hashes.size() == hashes64.size() &&
+           hashes.size() == results.size());
+    if (isBloomFilterEmpty()) {
+      std::fill(results.begin(), results.end(), false);
+      return;
+    }
+
+    if (m_BloomKind == BloomKind::Blocked) {
+      m_BlockedFilter.TestHashes(hashes64, results);
+      return;
+    }
+    for (size_t i = 0, e = hashes.size(); i < e; ++i)
+      results[i] = m_Filter.TestHash(hashes[i]);
+  }
+
+  /// Whether the symbol table may contain the symbol hashed by
+  /// SymbolTable::Hash. Does not touch the object file.
+  bool MayExistInSymbolTable(uint64_t hash) const {
+    return GetSymbolTable().MayContain(hash);
+  }
+
+  /// Whether the library exports \p symbol, confirmed against \p FileData.
+  /// See SymbolTable::Contains.
+  std::optional<bool> ExistSymbol(StringRef symbol, StringRef FileData) const {
+    return GetSymbolTable().Contains(symbol, FileData);
   }
 };
 
@@ -244,10 +818,111 @@ public:
   const std::vector<const LibraryPath*>& GetLibraries() const { return m_Libs; }
 };
 
+/// A bounded, least-recently-used cache of memory mapped object files keyed by
+/// their full path. Symbol lookup touches the same libraries repeatedly and
+/// reopening them means an open, mmap and header parse each time. The cache
+/// owns at most a fixed number of mappings; the underlying file descriptors
+/// are closed once the file is mapped.
+class ObjectFileCache {
+public:
+  using ObjectFilePtr =
+      std::shared_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>;
+
+private:
+  using EntryList = std::list<std::pair<std::string, ObjectFilePtr>>;
+
+  /// Most recently used first.
+  EntryList m_Entries;
+  StringMap<EntryList::iterator> m_Index;
+  size_t m_Capacity;
+
+public:
+  explicit ObjectFileCache(size_t Capacity) : m_Capacity(Capacity) {
+    assert(Capacity && "Cache must hold at least one object file!");
+  }
+
+  /// Returns the object file at \p Path, opening it if it is not cached.
+  /// The returned pointer keeps the mapping alive even if it gets evicted.
+  Expected<ObjectFilePtr> get(StringRef Path) {
+    auto It = m_Index.find(Path);
+    if (It != m_Index.end()) {
+      m_Entries.splice(m_Entries.begin(), m_Entries, It->second);
+      return It->second->second;
+    }
+
+    auto ObjF = llvm::object::ObjectFile::createObjectFile(Path);
+    if (!ObjF)
+      return ObjF.takeError();
+
+    if (m_Entries.size() >= m_Capacity) {
+      m_Index.erase(m_Entries.back().first);
+      m_Entries.pop_back();
+    }
+    auto Obj = std::make_shared<
+        llvm::object::OwningBinary<llvm::object::ObjectFile>>(
+        std::move(ObjF.get()));
+    m_Entries.emplace_front(Path.str(), Obj);
+    m_Index[Path] = m_Entries.begin();
+    return Obj;
+  }
+
+  void erase(StringRef Path) {
+    auto It = m_Index.find(Path);
+    if (It == m_Index.end())
+      return;
+    m_Entries.erase(It->second);
+    m_Index.erase(It);
+  }
+
+  size_t size() const { return m_Entries.size(); }
+};
+
+/// The results of cached_lstat, cached_readlink and cached_realpath. They are
+/// shared by all Dyld instances and guarded by Mutex, which cached_realpath
+/// holds while it resolves a path.
+struct PathCaches {
+  std::recursive_mutex Mutex;
+#ifndef _WIN32
+  StringMap<mode_t> LStat;
+  StringMap<std::string> ReadLink;
+#endif
+  StringMap<std::pair<std::string, int>> RealPath;
+};
+
+static PathCaches& GetPathCaches() {
+  static PathCaches Caches;
+  return Caches;
+}
+
+/// Forgets the cached results for the paths in, or resolving into, \p Dir.
+static void ForgetCachedPaths(StringRef Dir) {
+  PathCaches& Caches = GetPathCaches();
+  std::lock_guard<std::recursive_mutex> Lock(Caches.Mutex);
+  auto EraseIf = [](auto& Cache, auto Pred) {
+    for (auto It = Cache.begin(), E = Cache.end(); It != E;) {
+      auto Cur = It++;
+      if (Pred(*Cur))
+        Cache.erase(Cur);
+    }
+  };
+  auto InDir = [Dir](StringRef Path) {
+    return Path.starts_with(Dir) &&
+           (Path.size() == Dir.size() ||
+            llvm::sys::path::is_separator(Path[Dir.size()]));
+  };
+#ifndef _WIN32
+  EraseIf(Caches.LStat, [&](const auto& E) { return InDir(E.getKey()); });
+  EraseIf(Caches.ReadLink, [&](const auto& E) { return InDir(E.getKey()); });
+#endif
+  EraseIf(Caches.RealPath, [&](const auto& E) {
+    return InDir(E.getKey()) || InDir(E.getValue().first);
+  });
+}
+
 #ifndef _WIN32
 // Cached version of system function lstat
 static inline mode_t cached_lstat(const char* path) {
-  static StringMap<mode_t> lstat_cache;
+  StringMap<mode_t>& lstat_cache = GetPathCaches().LStat;
 
   // If already cached - return cached result
   auto it = lstat_cache.find(path);
@@ -263,7 +938,7 @@ static inline mode_t cached_lstat(const char* path) {
 
 // Cached version of system function readlink
 static inline StringRef cached_readlink(const char* pathname) {
-  static StringMap<std::string> readlink_cache;
+  StringMap<std::string>& readlink_cache = GetPathCaches().ReadLink;
 
   // If already cached - return cached result
   auto it = readlink_cache.find(pathname);
@@ -297,8 +972,10 @@ std::string cached_realpath(StringRef path, StringRef base_path = "",
     return "";
   }
 
+  std::lock_guard<std::recursive_mutex> Lock(GetPathCaches().Mutex);
+
   // If already cached - return cached result
-  static StringMap<std::pair<std::string, int>> cache;
+  StringMap<std::pair<std::string, int>>& cache = GetPathCaches().RealPath;
   bool relative_path = llvm::sys::path::is_relative(path);
   if (!relative_path) {
     auto it = cache.find(path);
@@ -506,6 +1183,20 @@ class Dyld {
 
   bool m_FirstRun = true;
   bool m_FirstRunSysLib = true;
+  /// The DynamicLibraryManager search paths generation scanned last.
+  unsigned m_ScannedGeneration = 0;
+
+  /// What ScanForLibraries saw in a search path. Keyed by the real path, or
+  /// by the search path itself if it did not exist.
+  struct ScannedDir {
+    /// The modification time of the directory, -1 if it did not exist.
+    int64_t MTime = -1;
+    /// When the directory was listed, in the unit of MTime.
+    int64_t ScanTime = 0;
+    bool System = false;
+    std::vector<std::string> Files;
+  };
+  StringMap<ScannedDir> m_ScannedDirs;
   bool m_UseBloomFilter = true;
   bool m_UseHashTable = true;
 
@@ -522,9 +1213,80 @@ class Dyld {
   /// useless iterations.
   LibraryPaths m_QueriedLibraries;
 
+  /// The maximum number of object files kept mapped between queries.
+  static constexpr size_t kMaxMappedObjectFiles = 64;
+
+  /// Object files touched by the symbol lookup. Mutable because the lookups
+  /// are logically const.
+  mutable ObjectFileCache m_ObjectFiles{kMaxMappedObjectFiles};
+
   using PermanentlyIgnoreCallbackProto = std::function<bool(StringRef)>;
   const PermanentlyIgnoreCallbackProto m_ShouldPermanentlyIgnoreCallback;
   const StringRef m_ExecutableFormat;
+  const unsigned m_Threads;
+  const BloomKind m_BloomKind;
+  const bool m_Rescan;
+  const std::vector<llvm::GlobPattern> m_Deny;
+  const std::vector<llvm::GlobPattern> m_Allow;
+
+  /// What ScanForLibraries needs to know about a candidate file. It depends
+  /// only on the file contents and can be computed concurrently.
+  struct LibraryInfo {
+    /// Whether the file is not a usable shared library for this process.
+    bool Ignore = true;
+    /// Whether the ignore callback has the final word on the library.
+    bool AskCallback = false;
+    bool IsPIEExecutable = false;
+    SmallVector<std::string, 2> RPath;
+    SmallVector<std::string, 2> RunPath;
+    std::vector<std::string> Deps;
+    /// The file identity, used to validate the persistent index.
+    uint64_t Size = 0;
+    int64_t MTime = 0;
+    std::string BuildID;
+    /// The entry of the persistent index this information comes from.
+    const IndexFormat::Lib* Indexed = nullptr;
+  };
+
+  /// The files seen by ScanForLibraries. Mutable because lookups replace
+  /// stale persistent index data.
+  mutable StringMap<LibraryInfo> m_Analyzed;
+
+  /// The persistent symbol index, if any, and whether it lags behind what we
+  /// know about the libraries.
+  SymbolIndex m_Index;
+  const std::string m_IndexFile;
+  mutable std::atomic<bool> m_IndexDirty{false};
+
+  /// Reads the object file at \p FileName, or takes what the persistent
+  /// index or another Dyld knows about it if the file did not change. Safe
+  /// to call concurrently.
+  LibraryInfo AnalyzeLibrary(StringRef FileName) const;
+
+  /// Fills \p Info from the object file at \p FileName.
+  void ReadLibraryInfo(StringRef FileName, LibraryInfo& Info) const;
+
+  /// The LibraryInfo read by any Dyld of the process, valid while the file
+  /// keeps its size and modification time. It depends only on the file, so
+  /// the Dyld instances of interpreters with different search paths share
+  /// it.
+  struct SharedLibraryInfos {
+    std::mutex Mutex;
+    StringMap<LibraryInfo> Infos;
+  };
+  static SharedLibraryInfos& GetSharedLibraryInfos();
+
+  LibraryInfo GetInfoFromIndex(const IndexFormat::Lib& L) const;
+
+  /// Adopts the filter of \p Lib from the persistent index if it was built
+  /// with the same \p IgnoreSymbolFlags.
+  bool LoadFilterFromIndex(LibraryPath* Lib, unsigned IgnoreSymbolFlags) const;
+
+  /// Writes what we know about the libraries to the persistent index.
+  void SaveIndex();
+
+  /// Calls \p Fn for each index in [0, N) on up to m_Threads threads.
+  void RunConcurrently(size_t N, llvm::function_ref<void(size_t)> Fn) const;
 
   /// Scan for shared objects which are not yet loaded. They are a our symbol
   /// resolution candidate sources.
@@ -537,6 +1299,28 @@ class Dyld {
   void BuildBloomFilter(LibraryPath* Lib, llvm::object::ObjectFile* BinObjFile,
                         unsigned IgnoreSymbolFlags = 0) const;
 
+  /// Appends the names of the symbols \p BinObjFile defines to \p symbols,
+  /// skipping the ones flagged with \p IgnoreSymbolFlags.
+  static void CollectSymbols(llvm::object::ObjectFile* BinObjFile,
+                             unsigned IgnoreSymbolFlags,
+                             std::vector<StringRef>& symbols);
+
+  /// Maps the demangled qualified names of the C++ symbols defined by a
+  /// library to their mangled names.
+  using QualifiedNameIndex = StringMap<SmallVector<std::string, 1>>;
+
+  /// The QualifiedNameIndex of the libraries queried by qualified name,
+  /// keyed by their full path.
+  StringMap<QualifiedNameIndex> m_QualifiedNames;
+
+  static QualifiedNameIndex
+  BuildQualifiedNameIndex(llvm::object::ObjectFile* BinObjFile,
+                          unsigned IgnoreSymbolFlags);
+
+  /// Builds the missing bloom filters of \p Libs concurrently.
+  void BuildBloomFilters(const LibraryPaths& Libs,
+                         unsigned IgnoreSymbolFlags) const;
+
   /// Looks up symbols from a an object file, representing the library.
   ///\param[in] Lib - full path to the library.
   ///\param[in] mangledName - the mangled name to look for.
@@ -545,20 +1329,73 @@ class Dyld {
   bool ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
                       unsigned IgnoreSymbolFlags = 0) const;
 
-  bool ShouldPermanentlyIgnore(StringRef FileName) const;
+  /// Like ContainsSymbol but with the GNUHash \p hashedMangle and the
+  /// SymbolTable::Hash \p tableHash of the symbol already computed.
+  bool ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
+                      uint32_t hashedMangle, uint64_t tableHash,
+                      unsigned IgnoreSymbolFlags) const;
+
+  /// Performs the first scan of the user or the system libraries if it has
+  /// not happened yet.
+  void EnsureScanned(bool searchSystem);
+
+  /// Forgets the previously matched libraries which got loaded since.
+  void ForgetLoadedLibraries();
+
+  /// Drops everything known about the library at \p FileName, so that the
+  /// next scan registers it anew.
+  void ForgetLibrary(StringRef FileName);
+
+  /// Forgets the libraries which were removed or replaced in the scanned
+  /// user or system directories, judging by the directory modification
+  /// times.
+  ///\returns true if a directory changed and has to be scanned again.
+  bool InvalidateChangedDirs(bool searchSystem);
+
+  bool ShouldPermanentlyIgnore(StringRef FileName,
+                               const LibraryInfo& Info) const;
   void dumpDebugInfo() const;
 
 public:
+  struct Options {
+    /// The number of threads scanning and indexing the libraries. 0 uses all
+    /// hardware threads, 1 scans serially.
+    unsigned Threads = 0;
+    /// The persistent symbol index to use and update, none if empty.
+    std::string IndexFile;
+    /// The kind of the bloom filters built for the libraries.
+    BloomKind Bloom = BloomKind::Blocked;
+    /// Whether to scan the directories again when they change.
+    bool Rescan = true;
+    /// Libraries matching any of these are never searched.
+    std::vector<llvm::GlobPattern> Deny;
+    /// If not empty, only libraries matching one of these are searched.
+    std::vector<llvm::GlobPattern> Allow;
+  };
+
   Dyld(const DynamicLibraryManager& DLM,
-       PermanentlyIgnoreCallbackProto shouldIgnore, StringRef execFormat)
+       PermanentlyIgnoreCallbackProto shouldIgnore, StringRef execFormat,
+       const Options& Opts)
       : m_DynamicLibraryManager(DLM),
         m_ShouldPermanentlyIgnoreCallback(shouldIgnore),
-        m_ExecutableFormat(execFormat) {}
+        m_ExecutableFormat(execFormat), m_Threads(Opts.Threads),
+        m_BloomKind(Opts.Bloom), m_Rescan(Opts.Rescan), m_Deny(Opts.Deny),
+        m_Allow(Opts.Allow), m_IndexFile(Opts.IndexFile) {
+    if (!m_IndexFile.empty())
+      m_Index.load(m_IndexFile, m_ExecutableFormat);
+  }
 
-  ~Dyld() {};
+  ~Dyld() { SaveIndex(); };
 
   std::string searchLibrariesForSymbol(StringRef mangledName,
                                        bool searchSystem);
+
+  std::map<std::string, std::string>
+  searchLibrariesForSymbols(ArrayRef<std::string> mangledNames,
+                            bool searchSystem);
+
+  std::vector<std::pair<std::string, std::string>>
+  searchLibrariesForQualifiedName(StringRef qualifiedName, bool searchSystem);
 };
 
 std::string RPathToStr(SmallVector<StringRef, 2> V) {
@@ -616,6 +1453,259 @@ void HandleDynTab(const ELFFile<ELFT>* Elf, StringRef FileName,
 #undef DEBUG_TYPE
 }
 
+Dyld::SharedLibraryInfos& Dyld::GetSharedLibraryInfos() {
+  static SharedLibraryInfos Infos;
+  return Infos;
+}
+
+Dyld::LibraryInfo Dyld::AnalyzeLibrary(StringRef FileName) const {
+  LibraryInfo Info;
+  sys::fs::file_status Status;
+  if (sys::fs::status(FileName, Status)) {
+    m_IndexDirty = true;
+    ReadLibraryInfo(FileName, Info);
+    return Info;
+  }
+
+  Info.Size = Status.getSize();
+  Info.MTime = Status.getLastModificationTime().time_since_epoch().count();
+  if (const IndexFormat::Lib* L = m_Index.find(FileName))
+    if (L->Size == Info.Size && L->MTime == Info.MTime)
+      return GetInfoFromIndex(*L);
+  m_IndexDirty = true;
+
+  SharedLibraryInfos& Shared = GetSharedLibraryInfos();
+  {
+    std::lock_guard<std::mutex> Lock(Shared.Mutex);
+    auto It = Shared.Infos.find(FileName);
+    if (It != Shared.Infos.end() && It->second.Size == Info.Size &&
+        It->second.MTime == Info.MTime)
+      return It->second;
+  }
+
+  ReadLibraryInfo(FileName, Info);
+
+  std::lock_guard<std::mutex> Lock(Shared.Mutex);
+  Shared.Infos[FileName] = Info;
+  return Info;
+}
+
+void Dyld::ReadLibraryInfo(StringRef FileName, LibraryInfo& Info) const {
+#define DEBUG_TYPE "Dyld:"
+  assert(!m_ExecutableFormat.empty() && "Failed to find the object format!");
+
+  if (!DynamicLibraryManager::isSharedLibrary(FileName))
+    return;
+
+  auto ObjF = llvm::object::ObjectFile::createObjectFile(FileName);
+  if (!ObjF) {
+    llvm::consumeError(ObjF.takeError());
+    LLVM_DEBUG(dbgs() << "[DyLD] Failed to read object file " << FileName
+                      << "\n");
+    return;
+  }
+
+  llvm::object::ObjectFile* file = ObjF.get().getBinary();
+
+  LLVM_DEBUG(dbgs() << "Current executable format: " << m_ExecutableFormat
+                    << ". Executable format of " << FileName << " : "
+                    << file->getFileFormatName() << "\n");
+
+  // Ignore libraries with different format than the executing one.
+  if (m_ExecutableFormat != file->getFileFormatName())
+    return;
+
+  llvm::object::BuildIDRef ID = llvm::object::getBuildID(file);
+  Info.BuildID = toStringRef(ID).str();
+
+  SmallVector<StringRef, 2> RPath;
+  SmallVector<StringRef, 2> RunPath;
+  std::vector<StringRef> Deps;
+  if (llvm::isa<llvm::object::ELFObjectFileBase>(*file)) {
+    bool HasText = false;
+    for (auto S : file->sections()) {
+      llvm::StringRef name = llvm::cantFail(S.getName());
+      if (name == ".text") {
+        // Check if the library has only debug symbols, usually when
+        // stripped with objcopy --only-keep-debug. This check is done by
+        // reading the manual of objcopy and inspection of stripped with
+        // objcopy libraries.
+        auto SecRef = static_cast<llvm::object::ELFSectionRef&>(S);
+        HasText = SecRef.getType() != llvm::ELF::SHT_NOBITS &&
+                  (SecRef.getFlags() & llvm::ELF::SHF_ALLOC) != 0;
+        break;
+      }
+    }
+    if (!HasText)
+      return;
+
+    if (const auto* ELF = dyn_cast<ELF32LEObjectFile>(file))
+      HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
+                   Info.IsPIEExecutable);
+    else if (const auto* ELF = dyn_cast<ELF32BEObjectFile>(file))
+      HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
+                   Info.IsPIEExecutable);
+    else if (const auto* ELF = dyn_cast<ELF64LEObjectFile>(file))
+      HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
+                   Info.IsPIEExecutable);
+    else if (const auto* ELF = dyn_cast<ELF64BEObjectFile>(file))
+      HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
+                   Info.IsPIEExecutable);
+  } else {
+    // FIXME: Handle osx using isStripped after upgrading to llvm9.
+    Info.AskCallback = true;
+
+    if (file->isMachO()) {
+      MachOObjectFile* Obj = (MachOObjectFile*)file;
+      for (const auto& Command : Obj->load_commands()) {
+        if (Command.C.cmd == MachO::LC_LOAD_DYLIB) {
+          // Command.C.cmd == MachO::LC_ID_DYLIB ||
+          // Command.C.cmd == MachO::LC_LOAD_WEAK_DYLIB ||
+          // Command.C.cmd == MachO::LC_REEXPORT_DYLIB ||
+          // Command.C.cmd == MachO::LC_LAZY_LOAD_DYLIB ||
+          // Command.C.cmd == MachO::LC_LOAD_UPWARD_DYLIB ||
+          MachO::dylib_command dylibCmd = Obj->getDylibIDLoadCommand(Command);
+          Deps.push_back(StringRef(Command.Ptr + dylibCmd.dylib.name));
+        } else if (Command.C.cmd == MachO::LC_RPATH) {
+          MachO::rpath_command rpathCmd = Obj->getRpathCommand(Command);
+          SplitPaths(Command.Ptr + rpathCmd.path, RPath,
+                     utils::SplitMode::kAllowNonExistent,
+                     utils::platform::kEnvDelim, false);
+        }
+      }
+    } else if (file->isCOFF()) {
+      // TODO: COFF support
+    }
+  }
+  Info.Ignore = false;
+
+  // The strings point into the object file which is about to be unmapped.
+  for (StringRef P : RPath)
+    Info.RPath.push_back(P.str());
+  for (StringRef P : RunPath)
+    Info.RunPath.push_back(P.str());
+  for (StringRef D : Deps)
+    Info.Deps.push_back(D.str());
+#undef DEBUG_TYPE
+}
+
+Dyld::LibraryInfo Dyld::GetInfoFromIndex(const IndexFormat::Lib& L) const {
+  using namespace IndexFormat;
+  LibraryInfo Info;
+  Info.Ignore = L.Flags & kIgnore;
+  Info.AskCallback = L.Flags & kAskCallback;
+  Info.IsPIEExecutable = L.Flags & kPIEExecutable;
+  for (const Str& S : m_Index.list(L.RPath, L.NumRPath))
+    Info.RPath.push_back(m_Index.str(S).str());
+  for (const Str& S : m_Index.list(L.RunPath, L.NumRunPath))
+    Info.RunPath.push_back(m_Index.str(S).str());
+  for (const Str& S : m_Index.list(L.Deps, L.NumDeps))
+    Info.Deps.push_back(m_Index.str(S).str());
+  Info.Size = L.Size;
+  Info.MTime = L.MTime;
+  Info.BuildID = m_Index.str(L.BuildID).str();
+  Info.Indexed = &L;
+  return Info;
+}
+
+bool Dyld::LoadFilterFromIndex(LibraryPath* Lib,
+                               unsigned IgnoreSymbolFlags) const {
+  if (!m_UseHashTable)
+    return false;
+
+  auto It = m_Analyzed.find(Lib->GetFullName());
+  if (It == m_Analyzed.end() || !It->second.Indexed)
+    return false;
+
+  const IndexFormat::Lib& L = *It->second.Indexed;
+  if (!(L.Flags & IndexFormat::kHasFilter) ||
+      L.IgnoreSymbolFlags != IgnoreSymbolFlags ||
+      L.BloomKind != static_cast<uint32_t>(m_BloomKind))
+    return false;
+
+  return Lib->InitializeFromIndex(m_Index, L);
+}
+
+void Dyld::SaveIndex() {
+  if (m_IndexFile.empty() || !m_IndexDirty)
+    return;
+
+  using namespace IndexFormat;
+  StringMap<const LibraryPath*> Filters;
+  if (m_UseHashTable)
+    for (const LibraryPaths* Libs : {&m_Libraries, &m_SysLibraries})
+      for (const LibraryPath* P : Libs->GetLibraries())
+        if (P->hasBloomFilter())
+          Filters[P->GetFullName()] = P;
+
+  SymbolIndexWriter W;
+  auto AddLib = [&](StringRef Path, const LibraryInfo& Info) {
+    Lib L = {};
+    L.Path = W.addString(Path);
+    L.BuildID = W.addString(Info.BuildID);
+    L.Size = Info.Size;
+    L.MTime = Info.MTime;
+    L.Flags = (Info.Ignore ? kIgnore : 0) |
+              (Info.AskCallback ? kAskCallback : 0) |
+              (Info.IsPIEExecutable ? kPIEExecutable : 0);
+    L.Deps = W.addList(Info.Deps, L.NumDeps);
+    L.RPath = W.addList(Info.RPath, L.NumRPath);
+    L.RunPath = W.addList(Info.RunPath, L.NumRunPath);
+
+    auto It = Filters.find(Path);
+    if (It != Filters.end()) {
+      const LibraryPath* P = It->second;
+      W.addFilter(L, P->m_BloomKind, P->m_Filter.m_SymbolsCount,
+                  P->m_Filter.m_BloomShift, P->GetBloomWords(),
+                  P->GetSymbolTable(), P->m_IgnoreSymbolFlags);
+    } else if (Info.Indexed && (Info.Indexed->Flags & kHasFilter)) {
+      // Keep the filter of an unchanged library we did not need this time.
+      const Lib& Old = *Info.Indexed;
+      W.addFilter(L, static_cast<BloomKind>(Old.BloomKind),
+                  Old.BloomSymbolsCount, Old.BloomShift, m_Index.bloom(Old),
+                  {m_Index.symbolHashes(Old), m_Index.symbolOffsets(Old)},
+                  Old.IgnoreSymbolFlags);
+    }
+    W.addLib(L);
+  };
+
+  std::vector<StringRef> Paths;
+  for (const auto& Entry : m_Analyzed)
+    Paths.push_back(Entry.getKey());
+  std::sort(Paths.begin(), Paths.end());
+  for (StringRef Path : Paths)
+    AddLib(Path, m_Analyzed.find(Path)->second);
+
+  // Keep the entries of other processes unless their file disappeared.
+  for (const Lib& L : m_Index.libs()) {
+    StringRef Path = m_Index.str(L.Path);
+    if (!m_Analyzed.count(Path) && sys::fs::exists(Path))
+      AddLib(Path, GetInfoFromIndex(L));
+  }
+
+  if (W.write(m_IndexFile, m_ExecutableFormat))
+    m_IndexDirty = false;
+}
+
+void Dyld::RunConcurrently(size_t N,
+                           llvm::function_ref<void(size_t)> Fn) const {
+  if (m_Threads == 1 || N < 2) {
+    for (size_t I = 0; I < N; ++I)
+      Fn(I);
+    return;
+  }
+
+  // Hand out indices one by one; the cost per library varies a lot.
+  llvm::DefaultThreadPool Pool(llvm::hardware_concurrency(m_Threads));
+  std::atomic<size_t> Next{0};
+  for (unsigned T = 0, E = Pool.getMaxConcurrency(); T < E; ++T)
+    Pool.async([&]() {
+      for (size_t I = Next++; I < N; I = Next++)
+        Fn(I);
+    });
+  Pool.wait();
+}
+
 void Dyld::ScanForLibraries(bool searchSystemLibraries /* = false*/) {
 #define DEBUG_TYPE "Dyld:ScanForLibraries:"
 
@@ -630,6 +1720,10 @@ void Dyld::ScanForLibraries(bool searchSystemLibraries /* = false*/) {
 #endif
   llvm::SmallSet<const BasePath*, 32> ScannedPaths;
 
+  // Collect the candidates first. Listing directories is cheap and keeps the
+  // order in which the libraries get registered independent of the number of
+  // threads reading them.
+  std::vector<std::string> Candidates;
   for (const DynamicLibraryManager::SearchPathInfo& Info : searchPaths) {
     if (Info.IsUser != searchSystemLibraries) {
       // Examples which we should handle.
@@ -663,8 +1757,16 @@ void Dyld::ScanForLibraries(bool searchSystemLibraries /* = false*/) {
       llvm::StringRef DirPath(RealPath);
       LLVM_DEBUG(dbgs() << RealPath << "\n");
 
-      if (!llvm::sys::fs::is_directory(DirPath) || DirPath.empty())
+      sys::fs::file_status DirStatus;
+      if (DirPath.empty() || sys::fs::status(DirPath, DirStatus) ||
+          !sys::fs::is_directory(DirStatus)) {
+        // Notice when it gets created.
+        ScannedDir& Dir = m_ScannedDirs[DirPath.empty() ? StringRef(Info.Path)
+                                                        : DirPath];
+        Dir.MTime = -1;
+        Dir.System = searchSystemLibraries;
         continue;
+      }
 
       // Already searched?
       const BasePath& ScannedBPath = m_BasePaths.RegisterBasePath(RealPath);
@@ -674,156 +1776,10 @@ void Dyld::ScanForLibraries(bool searchSystemLibraries /* = false*/) {
         continue;
       }
 
-      // FileName must be always full/absolute/resolved file name.
-      std::function<void(llvm::StringRef, unsigned)> HandleLib =
-          [&](llvm::StringRef FileName, unsigned level) {
-            LLVM_DEBUG(dbgs()
-                       << "Dyld::ScanForLibraries HandleLib:" << FileName.str()
-                       << ", level=" << level << " -> ");
-
-            llvm::StringRef FileRealPath =
-                llvm::sys::path::parent_path(FileName);
-            llvm::StringRef FileRealName = llvm::sys::path::filename(FileName);
-            const BasePath& BaseP =
-                m_BasePaths.RegisterBasePath(FileRealPath.str());
-            LibraryPath LibPath(BaseP, FileRealName.str()); // bp, str
-
-            if (m_SysLibraries.GetRegisteredLib(LibPath) ||
-                m_Libraries.GetRegisteredLib(LibPath)) {
-              LLVM_DEBUG(dbgs() << "Already handled!!!\n");
-              return;
-            }
-
-            if (ShouldPermanentlyIgnore(FileName)) {
-              LLVM_DEBUG(dbgs() << "PermanentlyIgnored!!!\n");
-              return;
-            }
-
-            if (searchSystemLibraries)
-              m_SysLibraries.RegisterLib(LibPath);
-            else
-              m_Libraries.RegisterLib(LibPath);
-
-            // Handle lib dependencies
-            llvm::SmallVector<llvm::StringRef, 2> RPath;
-            llvm::SmallVector<llvm::StringRef, 2> RunPath;
-            std::vector<StringRef> Deps;
-            auto ObjFileOrErr =
-                llvm::object::ObjectFile::createObjectFile(FileName);
-            if (llvm::Error Err = ObjFileOrErr.takeError()) {
-              std::string Message;
-              handleAllErrors(std::move(Err), [&](llvm::ErrorInfoBase& EIB) {
-                Message += EIB.message() + "; ";
-              });
-              LLVM_DEBUG(
-                  dbgs()
-                  << "Dyld::ScanForLibraries: Failed to read object file "
-                  << FileName.str() << " Errors: " << Message << "\n");
-              return;
-            }
-            llvm::object::ObjectFile* BinObjF = ObjFileOrErr.get().getBinary();
-            if (BinObjF->isELF()) {
-              bool isPIEExecutable = false;
-
-              if (const auto* ELF = dyn_cast<ELF32LEObjectFile>(BinObjF))
-                HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
-                             isPIEExecutable);
-              else if (const auto* ELF = dyn_cast<ELF32BEObjectFile>(BinObjF))
-                HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
-                             isPIEExecutable);
-              else if (const auto* ELF = dyn_cast<ELF64LEObjectFile>(BinObjF))
-                HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
-                             isPIEExecutable);
-              else if (const auto* ELF = dyn_cast<ELF64BEObjectFile>(BinObjF))
-                HandleDynTab(&ELF->getELFFile(), FileName, RPath, RunPath, Deps,
-                             isPIEExecutable);
-
-              if ((level == 0) && isPIEExecutable) {
-                if (searchSystemLibraries)
-                  m_SysLibraries.UnregisterLib(LibPath);
-                else
-                  m_Libraries.UnregisterLib(LibPath);
-                return;
-              }
-            } else if (BinObjF->isMachO()) {
-              MachOObjectFile* Obj = (MachOObjectFile*)BinObjF;
-              for (const auto& Command : Obj->load_commands()) {
-                if (Command.C.cmd == MachO::LC_LOAD_DYLIB) {
-                  // Command.C.cmd == MachO::LC_ID_DYLIB ||
-                  // Command.C.cmd == MachO::LC_LOAD_WEAK_DYLIB ||
-                  // Command.C.cmd == MachO::LC_REEXPORT_DYLIB ||
-                  // Command.C.cmd == MachO::LC_LAZY_LOAD_DYLIB ||
-                  // Command.C.cmd == MachO::LC_LOAD_UPWARD_DYLIB ||
-                  MachO::dylib_command dylibCmd =
-                      Obj->getDylibIDLoadCommand(Command);
-                  Deps.push_back(StringRef(Command.Ptr + dylibCmd.dylib.name));
-                } else if (Command.C.cmd == MachO::LC_RPATH) {
-                  MachO::rpath_command rpathCmd = Obj->getRpathCommand(Command);
-                  SplitPaths(Command.Ptr + rpathCmd.path, RPath,
-                             utils::SplitMode::kAllowNonExistent,
-                             utils::platform::kEnvDelim, false);
-                }
-              }
-            } else if (BinObjF->isCOFF()) {
-              // TODO: COFF support
-            }
-
-            LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries: Deps Info:\n");
-            LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries:   RPATH="
-                              << RPathToStr(RPath) << "\n");
-            LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries:   RUNPATH="
-                              << RPathToStr(RunPath) << "\n");
-#ifndef NDEBUG
-            int x = 0;
-            for (StringRef dep : Deps)
-              LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries:   Deps[" << x++
-                                << "]=" << dep.str() << "\n");
-#endif
-            // Heuristics for workaround performance problems:
-            // (H1) If RPATH and RUNPATH == "" -> skip handling Deps
-            if (RPath.empty() && RunPath.empty()) {
-              LLVM_DEBUG(
-                  dbgs()
-                  << "Dyld::ScanForLibraries: Skip all deps by Heuristic1: "
-                  << FileName.str() << "\n");
-              return;
-            };
-            // (H2) If RPATH subset of LD_LIBRARY_PATH &&
-            //         RUNPATH subset of LD_LIBRARY_PATH  -> skip handling Deps
-            if (std::all_of(
-                    RPath.begin(), RPath.end(),
-                    [&](StringRef item) {
-                      return std::any_of(
-                          searchPaths.begin(), searchPaths.end(),
-                          [&](DynamicLibraryManager::SearchPathInfo item1) {
-                            return item == item1.Path;
-                          });
-                    }) &&
-                std::all_of(
-                    RunPath.begin(), RunPath.end(), [&](StringRef item) {
-                      return std::any_of(
-                          searchPaths.begin(), searchPaths.end(),
-                          [&](DynamicLibraryManager::SearchPathInfo item1) {
-                            return item == item1.Path;
-                          });
-                    })) {
-              LLVM_DEBUG(
-                  dbgs()
-                  << "Dyld::ScanForLibraries: Skip all deps by Heuristic2: "
-                  << FileName.str() << "\n");
-              return;
-            }
-
-            // Handle dependencies
-            for (StringRef dep : Deps) {
-              std::string dep_full = m_DynamicLibraryManager.lookupLibrary(
-                  dep, RPath, RunPath, FileName, false);
-              HandleLib(dep_full, level + 1);
-            }
-          };
-
       LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries: Iterator: " << DirPath
                         << "\n");
+      size_t FirstCandidate = Candidates.size();
+      sys::TimePoint<> ScanTime = std::chrono::system_clock::now();
       std::error_code EC;
       for (llvm::sys::fs::directory_iterator DirIt(DirPath, EC), DirEnd;
            DirIt != DirEnd && !EC; DirIt.increment(EC)) {
@@ -834,41 +1790,157 @@ void Dyld::ScanForLibraries(bool searchSystemLibraries /* = false*/) {
 
         const llvm::sys::fs::file_type ft = DirIt->type();
         if (ft == llvm::sys::fs::file_type::regular_file) {
-          HandleLib(DirIt->path(), 0);
+          Candidates.push_back(DirIt->path());
         } else if (ft == llvm::sys::fs::file_type::symlink_file) {
-          std::string DepFileName_str = cached_realpath(DirIt->path());
-          llvm::StringRef DepFileName = DepFileName_str;
+          std::string DepFileName = cached_realpath(DirIt->path());
           assert(!llvm::sys::fs::is_symlink_file(DepFileName));
           if (!llvm::sys::fs::is_directory(DepFileName))
-            HandleLib(DepFileName, 0);
+            Candidates.push_back(std::move(DepFileName));
         }
       }
 
       // Register the DirPath as fully scanned.
       ScannedPaths.insert(&ScannedBPath);
+      ScannedDir& Dir = m_ScannedDirs[DirPath];
+      Dir.MTime =
+          DirStatus.getLastModificationTime().time_since_epoch().count();
+      Dir.ScanTime = ScanTime.time_since_epoch().count();
+      Dir.System = searchSystemLibraries;
+      Dir.Files.assign(Candidates.begin() + FirstCandidate, Candidates.end());
     }
   }
+
+  // Reading the object files is the expensive part; do it up front and
+  // concurrently. Dependencies outside of the scanned directories are read on
+  // demand.
+  if (m_Threads != 1) {
+    std::vector<LibraryInfo> Infos(Candidates.size());
+    RunConcurrently(Candidates.size(), [&](size_t I) {
+      if (!m_Analyzed.count(Candidates[I]))
+        Infos[I] = AnalyzeLibrary(Candidates[I]);
+    });
+    for (size_t I = 0, E = Candidates.size(); I < E; ++I)
+      if (!m_Analyzed.count(Candidates[I]))
+        m_Analyzed.try_emplace(Candidates[I], std::move(Infos[I]));
+  }
+
+  auto GetLibraryInfo = [&](StringRef FileName) -> const LibraryInfo& {
+    auto It = m_Analyzed.find(FileName);
+    if (It != m_Analyzed.end())
+      return It->second;
+    return m_Analyzed.try_emplace(FileName, AnalyzeLibrary(FileName))
+        .first->second;
+  };
+
+  // FileName must be always full/absolute/resolved file name.
+  std::function<void(llvm::StringRef, unsigned)> HandleLib =
+      [&](llvm::StringRef FileName, unsigned level) {
+        LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries HandleLib:"
+                          << FileName.str() << ", level=" << level << " -> ");
+
+        llvm::StringRef FileRealPath = llvm::sys::path::parent_path(FileName);
+        llvm::StringRef FileRealName = llvm::sys::path::filename(FileName);
+        const BasePath& BaseP =
+            m_BasePaths.RegisterBasePath(FileRealPath.str());
+        LibraryPath LibPath(BaseP, FileRealName.str()); // bp, str
+
+        if (m_SysLibraries.GetRegisteredLib(LibPath) ||
+            m_Libraries.GetRegisteredLib(LibPath)) {
+          LLVM_DEBUG(dbgs() << "Already handled!!!\n");
+          return;
+        }
+
+        // No need to check linked libraries, as this function is only
+        // invoked for symbols that cannot be found (neither by dlsym nor in
+        // the JIT).
+        if (m_DynamicLibraryManager.isLibraryLoaded(FileName)) {
+          LLVM_DEBUG(dbgs() << "PermanentlyIgnored!!!\n");
+          return;
+        }
+
+        const LibraryInfo& LibInfo = GetLibraryInfo(FileName);
+        if (ShouldPermanentlyIgnore(FileName, LibInfo)) {
+          LLVM_DEBUG(dbgs() << "PermanentlyIgnored!!!\n");
+          return;
+        }
+
+        if ((level == 0) && LibInfo.IsPIEExecutable)
+          return;
+
+        if (searchSystemLibraries)
+          m_SysLibraries.RegisterLib(LibPath);
+        else
+          m_Libraries.RegisterLib(LibPath);
+
+        // Handle lib dependencies
+        llvm::SmallVector<llvm::StringRef, 2> RPath(LibInfo.RPath.begin(),
+                                                    LibInfo.RPath.end());
+        llvm::SmallVector<llvm::StringRef, 2> RunPath(LibInfo.RunPath.begin(),
+                                                      LibInfo.RunPath.end());
+
+        LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries: Deps Info:\n");
+        LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries:   RPATH="
+                          << RPathToStr(RPath) << "\n");
+        LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries:   RUNPATH="
+                          << RPathToStr(RunPath) << "\n");
+#ifndef NDEBUG
+        int x = 0;
+        for (const std::string& dep : LibInfo.Deps)
+          LLVM_DEBUG(dbgs() << "Dyld::ScanForLibraries:   Deps[" << x++
+                            << "]=" << dep << "\n");
+#endif
+        // Heuristics for workaround performance problems:
+        // (H1) If RPATH and RUNPATH == "" -> skip handling Deps
+        if (RPath.empty() && RunPath.empty()) {
+          LLVM_DEBUG(dbgs()
+                     << "Dyld::ScanForLibraries: Skip all deps by Heuristic1: "
+                     << FileName.str() << "\n");
+          return;
+        };
+        // (H2) If RPATH subset of LD_LIBRARY_PATH &&
+        //         RUNPATH subset of LD_LIBRARY_PATH  -> skip handling Deps
+        if (std::all_of(
+                RPath.begin(), RPath.end(),
+                [&](StringRef item) {
+                  return std::any_of(
+                      searchPaths.begin(), searchPaths.end(),
+                      [&](DynamicLibraryManager::SearchPathInfo item1) {
+                        return item == item1.Path;
+                      });
+                }) &&
+            std::all_of(RunPath.begin(), RunPath.end(), [&](StringRef item) {
+              return std::any_of(
+                  searchPaths.begin(), searchPaths.end(),
+                  [&](DynamicLibraryManager::SearchPathInfo item1) {
+                    return item == item1.Path;
+                  });
+            })) {
+          LLVM_DEBUG(dbgs()
+                     << "Dyld::ScanForLibraries: Skip all deps by Heuristic2: "
+                     << FileName.str() << "\n");
+          return;
+        }
+
+        // Handle dependencies
+        for (const std::string& dep : LibInfo.Deps) {
+          std::string dep_full = m_DynamicLibraryManager.lookupLibrary(
+              dep, RPath, RunPath, FileName, false);
+          HandleLib(dep_full, level + 1);
+        }
+      };
+
+  for (const std::string& Candidate : Candidates)
+    HandleLib(Candidate, 0);
 #undef DEBUG_TYPE
 }
 
-void Dyld::BuildBloomFilter(LibraryPath* Lib,
-                            llvm::object::ObjectFile* BinObjFile,
-                            unsigned IgnoreSymbolFlags /*= 0*/) const {
-#define DEBUG_TYPE "Dyld::BuildBloomFilter:"
-  assert(m_UseBloomFilter && "Bloom filter is disabled");
-  assert(!Lib->hasBloomFilter() && "Already built!");
-
+void Dyld::CollectSymbols(llvm::object::ObjectFile* BinObjFile,
+                          unsigned IgnoreSymbolFlags,
+                          std::vector<StringRef>& symbols) {
+#define DEBUG_TYPE "Dyld::CollectSymbols:"
   using namespace llvm;
   using namespace llvm::object;
 
-  LLVM_DEBUG(
-      dbgs() << "Dyld::BuildBloomFilter: Start building Bloom filter for: "
-             << Lib->GetFullName() << "\n");
-
-  // If BloomFilter is empty then build it.
-  // Count Symbols and generate BloomFilter
-  uint32_t SymbolsCount = 0;
-  std::list<llvm::StringRef> symbols;
   for (const llvm::object::SymbolRef& S : BinObjFile->symbols()) {
     uint32_t Flags = llvm::cantFail(S.getFlags());
     // Do not insert in the table symbols flagged to ignore.
@@ -886,7 +1958,7 @@ void Dyld::BuildBloomFilter(LibraryPath* Lib,
 
     llvm::Expected<llvm::StringRef> SymNameErr = S.getName();
     if (!SymNameErr) {
-      LLVM_DEBUG(dbgs() << "Dyld::BuildBloomFilter: Failed to read symbol "
+      LLVM_DEBUG(dbgs() << "Dyld::CollectSymbols: Failed to read symbol "
                         << SymNameErr.get() << "\n");
       continue;
     }
@@ -894,7 +1966,6 @@ void Dyld::BuildBloomFilter(LibraryPath* Lib,
     if (SymNameErr.get().empty())
       continue;
 
-    ++SymbolsCount;
     symbols.push_back(SymNameErr.get());
   }
 
@@ -919,7 +1990,7 @@ void Dyld::BuildBloomFilter(LibraryPath* Lib,
 
       llvm::Expected<StringRef> SymNameErr = S.getName();
       if (!SymNameErr) {
-        LLVM_DEBUG(dbgs() << "Dyld::BuildBloomFilter: Failed to read symbol "
+        LLVM_DEBUG(dbgs() << "Dyld::CollectSymbols: Failed to read symbol "
                           << SymNameErr.get() << "\n");
         continue;
       }
@@ -927,7 +1998,6 @@ void Dyld::BuildBloomFilter(LibraryPath* Lib,
       if (SymNameErr.get().empty())
         continue;
 
-      ++SymbolsCount;
       symbols.push_back(SymNameErr.get());
     }
   } else if (BinObjFile->isCOFF()) { // On Windows, the symbols are present in
@@ -950,19 +2020,77 @@ void Dyld::BuildBloomFilter(LibraryPath* Lib,
         handleAllErrors(std::move(Err), [&](llvm::ErrorInfoBase& EIB) {
           Message += EIB.message() + "; ";
         });
-        LLVM_DEBUG(dbgs() << "Dyld::BuildBloomFilter: Failed to read symbol "
+        LLVM_DEBUG(dbgs() << "Dyld::CollectSymbols: Failed to read symbol "
                           << Message << "\n");
         continue;
       }
       if (Name.empty())
         continue;
 
-      ++SymbolsCount;
       symbols.push_back(Name);
     }
   }
+#undef DEBUG_TYPE
+}
+
+Dyld::QualifiedNameIndex
+Dyld::BuildQualifiedNameIndex(llvm::object::ObjectFile* BinObjFile,
+                              unsigned IgnoreSymbolFlags) {
+  std::vector<StringRef> symbols;
+  CollectSymbols(BinObjFile, IgnoreSymbolFlags, symbols);
+
+  QualifiedNameIndex Index;
+  llvm::ItaniumPartialDemangler Demangler;
+  // Reused by the demangler for all names.
+  char* Buf = nullptr;
+  size_t BufSize = 0;
+  std::string Mangled;
+  for (StringRef Name : symbols) {
+    // Mach-O adds a leading underscore to the lowered names.
+    StringRef ItaniumName = Name;
+    if (ItaniumName.starts_with("__Z"))
+      ItaniumName = ItaniumName.drop_front();
+    if (!ItaniumName.starts_with("_Z"))
+      continue;
 
-  Lib->InitializeBloomFilter(SymbolsCount);
+    Mangled = ItaniumName.str();
+    if (Demangler.partialDemangle(Mangled.c_str()))
+      continue;
+    // Functions are looked up without their parameters. Anything else, such
+    // as variables, demangles to its qualified name as is.
+    char* Result = Demangler.isFunction()
+                       ? Demangler.getFunctionName(Buf, &BufSize)
+                       : Demangler.finishDemangle(Buf, &BufSize);
+    if (!Result)
+      continue;
+    Buf = Result;
+    Index[Buf].push_back(Name.str());
+  }
+  std::free(Buf);
+  return Index;
+}
+
+void Dyld::BuildBloomFilter(LibraryPath* Lib,
+                            llvm::object::ObjectFile* BinObjFile,
+                            unsigned IgnoreSymbolFlags /*= 0*/) const {
+#define DEBUG_TYPE "Dyld::BuildBloomFilter:"
+  assert(m_UseBloomFilter && "Bloom filter is disabled");
+  assert(!Lib->hasBloomFilter() && "Already built!");
+
+  using namespace llvm;
+  using namespace llvm::object;
+
+  LLVM_DEBUG(
+      dbgs() << "Dyld::BuildBloomFilter: Start building Bloom filter for: "
+             << Lib->GetFullName() << "\n");
+
+  std::vector<StringRef> symbols;
+  CollectSymbols(BinObjFile, IgnoreSymbolFlags, symbols);
+  uint32_t SymbolsCount = symbols.size();
+
+  Lib->InitializeBloomFilter(SymbolsCount, m_BloomKind);
+  Lib->m_IgnoreSymbolFlags = IgnoreSymbolFlags;
+  m_IndexDirty = true;
 
   if (!SymbolsCount) {
     LLVM_DEBUG(dbgs() << "Dyld::BuildBloomFilter: No symbols!\n");
@@ -976,17 +2104,30 @@ void Dyld::BuildBloomFilter(LibraryPath* Lib,
                       << "- " << it << "\n");
 #endif
   // Generate BloomFilter
+  std::vector<std::pair<uint64_t, uint32_t>> Table;
+  if (m_UseHashTable)
+    Table.reserve(SymbolsCount);
+  StringRef FileData = BinObjFile->getData();
   for (const auto& S : symbols) {
+    uint64_t Hash = SymbolTable::Hash(S);
+    Lib->AddBloom(S, Hash);
     if (m_UseHashTable)
-      Lib->AddBloom(Lib->AddSymbol(S.str()));
-    else
-      Lib->AddBloom(S);
+      Table.emplace_back(Hash, SymbolTable::GetOffset(FileData, S));
   }
+  if (m_UseHashTable)
+    Lib->SetSymbolTable(Table);
 #undef DEBUG_TYPE
 }
 
 bool Dyld::ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
                           unsigned IgnoreSymbolFlags /*= 0*/) const {
+  return ContainsSymbol(Lib, mangledName, GNUHash(mangledName),
+                        SymbolTable::Hash(mangledName), IgnoreSymbolFlags);
+}
+
+bool Dyld::ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
+                          uint32_t hashedMangle, uint64_t tableHash,
+                          unsigned IgnoreSymbolFlags) const {
 #define DEBUG_TYPE "Dyld::ContainsSymbol:"
   const std::string library_filename = Lib->GetFullName();
 
@@ -994,7 +2135,26 @@ bool Dyld::ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
                     << library_filename << ", mangled=" << mangledName.str()
                     << "\n");
 
-  auto ObjF = llvm::object::ObjectFile::createObjectFile(library_filename);
+  if (m_UseBloomFilter && !Lib->hasBloomFilter())
+    LoadFilterFromIndex(const_cast<LibraryPath*>(Lib), IgnoreSymbolFlags);
+
+  // Once our bloom filter is built most libraries can be ruled out without
+  // touching the object file at all.
+  bool HadBloomFilter = m_UseBloomFilter && Lib->hasBloomFilter();
+  if (HadBloomFilter) {
+    if (!Lib->MayExistSymbol(hashedMangle, tableHash)) {
+      LLVM_DEBUG(dbgs() << "Dyld::ContainsSymbol: BloomFilter: Skip symbol <"
+                        << mangledName.str() << ">.\n");
+      return false;
+    }
+    if (m_UseHashTable && !Lib->MayExistInSymbolTable(tableHash)) {
+      LLVM_DEBUG(dbgs() << "Dyld::ContainsSymbol: HashTable: Symbol "
+                        << "Not exist\n");
+      return false;
+    }
+  }
+
+  auto ObjF = m_ObjectFiles.get(library_filename);
   if (llvm::Error Err = ObjF.takeError()) {
     std::string Message;
     handleAllErrors(std::move(Err), [&](llvm::ErrorInfoBase& EIB) {
@@ -1005,9 +2165,27 @@ bool Dyld::ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
     return false;
   }
 
-  llvm::object::ObjectFile* BinObjFile = ObjF.get().getBinary();
+  ObjectFileCache::ObjectFilePtr ObjFile = *ObjF;
+  llvm::object::ObjectFile* BinObjFile = ObjFile->getBinary();
+
+  // The persistent index was matched by size and modification time only.
+  // Compare the build id before trusting it with a match.
+  if (Lib->isFromIndex()) {
+    StringRef BuildID = toStringRef(llvm::object::getBuildID(BinObjFile));
+    if (BuildID != m_Index.str(Lib->m_IndexEntry->BuildID)) {
+      LLVM_DEBUG(dbgs() << "Dyld::ContainsSymbol: Stale index entry for "
+                        << library_filename << "\n");
+      const_cast<LibraryPath*>(Lib)->ResetBloomFilter();
+      HadBloomFilter = false;
+      auto It = m_Analyzed.find(library_filename);
+      if (It != m_Analyzed.end()) {
+        It->second.BuildID = BuildID.str();
+        It->second.Indexed = nullptr;
+      }
+      m_IndexDirty = true;
+    }
+  }
 
-  uint32_t hashedMangle = GNUHash(mangledName);
   // Check for the gnu.hash section if ELF.
   // If the symbol doesn't exist, exit early.
   if (BinObjFile->isELF() &&
@@ -1017,28 +2195,33 @@ bool Dyld::ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
     return false;
   }
 
-  if (m_UseBloomFilter) {
+  if (m_UseBloomFilter && !HadBloomFilter) {
     // Use our bloom filters and create them if necessary.
-    if (!Lib->hasBloomFilter())
-      BuildBloomFilter(const_cast<LibraryPath*>(Lib), BinObjFile,
-                       IgnoreSymbolFlags);
+    BuildBloomFilter(const_cast<LibraryPath*>(Lib), BinObjFile,
+                     IgnoreSymbolFlags);
 
     // If the symbol does not exist, exit early. In case it may exist, iterate.
-    if (!Lib->MayExistSymbol(hashedMangle)) {
+    if (!Lib->MayExistSymbol(hashedMangle, tableHash)) {
       LLVM_DEBUG(dbgs() << "Dyld::ContainsSymbol: BloomFilter: Skip symbol <"
                         << mangledName.str() << ">.\n");
       return false;
     }
+  }
+  if (m_UseBloomFilter)
     LLVM_DEBUG(dbgs() << "Dyld::ContainsSymbol: BloomFilter: Symbol <"
                       << mangledName.str() << "> May exist."
                       << " Search for it. ");
-  }
 
   if (m_UseHashTable) {
-    bool result = Lib->ExistSymbol(mangledName);
-    LLVM_DEBUG(dbgs() << "Dyld::ContainsSymbol: HashTable: Symbol "
-                      << (result ? "Exist" : "Not exist") << "\n");
-    return result;
+    // The table stores no names; confirm the match in the object file. If
+    // that is not possible fall back to iterating the symbols.
+    std::optional<bool> result =
+        Lib->ExistSymbol(mangledName, BinObjFile->getData());
+    if (result) {
+      LLVM_DEBUG(dbgs() << "Dyld::ContainsSymbol: HashTable: Symbol "
+                        << (*result ? "Exist" : "Not exist") << "\n");
+      return *result;
+    }
   }
 
   auto ForeachSymbol =
@@ -1111,57 +2294,43 @@ bool Dyld::ContainsSymbol(const LibraryPath* Lib, StringRef mangledName,
 #undef DEBUG_TYPE
 }
 
-bool Dyld::ShouldPermanentlyIgnore(StringRef FileName) const {
-#define DEBUG_TYPE "Dyld:"
-  assert(!m_ExecutableFormat.empty() && "Failed to find the object format!");
-
-  if (!DynamicLibraryManager::isSharedLibrary(FileName))
+bool Dyld::ShouldPermanentlyIgnore(StringRef FileName,
+                                   const LibraryInfo& Info) const {
+  if (Info.Ignore)
     return true;
 
-  // No need to check linked libraries, as this function is only invoked
-  // for symbols that cannot be found (neither by dlsym nor in the JIT).
-  if (m_DynamicLibraryManager.isLibraryLoaded(FileName))
-    return true;
-
-  auto ObjF = llvm::object::ObjectFile::createObjectFile(FileName);
-  if (!ObjF) {
-    llvm::consumeError(ObjF.takeError());
-    LLVM_DEBUG(dbgs() << "[DyLD] Failed to read object file " << FileName
-                      << "\n");
+  // The user's filters apply to every format, unlike the callback which
+  // only decides for the libraries that could not be classified.
+  auto Matches = [FileName](const std::vector<llvm::GlobPattern>& Patterns) {
+    return llvm::any_of(Patterns, [FileName](const llvm::GlobPattern& P) {
+      return P.match(FileName);
+    });
+  };
+  if (Matches(m_Deny) || (!m_Allow.empty() && !Matches(m_Allow)))
     return true;
-  }
-
-  llvm::object::ObjectFile* file = ObjF.get().getBinary();
 
-  LLVM_DEBUG(dbgs() << "Current executable format: " << m_ExecutableFormat
-                    << ". Executable format of " << FileName << " : "
-                    << file->getFileFormatName() << "\n");
-
-  // Ignore libraries with different format than the executing one.
-  if (m_ExecutableFormat != file->getFileFormatName())
-    return true;
+  return Info.AskCallback && m_ShouldPermanentlyIgnoreCallback(FileName);
+}
 
-  if (llvm::isa<llvm::object::ELFObjectFileBase>(*file)) {
-    for (auto S : file->sections()) {
-      llvm::StringRef name = llvm::cantFail(S.getName());
-      if (name == ".text") {
-        // Check if the library has only debug symbols, usually when
-        // stripped with objcopy --only-keep-debug. This check is done by
-        // reading the manual of objcopy and inspection of stripped with
-        // objcopy libraries.
-        auto SecRef = static_cast<llvm::object::ELFSectionRef&>(S);
-        if (SecRef.getType() == llvm::ELF::SHT_NOBITS)
-          return true;
+void Dyld::BuildBloomFilters(const LibraryPaths& Libs,
+                             unsigned IgnoreSymbolFlags) const {
+#define DEBUG_TYPE "Dyld::BuildBloomFilter:"
+  const std::vector<const LibraryPath*>& L = Libs.GetLibraries();
+  // Each task only writes to its own library.
+  RunConcurrently(L.size(), [&](size_t I) {
+    LibraryPath* Lib = const_cast<LibraryPath*>(L[I]);
+    if (Lib->hasBloomFilter() || LoadFilterFromIndex(Lib, IgnoreSymbolFlags))
+      return;
 
-        return (SecRef.getFlags() & llvm::ELF::SHF_ALLOC) == 0;
-      }
+    auto ObjF = llvm::object::ObjectFile::createObjectFile(Lib->GetFullName());
+    if (!ObjF) {
+      llvm::consumeError(ObjF.takeError());
+      LLVM_DEBUG(dbgs() << "Dyld::BuildBloomFilter: Failed to read object file "
+                        << Lib->GetFullName() << "\n");
+      return;
     }
-    return true;
-  }
-
-  // FIXME: Handle osx using isStripped after upgrading to llvm9.
-
-  return m_ShouldPermanentlyIgnoreCallback(FileName);
+    BuildBloomFilter(Lib, ObjF.get().getBinary(), IgnoreSymbolFlags);
+  });
 #undef DEBUG_TYPE
 }
 
@@ -1190,21 +2359,26 @@ void Dyld::dumpDebugInfo() const {
 #undef DEBUG_TYPE
 }
 
-std::string Dyld::searchLibrariesForSymbol(StringRef mangledName,
-                                           bool searchSystem /* = true*/) {
+void Dyld::EnsureScanned(bool searchSystem) {
 #define DEBUG_TYPE "Dyld:searchLibrariesForSymbol:"
-  assert(
-      !llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(mangledName.str()) &&
-      "Library already loaded, please use dlsym!");
-  assert(!mangledName.empty());
+  // The libraries of search paths added since are not known yet. Scanning
+  // again only registers the libraries which are not yet registered.
+  unsigned Generation = m_DynamicLibraryManager.getSearchPathsGeneration();
+  if (Generation != m_ScannedGeneration) {
+    m_ScannedGeneration = Generation;
+    m_FirstRun = m_FirstRunSysLib = true;
+  }
 
-  using namespace llvm::sys::path;
-  using namespace llvm::sys::fs;
+  // Pick up the libraries built, replaced or removed since the last scan.
+  if (m_Rescan && !m_FirstRun && InvalidateChangedDirs(/*searchSystem=*/false))
+    m_FirstRun = true;
+  if (m_Rescan && searchSystem && !m_FirstRunSysLib &&
+      InvalidateChangedDirs(/*searchSystem=*/true))
+    m_FirstRunSysLib = true;
 
-  if (m_FirstRun) {
-    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol:" << mangledName.str()
-                      << ", searchSystem=" << (searchSystem ? "true" : "false")
-                      << ", FirstRun(user)... scanning\n");
+  if (!searchSystem && m_FirstRun) {
+    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol: FirstRun(user)... "
+                      << "scanning\n");
 
     LLVM_DEBUG(
         dbgs()
@@ -1213,6 +2387,11 @@ std::string Dyld::searchLibrariesForSymbol(StringRef mangledName,
 
     ScanForLibraries(/* SearchSystemLibraries= */ false);
     m_FirstRun = false;
+    // The lookup below probes every library until it finds a match. Build
+    // all filters at once while we can spread the work over many threads.
+    if (m_UseBloomFilter && m_Threads != 1)
+      BuildBloomFilters(m_Libraries, llvm::object::SymbolRef::SF_Undefined);
+    SaveIndex();
 
     LLVM_DEBUG(
         dbgs()
@@ -1220,6 +2399,91 @@ std::string Dyld::searchLibrariesForSymbol(StringRef mangledName,
     dumpDebugInfo();
   }
 
+  if (searchSystem && m_FirstRunSysLib) {
+    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol: "
+                      << "FirstRun(system)... scanning\n");
+
+    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol: Before first system "
+                         "ScanForLibraries\n");
+    dumpDebugInfo();
+
+    ScanForLibraries(/* SearchSystemLibraries= */ true);
+    m_FirstRunSysLib = false;
+    if (m_UseBloomFilter && m_Threads != 1)
+      BuildBloomFilters(m_SysLibraries,
+                        llvm::object::SymbolRef::SF_Undefined |
+                            llvm::object::SymbolRef::SF_Weak);
+    SaveIndex();
+
+    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol: After first system "
+                         "ScanForLibraries\n");
+    dumpDebugInfo();
+  }
+#undef DEBUG_TYPE
+}
+
+void Dyld::ForgetLibrary(StringRef FileName) {
+  const BasePath& BaseP =
+      m_BasePaths.RegisterBasePath(sys::path::parent_path(FileName).str());
+  LibraryPath LibPath(BaseP, sys::path::filename(FileName).str());
+  m_Libraries.UnregisterLib(LibPath);
+  m_SysLibraries.UnregisterLib(LibPath);
+  m_QueriedLibraries.UnregisterLib(LibPath);
+  m_ObjectFiles.erase(FileName);
+  m_Analyzed.erase(FileName);
+  m_QualifiedNames.erase(FileName);
+}
+
+bool Dyld::InvalidateChangedDirs(bool searchSystem) {
+#define DEBUG_TYPE "Dyld:InvalidateChangedDirs:"
+  // File systems keep modification times with a limited granularity, as
+  // coarse as two seconds on FAT. A directory modified that shortly before it
+  // was listed may have changed again without a new modification time, so it
+  // is listed again until its modification time is older than the listing.
+  const int64_t Granularity =
+      std::chrono::nanoseconds(std::chrono::seconds(2)).count();
+  bool Changed = false;
+  for (auto& Entry : m_ScannedDirs) {
+    ScannedDir& Dir = Entry.second;
+    if (Dir.System != searchSystem)
+      continue;
+
+    sys::fs::file_status Status;
+    int64_t MTime = -1;
+    if (!sys::fs::status(Entry.first(), Status))
+      MTime = Status.getLastModificationTime().time_since_epoch().count();
+    bool Racy = MTime != -1 && Dir.ScanTime - MTime < Granularity;
+    if (MTime == Dir.MTime && !Racy)
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Dyld::InvalidateChangedDirs: " << Entry.first()
+                      << " changed\n");
+    Changed = true;
+    ForgetCachedPaths(Entry.first());
+    // Linkers write a new file rather than overwriting the old one, which is
+    // what changes the directory. Keep the libraries which are still the
+    // same file.
+    for (const std::string& File : Dir.Files) {
+      auto It = m_Analyzed.find(File);
+      sys::fs::file_status FileStatus;
+      if (It != m_Analyzed.end() && !sys::fs::status(File, FileStatus) &&
+          FileStatus.getSize() == It->second.Size &&
+          FileStatus.getLastModificationTime().time_since_epoch().count() ==
+              It->second.MTime)
+        continue;
+      LLVM_DEBUG(dbgs() << "Dyld::InvalidateChangedDirs: Forget " << File
+                        << "\n");
+      ForgetLibrary(File);
+    }
+    Dir.Files.clear();
+    Dir.MTime = MTime;
+  }
+  return Changed;
+#undef DEBUG_TYPE
+}
+
+void Dyld::ForgetLoadedLibraries() {
+#define DEBUG_TYPE "Dyld:searchLibrariesForSymbol:"
   if (m_QueriedLibraries.size() > 0) {
     // Last call we were asked if a library contains a symbol. Usually, the
     // caller wants to load this library. Check if was loaded and remove it
@@ -1238,11 +2502,29 @@ std::string Dyld::searchLibrariesForSymbol(StringRef mangledName,
       if (!m_DynamicLibraryManager.isLibraryLoaded(LibName))
         continue;
 
+      m_ObjectFiles.erase(LibName);
       m_Libraries.UnregisterLib(*P);
       m_SysLibraries.UnregisterLib(*P);
     }
     // TODO:  m_QueriedLibraries.clear ?
   }
+#undef DEBUG_TYPE
+}
+
+std::string Dyld::searchLibrariesForSymbol(StringRef mangledName,
+                                           bool searchSystem /* = true*/) {
+#define DEBUG_TYPE "Dyld:searchLibrariesForSymbol:"
+  assert(
+      !llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(mangledName.str()) &&
+      "Library already loaded, please use dlsym!");
+  assert(!mangledName.empty());
+
+  LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol:" << mangledName.str()
+                    << ", searchSystem=" << (searchSystem ? "true" : "false")
+                    << "\n");
+
+  EnsureScanned(/*searchSystem=*/false);
+  ForgetLoadedLibraries();
 
   // Iterate over files under this path. We want to get each ".so" files
   for (const LibraryPath* P : m_Libraries.GetLibraries()) {
@@ -1265,22 +2547,7 @@ std::string Dyld::searchLibrariesForSymbol(StringRef mangledName,
   LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol: SearchSystem!!!\n");
 
   // Lookup in non-system libraries failed. Expand the search to the system.
-  if (m_FirstRunSysLib) {
-    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol:" << mangledName.str()
-                      << ", searchSystem=" << (searchSystem ? "true" : "false")
-                      << ", FirstRun(system)... scanning\n");
-
-    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol: Before first system "
-                         "ScanForLibraries\n");
-    dumpDebugInfo();
-
-    ScanForLibraries(/* SearchSystemLibraries= */ true);
-    m_FirstRunSysLib = false;
-
-    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbol: After first system "
-                         "ScanForLibraries\n");
-    dumpDebugInfo();
-  }
+  EnsureScanned(/*searchSystem=*/true);
 
   for (const LibraryPath* P : m_SysLibraries.GetLibraries()) {
     if (ContainsSymbol(P, mangledName, /*ignore*/
@@ -1303,6 +2570,262 @@ std::string Dyld::searchLibrariesForSymbol(StringRef mangledName,
 #undef DEBUG_TYPE
 }
 
+std::map<std::string, std::string>
+Dyld::searchLibrariesForSymbols(ArrayRef<std::string> mangledNames,
+                                bool searchSystem /* = true*/) {
+#define DEBUG_TYPE "Dyld:searchLibrariesForSymbols:"
+  std::map<std::string, std::string> Result;
+
+  // Hash every distinct symbol once. The pending symbols are kept in
+  // parallel arrays so that a library filter can test them all at once.
+  std::vector<StringRef> Names;
+  std::vector<uint32_t> GNUHashes;
+  std::vector<uint64_t> Hashes;
+  {
+    StringSet<> Seen;
+    for (const std::string& Name : mangledNames)
+      if (!Name.empty() && Seen.insert(Name).second)
+        Names.push_back(Name);
+  }
+  GNUHashes.reserve(Names.size());
+  for (StringRef Name : Names)
+    GNUHashes.push_back(GNUHash(Name));
+  Hashes.resize(Names.size());
+  SymbolTable::HashBatch(Names, Hashes);
+
+  LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbols: " << Names.size()
+                    << " symbols, searchSystem="
+                    << (searchSystem ? "true" : "false") << "\n");
+
+  // Walks the libraries once, in the order searchLibrariesForSymbol would.
+  // Every symbol is assigned to the first library which has it, so the
+  // result names the same libraries as one lookup per symbol would, each
+  // of them once.
+  auto Sweep = [&](const LibraryPaths& Libs, unsigned IgnoreSymbolFlags) {
+    std::vector<bool> Found;
+    std::unique_ptr<bool[]> MayExist(new bool[Names.size()]);
+    for (const LibraryPath* P : Libs.GetLibraries()) {
+      if (Names.empty())
+        return;
+
+      MutableArrayRef<bool> Candidates(MayExist.get(), Names.size());
+      if (m_UseBloomFilter && !P->hasBloomFilter())
+        LoadFilterFromIndex(const_cast<LibraryPath*>(P), IgnoreSymbolFlags);
+      if (m_UseBloomFilter && P->hasBloomFilter())
+        P->MayExistSymbols(GNUHashes, Hashes, Candidates);
+      else
+        std::fill(Candidates.begin(), Candidates.end(), true);
+
+      Found.assign(Names.size(), false);
+      bool FoundAny = false;
+      for (size_t i = 0, e = Names.size(); i < e; ++i) {
+        if (!Candidates[i] ||
+            !ContainsSymbol(P, Names[i], GNUHashes[i], Hashes[i],
+                            IgnoreSymbolFlags))
+          continue;
+        Result[Names[i].str()] = P->GetFullName();
+        Found[i] = FoundAny = true;
+      }
+      if (!FoundAny)
+        continue;
+
+      if (!m_QueriedLibraries.HasRegisteredLib(*P))
+        m_QueriedLibraries.RegisterLib(*P);
+      LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbols: Search found "
+                        << "matches in: " << P->GetFullName() << "!\n");
+
+      // Drop the resolved symbols from the batch.
+      size_t Kept = 0;
+      for (size_t i = 0, e = Names.size(); i < e; ++i) {
+        if (Found[i])
+          continue;
+        Names[Kept] = Names[i];
+        GNUHashes[Kept] = GNUHashes[i];
+        Hashes[Kept] = Hashes[i];
+        ++Kept;
+      }
+      Names.resize(Kept);
+      GNUHashes.resize(Kept);
+      Hashes.resize(Kept);
+    }
+  };
+
+  EnsureScanned(/*searchSystem=*/false);
+  ForgetLoadedLibraries();
+  Sweep(m_Libraries, llvm::object::SymbolRef::SF_Undefined);
+
+  if (searchSystem && !Names.empty()) {
+    EnsureScanned(/*searchSystem=*/true);
+    Sweep(m_SysLibraries, llvm::object::SymbolRef::SF_Undefined |
+                              llvm::object::SymbolRef::SF_Weak);
+  }
+
+  LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForSymbols: " << Names.size()
+                    << " symbols not found\n");
+  return Result;
+#undef DEBUG_TYPE
+}
+
+/// Resolves the symbols missing in a JITDylib by loading the not-yet-loaded
+/// libraries which define them.
+class AutoloadGenerator : public llvm::orc::DefinitionGenerator {
+  std::function<DynamicLibraryManager*()> m_GetDLM;
+  char m_GlobalPrefix;
+  bool m_SearchSystem;
+
+public:
+  AutoloadGenerator(std::function<DynamicLibraryManager*()> GetDLM,
+                    char GlobalPrefix, bool SearchSystem)
+      : m_GetDLM(std::move(GetDLM)), m_GlobalPrefix(GlobalPrefix),
+        m_SearchSystem(SearchSystem) {}
+
+  llvm::Error
+  tryToGenerate(llvm::orc::LookupState& LS, llvm::orc::LookupKind K,
+                llvm::orc::JITDylib& JD,
+                llvm::orc::JITDylibLookupFlags JDLookupFlags,
+                const llvm::orc::SymbolLookupSet& LookupSet) override {
+#define DEBUG_TYPE "Dyld::AutoloadGenerator:"
+    using namespace llvm::orc;
+
+    // The libraries hold the names as the linker sees them, which is how the
+    // JIT looks them up as well.
+    std::vector<std::string> Names;
+    Names.reserve(LookupSet.size());
+    for (const auto& KV : LookupSet)
+      Names.push_back((*KV.first).str());
+
+    DynamicLibraryManager* DLM = m_GetDLM();
+    if (!DLM)
+      return llvm::Error::success();
+
+    std::map<std::string, std::string> Found =
+        DLM->searchLibrariesForSymbols(Names, m_SearchSystem);
+    if (Found.empty())
+      return llvm::Error::success();
+
+    StringSet<> Loaded;
+    SymbolMap NewSymbols;
+    for (const auto& KV : LookupSet) {
+      auto It = Found.find((*KV.first).str());
+      if (It == Found.end())
+        continue;
+
+      if (Loaded.insert(It->second).second) {
+        LLVM_DEBUG(dbgs() << "Dyld::AutoloadGenerator: Loading "
+                          << It->second << " for " << It->first << "\n");
+        DynamicLibraryManager::LoadLibResult Res =
+            DLM->loadLibrary(It->second, /*permanent=*/true,
+                             /*resolved=*/true);
+        if (Res != DynamicLibraryManager::kLoadLibSuccess &&
+            Res != DynamicLibraryManager::kLoadLibAlreadyLoaded)
+          continue;
+      }
+
+      // dlsym takes the C-level name.
+      StringRef Name = *KV.first;
+      if (m_GlobalPrefix)
+        Name.consume_front(StringRef(&m_GlobalPrefix, 1));
+      void* Addr =
+          llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(Name.str());
+      if (!Addr)
+        continue;
+      NewSymbols[KV.first] = {ExecutorAddr::fromPtr(Addr),
+                              llvm::JITSymbolFlags::Exported};
+    }
+
+    if (NewSymbols.empty())
+      return llvm::Error::success();
+    return JD.define(absoluteSymbols(std::move(NewSymbols)));
+#undef DEBUG_TYPE
+  }
+};
+
+std::unique_ptr<llvm::orc::DefinitionGenerator>
+DynamicLibraryManager::createAutoloadGenerator(
+    std::function<DynamicLibraryManager*()> GetDLM, char GlobalPrefix,
+    bool searchSystem) {
+  return std::make_unique<AutoloadGenerator>(std::move(GetDLM), GlobalPrefix,
+                                             searchSystem);
+}
+
+/// Reads a list of glob patterns separated by the platform's path list
+/// delimiter from the environment variable \p Var.
+static std::vector<llvm::GlobPattern> GetGlobPatternsFromEnv(const char* Var) {
+  std::vector<llvm::GlobPattern> Patterns;
+  auto Env = llvm::sys::Process::GetEnv(Var);
+  if (!Env)
+    return Patterns;
+
+  SmallVector<StringRef, 4> Items;
+  StringRef(*Env).split(Items, utils::platform::kEnvDelim, /*MaxSplit=*/-1,
+                        /*KeepEmpty=*/false);
+  for (StringRef Item : Items) {
+    auto Pattern = llvm::GlobPattern::create(Item);
+    if (!Pattern) {
+      llvm::consumeError(Pattern.takeError());
+      continue;
+    }
+    Patterns.push_back(std::move(*Pattern));
+  }
+  return Patterns;
+}
+
+std::vector<std::pair<std::string, std::string>>
+Dyld::searchLibrariesForQualifiedName(StringRef qualifiedName,
+                                      bool searchSystem /* = true*/) {
+#define DEBUG_TYPE "Dyld:searchLibrariesForQualifiedName:"
+  qualifiedName.consume_front("::");
+
+  EnsureScanned(/*searchSystem=*/false);
+  ForgetLoadedLibraries();
+  if (searchSystem)
+    EnsureScanned(/*searchSystem=*/true);
+
+  std::vector<std::pair<const LibraryPath*, unsigned>> Libs;
+  for (const LibraryPath* P : m_Libraries.GetLibraries())
+    Libs.emplace_back(P, llvm::object::SymbolRef::SF_Undefined);
+  if (searchSystem)
+    for (const LibraryPath* P : m_SysLibraries.GetLibraries())
+      Libs.emplace_back(P, llvm::object::SymbolRef::SF_Undefined |
+                               llvm::object::SymbolRef::SF_Weak);
+
+  // Demangle the libraries not seen before, each once and concurrently.
+  std::vector<std::pair<std::string, unsigned>> Missing;
+  for (const auto& Lib : Libs) {
+    std::string Path = Lib.first->GetFullName();
+    if (!m_QualifiedNames.count(Path))
+      Missing.emplace_back(std::move(Path), Lib.second);
+  }
+  std::vector<QualifiedNameIndex> Built(Missing.size());
+  RunConcurrently(Missing.size(), [&](size_t I) {
+    auto ObjF = llvm::object::ObjectFile::createObjectFile(Missing[I].first);
+    if (!ObjF) {
+      llvm::consumeError(ObjF.takeError());
+      return;
+    }
+    Built[I] =
+        BuildQualifiedNameIndex(ObjF->getBinary(), Missing[I].second);
+  });
+  for (size_t I = 0, E = Missing.size(); I < E; ++I)
+    m_QualifiedNames[Missing[I].first] = std::move(Built[I]);
+
+  std::vector<std::pair<std::string, std::string>> Result;
+  for (const auto& Lib : Libs) {
+    std::string Path = Lib.first->GetFullName();
+    const QualifiedNameIndex& Index = m_QualifiedNames[Path];
+    auto It = Index.find(qualifiedName);
+    if (It == Index.end())
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Dyld::searchLibrariesForQualifiedName: "
+                      << qualifiedName << " found in " << Path << "\n");
+    for (const std::string& Mangled : It->second)
+      Result.emplace_back(Mangled, Path);
+  }
+  return Result;
+#undef DEBUG_TYPE
+}
+
 DynamicLibraryManager::~DynamicLibraryManager() {
   static_assert(sizeof(Dyld) > 0, "Incomplete type");
   delete m_Dyld;
@@ -1310,6 +2833,7 @@ DynamicLibraryManager::~DynamicLibraryManager() {
 
 void DynamicLibraryManager::initializeDyld(
     std::function<bool(llvm::StringRef)> shouldPermanentlyIgnore) {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   // assert(!m_Dyld && "Already initialized!");
   if (m_Dyld)
     delete m_Dyld;
@@ -1317,14 +2841,82 @@ void DynamicLibraryManager::initializeDyld(
   std::string exeP = GetExecutablePath();
   auto ObjF = cantFail(llvm::object::ObjectFile::createObjectFile(exeP));
 
+  Dyld::Options Opts;
+  // Scanning the library paths is done by all hardware threads unless
+  // CPPINTEROP_DYLD_THREADS says otherwise; 1 scans serially.
+  if (auto Env = llvm::sys::Process::GetEnv("CPPINTEROP_DYLD_THREADS"))
+    if (StringRef(*Env).getAsInteger(10, Opts.Threads))
+      Opts.Threads = 0;
+
+  // CPPINTEROP_DYLD_INDEX names a file caching the library scan and the
+  // symbol tables across processes.
+  if (auto Env = llvm::sys::Process::GetEnv("CPPINTEROP_DYLD_INDEX"))
+    Opts.IndexFile = *Env;
+
+  // CPPINTEROP_DYLD_BLOOM=classic selects the bloom filter probing one word
+  // per bit instead of the cache-line blocked one.
+  if (auto Env = llvm::sys::Process::GetEnv("CPPINTEROP_DYLD_BLOOM"))
+    if (*Env == "classic")
+      Opts.Bloom = BloomKind::Classic;
+
+  // CPPINTEROP_DYLD_RESCAN=0 keeps the result of the first scan for the
+  // lifetime of the process instead of checking the directories for changes
+  // before each search.
+  if (auto Env = llvm::sys::Process::GetEnv("CPPINTEROP_DYLD_RESCAN"))
+    Opts.Rescan = *Env != "0";
+
+  // CPPINTEROP_DYLD_DENY and CPPINTEROP_DYLD_ALLOW hold glob patterns over
+  // the library paths. A library is not searched, and thus not autoloaded,
+  // if it matches the former or there is a latter and it does not match it.
+  Opts.Deny = GetGlobPatternsFromEnv("CPPINTEROP_DYLD_DENY");
+  Opts.Allow = GetGlobPatternsFromEnv("CPPINTEROP_DYLD_ALLOW");
+
   m_Dyld = new Dyld(*this, shouldPermanentlyIgnore,
-                    ObjF.getBinary()->getFileFormatName());
+                    ObjF.getBinary()->getFileFormatName(), Opts);
 }
 
 std::string DynamicLibraryManager::searchLibrariesForSymbol(
     StringRef mangledName, bool searchSystem /* = true*/) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  assert(m_Dyld && "Must call initialize dyld before!");
+  CPPINTEROP_PROBE2(symbol__resolve__start, mangledName.data(),
+                    mangledName.size());
+  std::string Lib = m_Dyld->searchLibrariesForSymbol(mangledName, searchSystem);
+  CPPINTEROP_PROBE3(symbol__resolve__done, mangledName.data(),
+                    mangledName.size(), Lib.c_str());
+  return Lib;
+}
+
+std::map<std::string, std::string>
+DynamicLibraryManager::searchLibrariesForSymbols(
+    llvm::ArrayRef<std::string> mangledNames,
+    bool searchSystem /* = true*/) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
+  assert(m_Dyld && "Must call initialize dyld before!");
+  // The batch is searched in one pass, so every symbol starts before the
+  // first one is done. A symbol nothing defines is done with "".
+#ifdef CPPINTEROP_ENABLE_USDT
+  for (const std::string& Name : mangledNames)
+    CPPINTEROP_PROBE2(symbol__resolve__start, Name.data(), Name.size());
+#endif
+  std::map<std::string, std::string> Found =
+      m_Dyld->searchLibrariesForSymbols(mangledNames, searchSystem);
+#ifdef CPPINTEROP_ENABLE_USDT
+  for (const std::string& Name : mangledNames) {
+    auto It = Found.find(Name);
+    CPPINTEROP_PROBE3(symbol__resolve__done, Name.data(), Name.size(),
+                      It != Found.end() ? It->second.c_str() : "");
+  }
+#endif
+  return Found;
+}
+
+std::vector<std::pair<std::string, std::string>>
+DynamicLibraryManager::searchLibrariesForQualifiedName(
+    llvm::StringRef qualifiedName, bool searchSystem /* = true*/) const {
+  std::lock_guard<std::recursive_mutex> Lock(m_Mutex);
   assert(m_Dyld && "Must call initialize dyld before!");
-  return m_Dyld->searchLibrariesForSymbol(mangledName, searchSystem);
+  return m_Dyld->searchLibrariesForQualifiedName(qualifiedName, searchSystem);
 }
 
 std::string DynamicLibraryManager::getSymbolLocation(void* func) {
@@ -0,0 +1,50 @@
+//===--- Probes.h - USDT probe points ---------------------------*- C++ -*-===//
+//
+// Part of the compiler-research project, under the Apache License v2.0 with
+// LLVM Exceptions.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Statically defined tracing points for external tracers (bpftrace, perf,
+// SystemTap, ...). Built with CPPINTEROP_ENABLE_USDT, every probe is a single
+// nop plus an ELF note in .note.stapsdt until a tracer attaches to it.
+// Otherwise the macros expand to nothing.
+//
+// All probes belong to the "cppinterop" provider:
+//
+//   api__entry(const char* name)           a traced API is entered
+//   api__return(const char* name)          a traced API returns
+//   wrapper__compile__start(const char* name, size_t source_bytes)
+//   wrapper__compile__done(const char* name, void* address)
+//   library__load__start(const char* path)
+//   library__load__done(const char* path, void* handle)
+//   symbol__resolve__start(const char* name, size_t name_len)
+//   symbol__resolve__done(const char* name, size_t name_len,
+//                         const char* library)
+//
+// The symbol probes fire once per symbol, also for batched searches. The
+// library is "" when no library defines the symbol.
+//
+// For example: bpftrace -e 'usdt:libclangCppInterOp.so:cppinterop:api__entry
+//                           { @[str(arg0)] = count(); }'
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CPPINTEROP_PROBES_H
+#define CPPINTEROP_PROBES_H
+
+#ifdef CPPINTEROP_ENABLE_USDT
+#include <sys/sdt.h>
+
+#define CPPINTEROP_PROBE1(Name, A) DTRACE_PROBE1(cppinterop, Name, A)
+#define CPPINTEROP_PROBE2(Name, A, B) DTRACE_PROBE2(cppinterop, Name, A, B)
+#define CPPINTEROP_PROBE3(Name, A, B, C)                                       \
+  DTRACE_PROBE3(cppinterop, Name, A, B, C)
+#else
+#define CPPINTEROP_PROBE1(Name, A)
+#define CPPINTEROP_PROBE2(Name, A, B)
+#define CPPINTEROP_PROBE3(Name, A, B, C)
+#endif
+
+#endif // CPPINTEROP_PROBES_H
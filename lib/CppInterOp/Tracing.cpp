@@ -11,12 +11,18 @@
 #include "CppInterOp/CppInterOp.h"
 
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <map>
 #include <system_error>
 
 namespace CppInterOp {
@@ -24,10 +30,588 @@ namespace Tracing {
 
 TraceInfo* TraceInfo::TheTraceInfo = nullptr;
 
-void InitTracing() {
+static std::atomic<unsigned> NextTraceInfoId{0};
+
+TraceInfo::TraceInfo()
+    : m_TG("CppInterOp", "CppInterOp Timing Report"), m_Id(++NextTraceInfoId) {
+  setMode(TraceMode::Text);
+}
+
+void InitTracing(TraceMode Mode) {
   assert(!TraceInfo::TheTraceInfo);
   static llvm::ManagedStatic<TraceInfo> TI;
   TraceInfo::TheTraceInfo = &*TI;
+  TI->setMode(Mode);
+}
+
+void TraceInfo::setMode(TraceMode Mode) {
+  m_Mode = Mode;
+  m_CalibTicks = ReadTimestamp();
+  m_CalibTime = std::chrono::steady_clock::now();
+}
+
+namespace {
+/// Tick and steady_clock readings taken at startup, used to convert
+/// ReadTimestamp() ticks into nanoseconds for the statistics.
+struct TickCalibration {
+  uint64_t Ticks = ReadTimestamp();
+  std::chrono::steady_clock::time_point Time =
+      std::chrono::steady_clock::now();
+
+  double getNanosecondsPerTick() const {
+    uint64_t Elapsed = ReadTimestamp() - Ticks;
+    auto Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - Time)
+                  .count();
+    return Elapsed && Ns > 0 ? double(Ns) / double(Elapsed) : 1.0;
+  }
+};
+} // namespace
+
+static const TickCalibration ProcessTicks;
+
+std::atomic<unsigned> ApiCallSite::SampleEvery{0};
+
+thread_local AllocCounters ThreadAllocs;
+std::atomic<bool> AllocTracker::Enabled{false};
+std::atomic<uint64_t (*)()> AllocTracker::ArenaProbe{nullptr};
+
+namespace {
+/// Allocation snapshots of one open TraceRegion.
+struct AllocFrame {
+  AllocCounters Enter;    ///< At push(), before the region's bookkeeping.
+  AllocCounters Begin;    ///< At begin(), when the call itself starts.
+  AllocCounters Children; ///< Whole spans of the nested regions.
+};
+struct AllocFrameStack {
+  AllocFrame Frames[AllocTracker::kMaxDepth];
+  unsigned Depth = 0;
+};
+} // namespace
+
+static thread_local AllocFrameStack AllocFrames;
+
+void AllocTracker::setEnabled(bool On) {
+  Enabled.store(On, std::memory_order_relaxed);
+#ifdef CPPINTEROP_ENABLE_ALLOC_TRACKING
+  // The replacement operator new only counts if the dynamic linker bound
+  // operator new to it, which it does not when the library is dlopen'd by a
+  // program that already has the C++ runtime's. Probe with one allocation.
+  if (On) {
+    uint64_t Before = ThreadAllocs.Allocs;
+    void* volatile P = ::operator new(1);
+    ::operator delete(P);
+    static std::atomic<bool> Warned{false};
+    if (ThreadAllocs.Allocs == Before && !Warned.exchange(true))
+      llvm::errs() << "CppInterOp: heap allocations cannot be counted, the "
+                      "operator new replacement is not in effect (was the "
+                      "library dlopen'd?)\n";
+  }
+#endif
+}
+
+bool AllocTracker::push() {
+  if (AllocFrames.Depth == kMaxDepth)
+    return false;
+  AllocFrame& F = AllocFrames.Frames[AllocFrames.Depth++];
+  F.Enter = F.Begin = now();
+  F.Children = AllocCounters();
+  return true;
+}
+
+void AllocTracker::begin() {
+  AllocFrames.Frames[AllocFrames.Depth - 1].Begin = now();
+}
+
+AllocCounters AllocTracker::end() {
+  const AllocFrame& F = AllocFrames.Frames[AllocFrames.Depth - 1];
+  return now() - F.Begin - F.Children;
+}
+
+void AllocTracker::pop() {
+  AllocCounters Span = now() - AllocFrames.Frames[--AllocFrames.Depth].Enter;
+  if (AllocFrames.Depth)
+    AllocFrames.Frames[AllocFrames.Depth - 1].Children += Span;
+}
+
+namespace {
+/// All ApiCallSites that have been called while statistics were on. Sites
+/// are function-local statics, so the list never needs to drop entries.
+struct ApiSiteRegistry {
+  std::mutex Mutex;
+  std::vector<ApiCallSite*> Sites;
+};
+} // namespace
+
+static ApiSiteRegistry& GetApiSiteRegistry() {
+  static ApiSiteRegistry Registry;
+  return Registry;
+}
+
+void ApiCallSite::registerSite() {
+  ApiSiteRegistry& Registry = GetApiSiteRegistry();
+  std::lock_guard<std::mutex> Lock(Registry.Mutex);
+  if (m_Registered.load(std::memory_order_relaxed))
+    return;
+  m_Hist.store(new LatencyHistogram(), std::memory_order_release);
+  Registry.Sites.push_back(this);
+  m_Registered.store(true, std::memory_order_release);
+}
+
+void ApiCallSite::setSampling(unsigned N) {
+  ApiSiteRegistry& Registry = GetApiSiteRegistry();
+  std::lock_guard<std::mutex> Lock(Registry.Mutex);
+  // Keep the randomized sampling gaps in range.
+  SampleEvery.store(std::min(N, 1u << 30), std::memory_order_relaxed);
+}
+
+void ResetApiStatistics() {
+  ApiSiteRegistry& Registry = GetApiSiteRegistry();
+  std::lock_guard<std::mutex> Lock(Registry.Mutex);
+  for (ApiCallSite* Site : Registry.Sites)
+    Site->reset();
+}
+
+void CollectApiStatistics(std::vector<CppImpl::ApiStatistics>& Stats) {
+  struct Merged {
+    uint64_t Calls = 0;
+    uint64_t Total = 0;
+    uint64_t Sum = 0;
+    uint64_t Min = UINT64_MAX;
+    uint64_t Max = 0;
+    AllocCounters Allocs;
+    std::vector<uint64_t> Counts =
+        std::vector<uint64_t>(LatencyHistogram::kBuckets);
+  };
+  std::map<std::string, Merged> ByName;
+  {
+    ApiSiteRegistry& Registry = GetApiSiteRegistry();
+    std::lock_guard<std::mutex> Lock(Registry.Mutex);
+    for (const ApiCallSite* Site : Registry.Sites) {
+      if (!Site->getCalls())
+        continue;
+      Merged& M = ByName[Site->getName()];
+      const LatencyHistogram& H = Site->getHistogram();
+      M.Calls += Site->getCalls();
+      M.Total += H.Total.load(std::memory_order_relaxed);
+      M.Sum += H.Sum.load(std::memory_order_relaxed);
+      M.Min = std::min(M.Min, H.Min.load(std::memory_order_relaxed));
+      M.Max = std::max(M.Max, H.Max.load(std::memory_order_relaxed));
+      M.Allocs += Site->getAllocs();
+      for (unsigned B = 0; B < LatencyHistogram::kBuckets; ++B)
+        M.Counts[B] += H.Counts[B].load(std::memory_order_relaxed);
+    }
+  }
+
+  const double NsPerTick = ProcessTicks.getNanosecondsPerTick();
+  auto ToNs = [NsPerTick](uint64_t Ticks) {
+    return static_cast<uint64_t>(double(Ticks) * NsPerTick);
+  };
+  for (auto& [Name, M] : ByName) {
+    // Buckets are updated without a lock, so their sum may be slightly off
+    // from Total; walk the buckets themselves.
+    uint64_t Counted = 0;
+    for (uint64_t C : M.Counts)
+      Counted += C;
+    auto Percentile = [&](double Q) -> uint64_t {
+      auto Rank = static_cast<uint64_t>(std::ceil(Q * double(Counted)));
+      uint64_t Seen = 0;
+      for (unsigned B = 0; B < LatencyHistogram::kBuckets; ++B) {
+        Seen += M.Counts[B];
+        if (Seen && Seen >= Rank) {
+          uint64_t Upper = LatencyHistogram::getBucketUpperBound(B);
+          return ToNs(std::min(Upper, M.Max));
+        }
+      }
+      return ToNs(M.Max);
+    };
+
+    CppImpl::ApiStatistics S;
+    S.Name = Name;
+    S.Calls = M.Calls;
+    S.Sampled = M.Total;
+    S.Allocs = M.Allocs.Allocs;
+    S.AllocBytes = M.Allocs.Bytes;
+    S.ArenaBytes = M.Allocs.ArenaBytes;
+    if (M.Total) {
+      S.MinNs = ToNs(M.Min);
+      S.MaxNs = ToNs(M.Max);
+      S.MeanNs = double(M.Sum) * NsPerTick / double(M.Total);
+      S.P50Ns = Percentile(0.5);
+      S.P99Ns = Percentile(0.99);
+      S.P999Ns = Percentile(0.999);
+    }
+    Stats.push_back(std::move(S));
+  }
+}
+
+namespace {
+constexpr unsigned NumWrapperPhases =
+    static_cast<unsigned>(WrapperPhase::NumPhases);
+
+/// Process-wide totals behind Cpp::GetWrapperCompilationStats.
+struct WrapperStats {
+  std::atomic<uint64_t> Wrappers{0};
+  std::atomic<uint64_t> SourceBytes{0};
+  std::atomic<uint64_t> ObjectBytes{0};
+  std::atomic<uint64_t> Ticks[NumWrapperPhases] = {};
+};
+WrapperStats TheWrapperStats;
+
+/// Per-thread progress through the JIT part of a wrapper compilation. The
+/// JIT materializes on the thread that looks the wrapper up, as long as the
+/// session has no task dispatcher of its own. With one, the notifications
+/// come from another thread, and the JIT phases are not counted.
+struct WrapperJitState {
+  unsigned Depth = 0;        ///< Open WrapperPhaseScopes.
+  uint64_t CompileStart = 0; ///< NotifyWrapperJitCompile() time, or 0.
+  uint64_t LinkStart = 0;    ///< NotifyWrapperObject() time, or 0.
+};
+thread_local WrapperJitState TheWrapperJitState;
+
+const char* const WrapperPhaseNames[NumWrapperPhases] = {
+    "wrapper.source",      "wrapper.compile", "wrapper.frontend",
+    "wrapper.execute",     "wrapper.lookup",  "wrapper.jit_compile",
+    "wrapper.jit_link"};
+} // namespace
+
+static void RecordWrapperPhase(WrapperPhase Phase, uint64_t Start,
+                               uint64_t End) {
+  auto Index = static_cast<unsigned>(Phase);
+  TheWrapperStats.Ticks[Index].fetch_add(End - Start,
+                                         std::memory_order_relaxed);
+  if (TraceInfo* TI = TraceInfo::TheTraceInfo) {
+    TraceRecord R;
+    R.begin(WrapperPhaseNames[Index]);
+    R.IsPhase = R.Returned = true;
+    R.Start = Start;
+    R.End = End;
+    TI->commitRecord(R);
+  }
+}
+
+/// Close a pending JIT link phase, if any, at \p Now.
+static void FinishWrapperJitLink(uint64_t Now) {
+  WrapperJitState& State = TheWrapperJitState;
+  if (!State.LinkStart)
+    return;
+  RecordWrapperPhase(WrapperPhase::JitLink, State.LinkStart, Now);
+  State.LinkStart = 0;
+}
+
+void EnterWrapperPhase() { ++TheWrapperJitState.Depth; }
+
+void LeaveWrapperPhase(WrapperPhase Phase, uint64_t Start, uint64_t End) {
+  WrapperJitState& State = TheWrapperJitState;
+  // The JIT has no hook for the end of linking; it is over once the phase
+  // that triggered materialization returns.
+  FinishWrapperJitLink(End);
+  if (--State.Depth == 0)
+    State.CompileStart = 0;
+  RecordWrapperPhase(Phase, Start, End);
+}
+
+void RecordWrapperSource(size_t Bytes) {
+  TheWrapperStats.Wrappers.fetch_add(1, std::memory_order_relaxed);
+  TheWrapperStats.SourceBytes.fetch_add(Bytes, std::memory_order_relaxed);
+}
+
+void NotifyWrapperJitCompile() {
+  WrapperJitState& State = TheWrapperJitState;
+  if (!State.Depth)
+    return;
+  uint64_t Now = ReadTimestamp();
+  FinishWrapperJitLink(Now);
+  State.CompileStart = Now;
+}
+
+void NotifyWrapperObject(size_t Bytes) {
+  WrapperJitState& State = TheWrapperJitState;
+  if (!State.Depth || !State.CompileStart)
+    return;
+  uint64_t Now = ReadTimestamp();
+  RecordWrapperPhase(WrapperPhase::JitCompile, State.CompileStart, Now);
+  TheWrapperStats.ObjectBytes.fetch_add(Bytes, std::memory_order_relaxed);
+  State.CompileStart = 0;
+  State.LinkStart = Now;
+}
+
+void CollectWrapperStats(CppImpl::WrapperCompilationStats& Stats) {
+  const double NsPerTick = ProcessTicks.getNanosecondsPerTick();
+  auto Ns = [&](WrapperPhase Phase) {
+    uint64_t Ticks = TheWrapperStats.Ticks[static_cast<unsigned>(Phase)].load(
+        std::memory_order_relaxed);
+    return static_cast<uint64_t>(double(Ticks) * NsPerTick);
+  };
+  Stats.Wrappers = TheWrapperStats.Wrappers.load(std::memory_order_relaxed);
+  Stats.SourceBytes =
+      TheWrapperStats.SourceBytes.load(std::memory_order_relaxed);
+  Stats.ObjectBytes =
+      TheWrapperStats.ObjectBytes.load(std::memory_order_relaxed);
+  Stats.SourceNs = Ns(WrapperPhase::Source);
+  Stats.CompileNs = Ns(WrapperPhase::Compile);
+  Stats.FrontendNs = Ns(WrapperPhase::Frontend);
+  Stats.ExecuteNs = Ns(WrapperPhase::Execute);
+  Stats.LookupNs = Ns(WrapperPhase::Lookup);
+  Stats.JitCompileNs = Ns(WrapperPhase::JitCompile);
+  Stats.JitLinkNs = Ns(WrapperPhase::JitLink);
+}
+
+void ResetWrapperStats() {
+  TheWrapperStats.Wrappers.store(0, std::memory_order_relaxed);
+  TheWrapperStats.SourceBytes.store(0, std::memory_order_relaxed);
+  TheWrapperStats.ObjectBytes.store(0, std::memory_order_relaxed);
+  for (auto& T : TheWrapperStats.Ticks)
+    T.store(0, std::memory_order_relaxed);
+}
+
+double NanosecondsPerTick() { return ProcessTicks.getNanosecondsPerTick(); }
+
+namespace {
+/// Ties a thread to its TraceRing and hands the ring back for reuse when the
+/// thread exits, so short-lived threads do not pile up rings.
+struct RingLease {
+  TraceInfo* Owner = nullptr;
+  unsigned OwnerId = 0;
+  TraceRing* Ring = nullptr;
+  ~RingLease() {
+    if (Ring && TraceInfo::TheTraceInfo == Owner)
+      Ring->InUse.store(false, std::memory_order_release);
+  }
+};
+thread_local RingLease TheRingLease;
+} // namespace
+
+static TraceRing& setRingThread(TraceRing& Ring) {
+  Ring.Thread = static_cast<uint32_t>(llvm::get_threadid());
+  return Ring;
+}
+
+TraceRing& TraceInfo::registerRing() {
+  std::lock_guard<std::mutex> Lock(m_RingsMutex);
+  for (auto& Ring : m_Rings)
+    if (!Ring->InUse.exchange(true, std::memory_order_acquire))
+      return setRingThread(*Ring);
+  m_Rings.push_back(std::make_unique<TraceRing>());
+  return setRingThread(*m_Rings.back());
+}
+
+void TraceInfo::commitRecord(const TraceRecord& R) {
+  RingLease& Lease = TheRingLease;
+  if (Lease.Owner != this || Lease.OwnerId != m_Id) {
+    Lease.Ring = &registerRing();
+    Lease.Owner = this;
+    Lease.OwnerId = m_Id;
+  }
+  TraceRing& Ring = *Lease.Ring;
+  uint64_t Head = Ring.Head.load(std::memory_order_relaxed);
+  TraceRecord& Slot = Ring.Slots[Head & (TraceRing::kCapacity - 1)];
+  Slot = R;
+  Slot.Thread = Ring.Thread;
+  Ring.Head.store(Head + 1, std::memory_order_release);
+}
+
+/// Render a binary record in the same shape TraceRegion uses in text mode.
+/// A lossy record would not compile, or would replay a different call, so
+/// it is rendered as a comment and the handle it returns is not named.
+static std::string FormatRecord(TraceInfo& TI, const TraceRecord& R,
+                                double NsPerTick) {
+  llvm::SmallString<128> ArgStr;
+  llvm::raw_svector_ostream OS(ArgStr);
+  for (unsigned I = 0; I < R.NumArgs; ++I) {
+    if (I)
+      OS << ", ";
+    uint64_t V = R.Args[I];
+    switch (R.Kinds[I]) {
+    case TraceRecord::Handle:
+      OS << TI.lookupHandle(reinterpret_cast<void*>(static_cast<uintptr_t>(V)));
+      break;
+    case TraceRecord::String: {
+      uint64_t Offset = V & (TraceRecord::kTruncated - 1);
+      OS << "\"";
+      if (Offset < TraceRecord::kStrBytes)
+        OS.write_escaped(R.Str + Offset);
+      if (V & TraceRecord::kTruncated)
+        OS << "...";
+      OS << "\"";
+      break;
+    }
+    case TraceRecord::Bool:
+      OS << (V ? "true" : "false");
+      break;
+    case TraceRecord::Signed:
+      OS << static_cast<int64_t>(V);
+      break;
+    case TraceRecord::Unsigned:
+      OS << V;
+      break;
+    case TraceRecord::Float: {
+      double D;
+      std::memcpy(&D, &V, sizeof(D));
+      OS << llvm::formatv("{0:f}", D);
+      break;
+    }
+    case TraceRecord::Container:
+      OS << "{...}";
+      break;
+    case TraceRecord::Unknown:
+      OS << "?";
+      break;
+    }
+  }
+  if (R.ExtraArgs)
+    OS << ", ...";
+
+  std::string VarPart;
+  if (R.Result) {
+    void* P = reinterpret_cast<void*>(static_cast<uintptr_t>(R.Result));
+    std::string HandleName = TI.lookupHandle(P);
+    bool IsNew = HandleName == "nullptr";
+    if (!IsNew)
+      VarPart = llvm::formatv("/*{0}*/ ", HandleName).str();
+    else if (!R.Lossy)
+      VarPart =
+          llvm::formatv("auto {0} = ", TI.getOrRegisterHandle(P)).str();
+  } else if (R.HasPtrResult) {
+    VarPart = "/*nullptr*/ ";
+  }
+
+  auto Dur = static_cast<long long>((R.End - R.Start) * NsPerTick);
+  std::string Line =
+      llvm::formatv("  {0}{1}Cpp::{2}({3}); // [{4} ns]", R.Lossy ? "// " : "",
+                    VarPart, R.Api, ArgStr, Dur);
+  if (R.HasAllocs)
+    Line += FormatAllocs({R.Allocs, R.AllocBytes, R.ArenaBytes});
+  return Line;
+}
+
+/// Copy the records of \p Ring from index \p From up to its current head
+/// into \p Out. Returns the index of the first record actually copied; any
+/// records between \p From and it were overwritten.
+static uint64_t SnapshotRing(const TraceRing& Ring, uint64_t From,
+                             uint64_t Head, std::vector<TraceRecord>& Out) {
+  const uint64_t Capacity = TraceRing::kCapacity;
+  uint64_t First = std::max(From, Head > Capacity ? Head - Capacity : 0);
+  size_t Base = Out.size();
+  for (uint64_t I = First; I < Head; ++I)
+    Out.push_back(Ring.Slots[I & (Capacity - 1)]);
+
+  // The owner keeps writing while we copy. Drop every slot it may have
+  // reused in the meantime, including the one it is writing right now.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t Now = Ring.Head.load(std::memory_order_relaxed) + 1;
+  uint64_t Valid = Now > Capacity ? Now - Capacity : 0;
+  if (Valid > First) {
+    uint64_t Torn = std::min(Valid, Head) - First;
+    Out.erase(Out.begin() + Base, Out.begin() + Base + Torn);
+    First += Torn;
+  }
+  return First;
+}
+
+double TraceInfo::getNanosecondsPerTick() const {
+  uint64_t Ticks = ReadTimestamp() - m_CalibTicks;
+  auto Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_CalibTime)
+                .count();
+  return Ticks && Ns > 0 ? double(Ns) / double(Ticks) : 1.0;
+}
+
+void TraceInfo::flushRecords() {
+  // In text mode the calls are already in the log; the records only carry
+  // timings for writeChromeTrace().
+  if (m_Mode != TraceMode::Binary)
+    return;
+
+  std::lock_guard<std::mutex> Lock(m_RingsMutex);
+  std::vector<TraceRecord> Records;
+  uint64_t Lost = 0;
+  for (auto& Ring : m_Rings) {
+    uint64_t Head = Ring->Head.load(std::memory_order_acquire);
+    uint64_t First = SnapshotRing(*Ring, Ring->Tail, Head, Records);
+    Lost += First - std::min(First, Ring->Tail);
+    Ring->Tail = Head;
+  }
+  std::stable_sort(Records.begin(), Records.end(),
+                   [](const TraceRecord& A, const TraceRecord& B) {
+                     return A.Start < B.Start;
+                   });
+
+  double NsPerTick = getNanosecondsPerTick();
+  if (Lost)
+    emitLine(
+        llvm::formatv("  // {0} trace records were overwritten", Lost).str());
+  for (const TraceRecord& R : Records)
+    if (!R.IsPhase)
+      emitLine(FormatRecord(*this, R, NsPerTick));
+}
+
+std::string TraceInfo::writeChromeTrace(const std::string& Path) {
+  std::vector<TraceRecord> Records;
+  {
+    std::lock_guard<std::mutex> Lock(m_RingsMutex);
+    for (auto& Ring : m_Rings) {
+      uint64_t Head = Ring->Head.load(std::memory_order_acquire);
+      SnapshotRing(*Ring, Ring->Base, Head, Records);
+    }
+  }
+  // Parents first, so viewers nest spans that start on the same tick.
+  std::stable_sort(Records.begin(), Records.end(),
+                   [](const TraceRecord& A, const TraceRecord& B) {
+                     if (A.Start != B.Start)
+                       return A.Start < B.Start;
+                     return A.End > B.End;
+                   });
+
+  llvm::SmallString<128> OutPath(Path);
+  int FD;
+  std::error_code EC;
+  if (OutPath.empty()) {
+    llvm::SmallString<128> TmpDir;
+    llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, TmpDir);
+    llvm::sys::path::append(OutPath, TmpDir, "cppinterop-trace-%%%%%%.json");
+    EC = llvm::sys::fs::createUniqueFile(OutPath, FD, OutPath);
+  } else {
+    EC = llvm::sys::fs::openFileForWrite(OutPath, FD);
+  }
+  if (EC)
+    return "";
+  llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+
+  const double NsPerTick = getNanosecondsPerTick();
+  const auto Pid = static_cast<int64_t>(llvm::sys::Process::getProcessId());
+  auto ToMicros = [&](uint64_t Ticks) {
+    return double(Ticks) * NsPerTick / 1000.0;
+  };
+  auto Since = [&](uint64_t Ticks) {
+    return Ticks > m_CalibTicks ? Ticks - m_CalibTicks : 0;
+  };
+
+  llvm::json::OStream J(OS);
+  J.object([&] {
+    J.attributeArray("traceEvents", [&] {
+      for (const TraceRecord& R : Records) {
+        J.object([&] {
+          J.attribute("name", R.Api);
+          J.attribute("cat", R.IsPhase ? "phase" : "api");
+          J.attribute("ph", "X");
+          J.attribute("pid", Pid);
+          J.attribute("tid", int64_t(R.Thread));
+          J.attribute("ts", ToMicros(Since(R.Start)));
+          J.attribute("dur", ToMicros(R.End - R.Start));
+        });
+      }
+      J.object([&] {
+        J.attribute("name", "process_name");
+        J.attribute("ph", "M");
+        J.attribute("pid", Pid);
+        J.attributeObject("args", [&] { J.attribute("name", "CppInterOp"); });
+      });
+    });
+    J.attribute("displayTimeUnit", "ns");
+  });
+  OS.flush();
+  return std::string(OutPath);
 }
 
 /// Helper: emit version info as comment lines.
@@ -42,34 +626,128 @@ static void WriteVersionComment(llvm::raw_ostream& OS,
   }
 }
 
-std::string TraceInfo::writeToFile(const std::string& Version) {
+/// Helper: emit everything up to the body of reproducer().
+static void WriteReproducerHeader(llvm::raw_ostream& OS, llvm::StringRef Title,
+                                  const std::string& Version,
+                                  llvm::StringRef Note) {
+  OS << "// " << Title << "\n";
+  WriteVersionComment(OS, Version);
+  OS << "// " << Note << "\n";
+  OS << "#include <CppInterOp/CppInterOp.h>\n\n";
+  OS << "void reproducer() {\n";
+}
+
+/// Helper: close reproducer() and add main().
+static void WriteReproducerFooter(llvm::raw_ostream& OS) {
+  OS << "}\n\n";
+  OS << "int main() { reproducer(); return 0; }\n";
+}
+
+/// Helper: create a uniquely named reproducer in the temporary directory.
+static std::error_code CreateReproducerFile(llvm::SmallVectorImpl<char>& Path,
+                                            int& FD) {
   llvm::SmallString<128> TmpDir;
   llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, TmpDir);
-  llvm::SmallString<128> Path;
-  llvm::sys::path::append(Path, TmpDir, "cppinterop-reproducer-%%%%%%.cpp");
+  llvm::SmallString<128> Model;
+  llvm::sys::path::append(Model, TmpDir, "cppinterop-reproducer-%%%%%%.cpp");
+  return llvm::sys::fs::createUniqueFile(Model, FD, Path);
+}
+
+std::string TraceInfo::writeToFile(const std::string& Version) {
+  if (m_Mode == TraceMode::Binary)
+    flushRecords();
+
+  // The entries are already on disk; only the footer is missing.
+  if (m_Stream) {
+    std::string Path = m_StreamPath;
+    stopStreaming();
+    return Path;
+  }
 
+  llvm::SmallString<128> Path;
   int FD;
-  std::error_code EC = llvm::sys::fs::createUniqueFile(Path, FD, Path);
-  if (EC)
+  if (CreateReproducerFile(Path, FD))
     return "";
 
   llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
 
-  OS << "// CppInterOp crash reproducer\n";
   std::string Ver = Version.empty() ? CppImpl::GetVersion() : Version;
-  WriteVersionComment(OS, Ver);
-  OS << "// Generated automatically — re-run to reproduce the crash.\n";
-  OS << "#include <CppInterOp/CppInterOp.h>\n\n";
-  OS << "void reproducer() {\n";
+  WriteReproducerHeader(OS, "CppInterOp crash reproducer", Ver,
+                        "Generated automatically — re-run to reproduce the "
+                        "crash.");
   for (const auto& Line : m_Log)
     OS << Line << "\n";
-  OS << "}\n\n";
-  OS << "int main() { reproducer(); return 0; }\n";
+  WriteReproducerFooter(OS);
   OS.flush();
   return std::string(Path);
 }
 
+/// Completes a streamed reproducer when the process exits. TraceInfo is a
+/// ManagedStatic and nothing calls llvm_shutdown(), so its destructor alone
+/// would never run.
+static void StopStreamingAtExit() {
+  TraceInfo* TI = TraceInfo::TheTraceInfo;
+  if (!TI || !TI->isStreaming())
+    return;
+  if (TI->getMode() == TraceMode::Binary)
+    TI->flushRecords();
+  TI->stopStreaming();
+}
+
+std::string TraceInfo::startStreaming(const std::string& Path,
+                                      const std::string& Version) {
+  stopStreaming();
+  static std::once_flag AtExit;
+  std::call_once(AtExit, [] { std::atexit(StopStreamingAtExit); });
+  // Query the version first so that its own trace entry is not streamed.
+  std::string Ver = Version.empty() ? CppImpl::GetVersion() : Version;
+
+  llvm::SmallString<128> OutPath(Path);
+  int FD;
+  std::error_code EC =
+      OutPath.empty() ? CreateReproducerFile(OutPath, FD)
+                      : llvm::sys::fs::openFileForWrite(OutPath, FD);
+  if (EC)
+    return "";
+
+  m_Stream = std::make_unique<llvm::raw_fd_ostream>(FD, /*shouldClose=*/true);
+  m_Stream->SetBufferSize(64 * 1024);
+  m_StreamPath = std::string(OutPath);
+  WriteReproducerHeader(*m_Stream, "CppInterOp reproducer", Ver,
+                        "Streamed while the session ran.");
+  flushStream();
+  return m_StreamPath;
+}
+
+void TraceInfo::streamLine(const std::string& line) {
+  *m_Stream << line << "\n";
+  if (++m_StreamPending >= kStreamFlushLines ||
+      std::chrono::steady_clock::now() - m_StreamFlushed >=
+          kStreamFlushInterval)
+    flushStream();
+}
+
+void TraceInfo::flushStream() {
+  if (!m_Stream)
+    return;
+  m_Stream->flush();
+  m_StreamPending = 0;
+  m_StreamFlushed = std::chrono::steady_clock::now();
+}
+
+void TraceInfo::stopStreaming() {
+  if (!m_Stream)
+    return;
+  WriteReproducerFooter(*m_Stream);
+  m_Stream.reset();
+  m_StreamPath.clear();
+  m_StreamPending = 0;
+}
+
 std::string TraceInfo::StartRegion(bool WriteOnStdErr) {
+  // Records made before the region must not show up in it.
+  if (m_Mode == TraceMode::Binary)
+    flushRecords();
   m_RegionStart = m_Log.size();
   m_InRegion = true;
   m_WriteOnStdErr = WriteOnStdErr;
@@ -80,13 +758,9 @@ std::string TraceInfo::StartRegion(bool WriteOnStdErr) {
     return "";
   }
 
-  llvm::SmallString<128> TmpDir;
-  llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, TmpDir);
   llvm::SmallString<128> Path;
-  llvm::sys::path::append(Path, TmpDir, "cppinterop-reproducer-%%%%%%.cpp");
   int FD;
-  std::error_code EC = llvm::sys::fs::createUniqueFile(Path, FD, Path);
-  if (EC)
+  if (CreateReproducerFile(Path, FD))
     return "";
   llvm::sys::Process::SafelyCloseFileDescriptor(FD);
   m_RegionPath = std::string(Path);
@@ -96,6 +770,9 @@ std::string TraceInfo::StartRegion(bool WriteOnStdErr) {
 void TraceInfo::StopRegion(const std::string& Version) {
   if (!m_InRegion)
     return;
+  // Format pending binary records while they still belong to the region.
+  if (m_Mode == TraceMode::Binary)
+    flushRecords();
   m_InRegion = false;
 
   // When streaming to stderr, there is no file to write.
@@ -109,15 +786,11 @@ void TraceInfo::StopRegion(const std::string& Version) {
 
   std::string Ver = Version.empty() ? CppImpl::GetVersion() : Version;
 
-  OS << "// CppInterOp trace region\n";
-  WriteVersionComment(OS, Ver);
-  OS << "// Generated automatically.\n";
-  OS << "#include <CppInterOp/CppInterOp.h>\n\n";
-  OS << "void reproducer() {\n";
+  WriteReproducerHeader(OS, "CppInterOp trace region", Ver,
+                        "Generated automatically.");
   for (size_t i = m_RegionStart; i < m_Log.size(); ++i)
     OS << m_Log[i] << "\n";
-  OS << "}\n\n";
-  OS << "int main() { reproducer(); return 0; }\n";
+  WriteReproducerFooter(OS);
   OS.flush();
 }
 
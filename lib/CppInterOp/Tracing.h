@@ -23,39 +23,477 @@
 #define CPPINTEROP_TRACE_API
 #endif
 
+#include "Probes.h"
+
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace CppImpl {
+struct ApiStatistics;
+struct WrapperCompilationStats;
+} // namespace CppImpl
+
 namespace CppInterOp {
 namespace Tracing {
 
+struct OutParam;
+
+/// Selects how TraceRegion records API calls.
+enum class TraceMode {
+  /// Format every call into a reproducer line as soon as it returns.
+  Text,
+  /// Write fixed-size TraceRecords into per-thread ring buffers and format
+  /// them only when the log is dumped. Cheap enough to leave on in
+  /// production; keeps the most recent TraceRing::kCapacity calls per thread.
+  Binary
+};
+
+/// Read a cheap monotonic tick counter (the TSC on x86, the virtual counter
+/// on AArch64, steady_clock elsewhere). Ticks are converted to nanoseconds
+/// at dump time.
+inline uint64_t ReadTimestamp() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+  uint64_t Ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(Ticks));
+  return Ticks;
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/// One traced API call in TraceMode::Binary. The record is trivially
+/// copyable and holds raw values only: handles are resolved to reproducer
+/// variable names and timestamps to nanoseconds when the log is dumped.
+struct TraceRecord {
+  enum ArgKind : uint8_t {
+    Handle,
+    String,
+    Bool,
+    Signed,
+    Unsigned,
+    Float,
+    Container,
+    Unknown
+  };
+  static constexpr unsigned kMaxArgs = 6;
+  static constexpr unsigned kStrBytes = 40;
+  /// Set in Args[i] of a String argument that did not fit into Str.
+  static constexpr uint64_t kTruncated = uint64_t(1) << 32;
+
+  const char* Api;     ///< The traced function's __func__, used as its id.
+  uint64_t Start;      ///< ReadTimestamp() on entry.
+  uint64_t End;        ///< ReadTimestamp() on exit.
+  uint64_t Result;     ///< Returned pointer, if any.
+  uint64_t AllocBytes; ///< Heap bytes, valid if HasAllocs.
+  uint64_t ArenaBytes; ///< AST arena bytes, valid if HasAllocs.
+  uint64_t Args[kMaxArgs];
+  ArgKind Kinds[kMaxArgs];
+  uint32_t Thread;      ///< llvm::get_threadid() of the caller, truncated.
+  uint32_t Allocs;      ///< Heap allocations, valid if HasAllocs.
+  uint8_t NumArgs;      ///< Number of captured entries in Args.
+  uint8_t ExtraArgs;    ///< Arguments beyond kMaxArgs, printed as "...".
+  uint8_t StrUsed;      ///< Bytes of Str in use.
+  bool HasPtrResult;    ///< The function returns a pointer.
+  bool Returned;        ///< INTEROP_RETURN was reached.
+  bool IsPhase;         ///< A TracePhase rather than an API call.
+  bool HasAllocs;       ///< The call was under AllocTracker accounting.
+  bool Lossy;           ///< An argument was truncated, elided or dropped.
+  char Str[kStrBytes];  ///< NUL-separated copies of the string arguments.
+
+  void begin(const char* Name) {
+    Api = Name;
+    Result = 0;
+    NumArgs = ExtraArgs = StrUsed = 0;
+    HasPtrResult = Returned = IsPhase = HasAllocs = Lossy = false;
+  }
+
+  template <typename T> void capture(const T& V) {
+    using D = std::decay_t<T>;
+    if constexpr (std::is_same_v<D, OutParam>) {
+      // The call cannot be replayed without the container it fills.
+      Lossy = true;
+    } else if constexpr (std::is_same_v<D, void*>) {
+      add(Handle, reinterpret_cast<uintptr_t>(V));
+    } else if constexpr (std::is_same_v<D, const char*> ||
+                         std::is_same_v<D, char*>) {
+      addString(V, std::strlen(V));
+    } else if constexpr (std::is_same_v<D, std::string>) {
+      addString(V.data(), V.size());
+    } else if constexpr (std::is_same_v<D, bool>) {
+      add(Bool, V);
+    } else if constexpr (std::is_same_v<D, int> || std::is_same_v<D, long> ||
+                         std::is_same_v<D, long long>) {
+      add(Signed, static_cast<uint64_t>(static_cast<int64_t>(V)));
+    } else if constexpr (std::is_same_v<D, unsigned> ||
+                         std::is_same_v<D, unsigned long> ||
+                         std::is_same_v<D, unsigned long long>) {
+      add(Unsigned, static_cast<uint64_t>(V));
+    } else if constexpr (std::is_same_v<D, double> ||
+                         std::is_same_v<D, float>) {
+      double Dbl = V;
+      uint64_t Bits;
+      std::memcpy(&Bits, &Dbl, sizeof(Bits));
+      add(Float, Bits);
+    } else if constexpr (IsVector<D>::value) {
+      Lossy = true;
+      add(Container, 0);
+    } else {
+      Lossy = true;
+      add(Unknown, 0);
+    }
+  }
+
+  template <typename T> void setResult(const T& Val) {
+    Returned = true;
+    if constexpr (std::is_pointer_v<T>) {
+      HasPtrResult = true;
+      Result = reinterpret_cast<uintptr_t>(Val);
+    } else if constexpr (std::is_null_pointer_v<T>) {
+      HasPtrResult = true;
+    }
+  }
+
+private:
+  template <typename T> struct IsVector : std::false_type {};
+  template <typename T, typename A>
+  struct IsVector<std::vector<T, A>> : std::true_type {};
+
+  void add(ArgKind Kind, uint64_t Val) {
+    if (NumArgs == kMaxArgs) {
+      Lossy = true;
+      ++ExtraArgs;
+      return;
+    }
+    Kinds[NumArgs] = Kind;
+    Args[NumArgs++] = Val;
+  }
+
+  void addString(const char* S, size_t Len) {
+    size_t Room = kStrBytes - StrUsed;
+    size_t N = Room ? std::min(Len, Room - 1) : 0;
+    uint64_t Val = StrUsed | (N < Len ? kTruncated : 0);
+    Lossy |= N < Len;
+    if (Room) {
+      std::memcpy(Str + StrUsed, S, N);
+      Str[StrUsed + N] = '\0';
+      StrUsed = static_cast<uint8_t>(StrUsed + N + 1);
+    }
+    add(String, Val);
+  }
+};
+static_assert(std::is_trivially_copyable_v<TraceRecord>,
+              "TraceRecord is copied into ring buffers with plain stores");
+
+/// A single-producer ring of TraceRecords owned by one thread. The owner
+/// publishes a record by bumping Head; readers drop whatever the owner may
+/// have overwritten while they were copying, so writers never block.
+struct TraceRing {
+  static constexpr uint64_t kCapacity = 8192; // Must be a power of two.
+  std::atomic<uint64_t> Head{0};
+  std::atomic<bool> InUse{true}; ///< Cleared when the owning thread exits.
+  /// First unread record and first record kept after TraceInfo::clear().
+  /// Both are guarded by the ring list lock.
+  uint64_t Tail = 0;
+  uint64_t Base = 0;
+  uint32_t Thread = 0; ///< Thread currently writing to the ring.
+  std::unique_ptr<TraceRecord[]> Slots{new TraceRecord[kCapacity]};
+};
+
+/// A log-bucketed latency histogram in the style of HdrHistogram. Each power
+/// of two is split into kSub linear buckets, so a reported percentile is
+/// within 1/kSub of the true value. Safe to update from many threads.
+struct LatencyHistogram {
+  static constexpr unsigned kSubBits = 3;
+  static constexpr unsigned kSub = 1u << kSubBits;
+  static constexpr unsigned kBuckets = (64 - kSubBits + 1) * kSub;
+
+  std::atomic<uint64_t> Counts[kBuckets] = {};
+  std::atomic<uint64_t> Total{0};
+  std::atomic<uint64_t> Sum{0};
+  std::atomic<uint64_t> Min{UINT64_MAX};
+  std::atomic<uint64_t> Max{0};
+
+  static unsigned getBucket(uint64_t V) {
+    if (V < kSub)
+      return static_cast<unsigned>(V);
+    unsigned Shift = llvm::Log2_64(V) - kSubBits;
+    auto Sub = static_cast<unsigned>((V >> Shift) & (kSub - 1));
+    return (Shift + 1) * kSub + Sub;
+  }
+
+  /// The largest value that falls into bucket \p B.
+  static uint64_t getBucketUpperBound(unsigned B) {
+    if (B < kSub)
+      return B;
+    unsigned Shift = B / kSub - 1;
+    uint64_t Low = uint64_t(kSub + B % kSub) << Shift;
+    return Low + ((uint64_t(1) << Shift) - 1);
+  }
+
+  void add(uint64_t V) {
+    Counts[getBucket(V)].fetch_add(1, std::memory_order_relaxed);
+    Total.fetch_add(1, std::memory_order_relaxed);
+    Sum.fetch_add(V, std::memory_order_relaxed);
+    uint64_t Old = Min.load(std::memory_order_relaxed);
+    while (V < Old && !Min.compare_exchange_weak(Old, V))
+      ;
+    Old = Max.load(std::memory_order_relaxed);
+    while (V > Old && !Max.compare_exchange_weak(Old, V))
+      ;
+  }
+
+  void reset() {
+    for (auto& C : Counts)
+      C.store(0, std::memory_order_relaxed);
+    Total.store(0, std::memory_order_relaxed);
+    Sum.store(0, std::memory_order_relaxed);
+    Min.store(UINT64_MAX, std::memory_order_relaxed);
+    Max.store(0, std::memory_order_relaxed);
+  }
+};
+
+/// Heap and AST arena usage. Heap allocations are counted by the replaced
+/// global operator new of CPPINTEROP_ENABLE_ALLOC_TRACKING builds; arena
+/// bytes come from the probe installed with AllocTracker::setArenaProbe().
+struct AllocCounters {
+  uint64_t Allocs = 0;     ///< Calls to operator new.
+  uint64_t Bytes = 0;      ///< Bytes requested from operator new.
+  uint64_t ArenaBytes = 0; ///< Bytes handed out by the AST's BumpPtrAllocator.
+
+  AllocCounters& operator+=(const AllocCounters& O) {
+    Allocs += O.Allocs;
+    Bytes += O.Bytes;
+    ArenaBytes += O.ArenaBytes;
+    return *this;
+  }
+  /// Saturates at zero: the arena shrinks when the probe moves on to a
+  /// newer interpreter.
+  AllocCounters operator-(const AllocCounters& O) const {
+    auto Sub = [](uint64_t A, uint64_t B) { return A > B ? A - B : 0; };
+    return {Sub(Allocs, O.Allocs), Sub(Bytes, O.Bytes),
+            Sub(ArenaBytes, O.ArenaBytes)};
+  }
+};
+
+/// The allocations of the calling thread so far. Updated without atomics by
+/// the operator new replacement.
+CPPINTEROP_TRACE_API extern thread_local AllocCounters ThreadAllocs;
+
+/// Attributes allocations to the innermost TraceRegion of each thread.
+/// Regions push a frame on entry and pop it on exit; a region is charged for
+/// what was allocated while it was innermost, excluding its own tracing
+/// bookkeeping and everything its nested regions allocated.
+class AllocTracker {
+  CPPINTEROP_TRACE_API static std::atomic<bool> Enabled;
+  CPPINTEROP_TRACE_API static std::atomic<uint64_t (*)()> ArenaProbe;
+
+public:
+  static constexpr unsigned kMaxDepth = 64;
+
+  static bool isEnabled() { return Enabled.load(std::memory_order_relaxed); }
+  CPPINTEROP_TRACE_API static void setEnabled(bool On);
+
+  /// Install a function returning the bytes allocated so far from the
+  /// current interpreter's AST arena; null disables arena accounting.
+  static void setArenaProbe(uint64_t (*Probe)()) {
+    ArenaProbe.store(Probe, std::memory_order_relaxed);
+  }
+
+  /// Count one heap allocation of \p Size bytes on this thread.
+  static void noteAlloc(size_t Size) {
+    if (!isEnabled())
+      return;
+    ++ThreadAllocs.Allocs;
+    ThreadAllocs.Bytes += Size;
+  }
+
+  /// This thread's totals, including the arena probe.
+  static AllocCounters now() {
+    AllocCounters C = ThreadAllocs;
+    if (auto* Probe = ArenaProbe.load(std::memory_order_relaxed))
+      C.ArenaBytes = Probe();
+    return C;
+  }
+
+  /// Open a frame. \returns false when regions nest deeper than kMaxDepth,
+  /// in which case no other member may be called for this region.
+  CPPINTEROP_TRACE_API static bool push();
+  /// Start charging the innermost frame; what came before is overhead.
+  CPPINTEROP_TRACE_API static void begin();
+  /// Stop charging the innermost frame. \returns its exclusive usage.
+  CPPINTEROP_TRACE_API static AllocCounters end();
+  /// Close the innermost frame and charge its whole span to the parent's
+  /// children.
+  CPPINTEROP_TRACE_API static void pop();
+};
+
+/// Format \p C for the reproducer, next to the [N ns] timing.
+inline std::string FormatAllocs(const AllocCounters& C) {
+  return llvm::formatv(" [{0} allocs, {1} B heap, {2} B arena]", C.Allocs,
+                       C.Bytes, C.ArenaBytes)
+      .str();
+}
+
+/// Call counter and latency histogram of one INTEROP_TRACE site. Every traced
+/// function has a constant-initialized static instance, which stays inert
+/// until statistics are switched on with setSampling().
+class ApiCallSite {
+  const char* m_Name;
+  std::atomic<uint64_t> m_Calls{0};
+  std::atomic<LatencyHistogram*> m_Hist{nullptr};
+  std::atomic<bool> m_Registered{false};
+  std::atomic<uint64_t> m_Allocs{0};
+  std::atomic<uint64_t> m_AllocBytes{0};
+  std::atomic<uint64_t> m_ArenaBytes{0};
+
+  CPPINTEROP_TRACE_API static std::atomic<unsigned> SampleEvery;
+
+  /// Add this site to the list reported by CollectApiStatistics.
+  CPPINTEROP_TRACE_API void registerSite();
+
+  /// Pick roughly one call in \p N. The gaps are randomized so that callers
+  /// alternating between APIs do not always sample the same one.
+  static bool takeSample(unsigned N) {
+    thread_local uint32_t Countdown = 0;
+    thread_local uint32_t Seed = 0x9E3779B9u;
+    if (Countdown) {
+      --Countdown;
+      return false;
+    }
+    if (N > 1) {
+      Seed ^= Seed << 13;
+      Seed ^= Seed >> 17;
+      Seed ^= Seed << 5;
+      Countdown = Seed % (2 * N - 1);
+    }
+    return true;
+  }
+
+public:
+  constexpr explicit ApiCallSite(const char* Name) : m_Name(Name) {}
+  ApiCallSite(const ApiCallSite&) = delete;
+  ApiCallSite& operator=(const ApiCallSite&) = delete;
+
+  const char* getName() const { return m_Name; }
+  uint64_t getCalls() const { return m_Calls.load(std::memory_order_relaxed); }
+  const LatencyHistogram& getHistogram() const {
+    return *m_Hist.load(std::memory_order_acquire);
+  }
+
+  /// Count a call. \returns true if the call should also be timed.
+  bool beginCall() {
+    unsigned N = SampleEvery.load(std::memory_order_relaxed);
+    if (!N)
+      return false;
+    if (!m_Registered.load(std::memory_order_acquire))
+      registerSite();
+    m_Calls.fetch_add(1, std::memory_order_relaxed);
+    return takeSample(N);
+  }
+
+  /// Record the duration, in ReadTimestamp() ticks, of a sampled call.
+  void endCall(uint64_t Ticks) {
+    m_Hist.load(std::memory_order_acquire)->add(Ticks);
+  }
+
+  /// Add the allocations of a sampled call.
+  void addAllocs(const AllocCounters& C) {
+    m_Allocs.fetch_add(C.Allocs, std::memory_order_relaxed);
+    m_AllocBytes.fetch_add(C.Bytes, std::memory_order_relaxed);
+    m_ArenaBytes.fetch_add(C.ArenaBytes, std::memory_order_relaxed);
+  }
+  AllocCounters getAllocs() const {
+    return {m_Allocs.load(std::memory_order_relaxed),
+            m_AllocBytes.load(std::memory_order_relaxed),
+            m_ArenaBytes.load(std::memory_order_relaxed)};
+  }
+
+  void reset() {
+    m_Calls.store(0, std::memory_order_relaxed);
+    m_Allocs.store(0, std::memory_order_relaxed);
+    m_AllocBytes.store(0, std::memory_order_relaxed);
+    m_ArenaBytes.store(0, std::memory_order_relaxed);
+    if (LatencyHistogram* H = m_Hist.load(std::memory_order_acquire))
+      H->reset();
+  }
+
+  /// Time one call in every \p N to every traced API; 0 turns statistics
+  /// off. Call counters stay exact whenever statistics are on.
+  CPPINTEROP_TRACE_API static void setSampling(unsigned N);
+  static unsigned getSampling() {
+    return SampleEvery.load(std::memory_order_relaxed);
+  }
+};
+
+/// Summarize every API called while statistics were on, merging overloads
+/// that share a name. Latencies are converted to nanoseconds.
+CPPINTEROP_TRACE_API void
+CollectApiStatistics(std::vector<CppImpl::ApiStatistics>& Stats);
+
+/// Zero all call counters and histograms.
+CPPINTEROP_TRACE_API void ResetApiStatistics();
+
 class TraceInfo {
   llvm::TimerGroup m_TG;
   llvm::StringMap<std::unique_ptr<llvm::Timer>> m_Timers;
   std::vector<llvm::Timer*> m_TimerStack;
 
   std::unordered_map<void*, std::string> m_HandleMap;
+  /// Named handles without a variable in the reproducer.
+  std::unordered_set<void*> m_Undeclared;
   unsigned m_VarCount = 0;
 
   std::vector<std::string> m_Log;
   size_t m_RegionStart = 0; ///< Log index where current region began.
   bool m_InRegion = false;  ///< True between StartTracing/StopTracing.
 
+  TraceMode m_Mode = TraceMode::Text;
+  const unsigned m_Id; ///< Lets threads notice a new TraceInfo instance.
+  std::mutex m_RingsMutex;
+  std::vector<std::unique_ptr<TraceRing>> m_Rings;
+  /// Tick and steady_clock readings used to convert ticks to nanoseconds.
+  uint64_t m_CalibTicks = 0;
+  std::chrono::steady_clock::time_point m_CalibTime;
+
+  TraceRing& registerRing();
+  double getNanosecondsPerTick() const;
+
 public:
-  TraceInfo() : m_TG("CppInterOp", "CppInterOp Timing Report") {}
-  ~TraceInfo() { TheTraceInfo = nullptr; }
+  CPPINTEROP_TRACE_API TraceInfo();
+  ~TraceInfo() {
+    stopStreaming();
+    TheTraceInfo = nullptr;
+  }
   TraceInfo(const TraceInfo&) = delete;
   TraceInfo& operator=(const TraceInfo&) = delete;
   TraceInfo(TraceInfo&&) = delete;
@@ -63,6 +501,26 @@ public:
 
   static bool isEnabled() { return TheTraceInfo; }
 
+  TraceMode getMode() const { return m_Mode; }
+  CPPINTEROP_TRACE_API void setMode(TraceMode Mode);
+
+  /// Publish a binary record into the calling thread's ring. Lock-free
+  /// except for the first call on each thread, which registers its ring.
+  CPPINTEROP_TRACE_API void commitRecord(const TraceRecord& R);
+
+  /// Format the records gathered in TraceMode::Binary since the last flush
+  /// and append them to the log, oldest first. Records overwritten before
+  /// they could be read are reported as a single comment line.
+  CPPINTEROP_TRACE_API void flushRecords();
+
+  /// Write the API calls and phases still held in the per-thread rings as
+  /// Chrome trace-event JSON, loadable in chrome://tracing and Perfetto.
+  /// Spans are recorded in both modes; text mode keeps no arguments.
+  /// \param Path output file; a temporary file is created when empty.
+  /// \returns the path written, or an empty string on failure.
+  CPPINTEROP_TRACE_API std::string
+  writeChromeTrace(const std::string& Path = "");
+
   llvm::Timer& getTimer(llvm::StringRef Name) {
     auto& T = m_Timers[Name];
     if (!T)
@@ -86,15 +544,25 @@ public:
       m_TimerStack.back()->startTimer();
   }
 
-  std::string getOrRegisterHandle(void* p) {
+  /// Name \p p. A handle registered as not \p Declared has no variable in
+  /// the reproducer until a replayable call returns it, so the calls using it
+  /// are written as comments.
+  std::string getOrRegisterHandle(void* p, bool Declared = true) {
     if (!p)
       return "";
     auto it = m_HandleMap.find(p);
-    if (it != m_HandleMap.end())
+    if (it != m_HandleMap.end()) {
+      if (Declared)
+        m_Undeclared.erase(p);
       return it->second;
+    }
+    if (!Declared)
+      m_Undeclared.insert(p);
     return m_HandleMap[p] = "v" + std::to_string(++m_VarCount);
   }
 
+  bool isDeclaredHandle(void* p) const { return !m_Undeclared.count(p); }
+
   std::string lookupHandle(void* p) {
     if (!p)
       return "nullptr";
@@ -102,10 +570,12 @@ public:
     return (it != m_HandleMap.end()) ? it->second : "nullptr";
   }
 
+  /// Append a line to the text log. Ignored in TraceMode::Binary, where the
+  /// log is only written from flushRecords().
   void appendToLog(const std::string& line) {
-    m_Log.push_back(line);
-    if (m_InRegion && m_WriteOnStdErr)
-      llvm::errs() << line << "\n";
+    if (m_Mode == TraceMode::Binary)
+      return;
+    emitLine(line);
   }
   const std::vector<std::string>& getLog() const { return m_Log; }
   std::string getLastLogEntry() const {
@@ -123,12 +593,59 @@ public:
   /// End the traced region and write only the region's entries to the file.
   CPPINTEROP_TRACE_API void StopRegion(const std::string& Version = "");
 
+  /// Write log entries straight to a reproducer file instead of keeping them
+  /// in memory. Writes are buffered and flushed every kStreamFlushLines
+  /// entries or kStreamFlushInterval, whichever comes first. Both are only
+  /// checked when an entry is written, so the tail of an idle session stays
+  /// buffered until the next entry, flushStream() or process exit, which
+  /// completes the file. Entries made in a StartRegion() region are still
+  /// kept in memory for StopRegion().
+  /// \param Path the file to write; a temporary file is created when empty.
+  /// \returns the path being written, or an empty string on failure.
+  CPPINTEROP_TRACE_API std::string
+  startStreaming(const std::string& Path = "", const std::string& Version = "");
+
+  /// Complete the streamed reproducer and close it. Later entries go back to
+  /// the in-memory log.
+  CPPINTEROP_TRACE_API void stopStreaming();
+
+  /// Push buffered entries to the streamed file.
+  CPPINTEROP_TRACE_API void flushStream();
+
+  bool isStreaming() const { return m_Stream != nullptr; }
+
+  static constexpr unsigned kStreamFlushLines = 256;
+  static constexpr std::chrono::seconds kStreamFlushInterval{1};
+
 private:
   std::string m_RegionPath;
   bool m_WriteOnStdErr = false;
 
+  std::unique_ptr<llvm::raw_fd_ostream> m_Stream;
+  std::string m_StreamPath;
+  unsigned m_StreamPending = 0; ///< Entries written since the last flush.
+  std::chrono::steady_clock::time_point m_StreamFlushed;
+
+  CPPINTEROP_TRACE_API void streamLine(const std::string& line);
+
+  void emitLine(const std::string& line) {
+    if (m_Stream)
+      streamLine(line);
+    if (!m_Stream || m_InRegion)
+      m_Log.push_back(line);
+    if (m_InRegion && m_WriteOnStdErr)
+      llvm::errs() << line << "\n";
+  }
+
 public:
   void clear() {
+    stopStreaming();
+    {
+      // Discard unread binary records; the rings stay with their threads.
+      std::lock_guard<std::mutex> Lock(m_RingsMutex);
+      for (auto& Ring : m_Rings)
+        Ring->Base = Ring->Tail = Ring->Head.load(std::memory_order_acquire);
+    }
     // Stop any running timers before clearing to avoid triggering
     // TimerGroup's destructor report.
     while (!m_TimerStack.empty()) {
@@ -139,6 +656,7 @@ public:
     m_TG.clear();
     m_Timers.clear();
     m_HandleMap.clear();
+    m_Undeclared.clear();
     m_Log.clear();
     m_VarCount = 0;
   }
@@ -146,9 +664,59 @@ public:
   CPPINTEROP_TRACE_API static TraceInfo* TheTraceInfo;
 };
 
+/// Steps of turning a FunctionDecl into a callable wrapper. Reported by
+/// Cpp::GetWrapperCompilationStats and as "wrapper.*" phase spans.
+enum class WrapperPhase : unsigned {
+  Source,     ///< Generating the wrapper's C++ source.
+  Compile,    ///< All of compile_wrapper, covering the phases below.
+  Frontend,   ///< Parsing, Sema and CodeGen to LLVM IR.
+  Execute,    ///< Handing the module to the JIT and running initializers.
+  Lookup,     ///< Resolving the wrapper's address.
+  JitCompile, ///< IR optimisation and object emission in the JIT.
+  JitLink,    ///< Linking and finalizing the object in the JIT.
+  NumPhases
+};
+
+CPPINTEROP_TRACE_API void EnterWrapperPhase();
+CPPINTEROP_TRACE_API void LeaveWrapperPhase(WrapperPhase Phase, uint64_t Start,
+                                            uint64_t End);
+
+/// Times one WrapperPhase on the current thread. JIT compilation reported
+/// through the Notify functions below is only counted inside such a scope,
+/// so modules compiled for user code are not attributed to wrappers.
+class WrapperPhaseScope {
+  WrapperPhase m_Phase;
+  uint64_t m_Start;
+
+public:
+  explicit WrapperPhaseScope(WrapperPhase Phase) : m_Phase(Phase) {
+    EnterWrapperPhase();
+    m_Start = ReadTimestamp();
+  }
+  ~WrapperPhaseScope() { LeaveWrapperPhase(m_Phase, m_Start, ReadTimestamp()); }
+  WrapperPhaseScope(const WrapperPhaseScope&) = delete;
+  WrapperPhaseScope& operator=(const WrapperPhaseScope&) = delete;
+};
+
+/// Count a compiled wrapper and the size of its source.
+CPPINTEROP_TRACE_API void RecordWrapperSource(size_t Bytes);
+/// Called by the JIT's IR transform layer when it starts compiling a module.
+CPPINTEROP_TRACE_API void NotifyWrapperJitCompile();
+/// Called by the JIT's object transform layer with each emitted object.
+CPPINTEROP_TRACE_API void NotifyWrapperObject(size_t Bytes);
+
+/// Fill \p Stats with the totals gathered since the last reset.
+CPPINTEROP_TRACE_API void
+CollectWrapperStats(CppImpl::WrapperCompilationStats& Stats);
+CPPINTEROP_TRACE_API void ResetWrapperStats();
+
+/// Nanoseconds per ReadTimestamp() tick, calibrated since startup.
+CPPINTEROP_TRACE_API double NanosecondsPerTick();
+
 /// Activate tracing. Called once during process initialization.
 /// After this, TheTraceInfo is non-null and all INTEROP_TRACE calls record.
-CPPINTEROP_TRACE_API void InitTracing();
+/// \param Mode whether calls are formatted eagerly or stored as records.
+CPPINTEROP_TRACE_API void InitTracing(TraceMode Mode = TraceMode::Text);
 
 /// Begin recording a traced region. If tracing is not yet active, activates
 /// it. Returns the path where StopTracing() will write the reproducer.
@@ -166,13 +734,31 @@ inline void StopTracing(const std::string& Version = "") {
     TraceInfo::TheTraceInfo->StopRegion(Version);
 }
 
+/// Stream every traced call to \p Path as it happens, keeping memory use
+/// bounded for long sessions. If tracing is not yet active, activates it.
+/// \returns the path being written, or an empty string on failure.
+inline std::string StartStreaming(const std::string& Path = "") {
+  if (!TraceInfo::TheTraceInfo)
+    InitTracing();
+  return TraceInfo::TheTraceInfo->startStreaming(Path);
+}
+
+/// Export the recorded API timings as Chrome trace-event JSON.
+/// \returns the path written, or an empty string if tracing is off.
+inline std::string WriteChromeTrace(const std::string& Path = "") {
+  if (!TraceInfo::TheTraceInfo)
+    return "";
+  return TraceInfo::TheTraceInfo->writeChromeTrace(Path);
+}
+
 /// Marks a function parameter as an output container (e.g. std::vector<T>&
 /// that the function fills). Constructed via the INTEROP_OUT(var) macro.
 ///
 /// Purpose:
 ///  - Excluded from the reproducer's argument list (it's an output, not input).
 ///  - If the container holds pointers, its elements are registered as handles
-///    at trace-region exit so later calls can reference them by name.
+///    at trace-region exit so later calls can reference them by name. The
+///    call itself cannot be replayed, so the handles are not declared.
 ///
 /// The container type is erased at construction via MakeOutParam() so that
 /// all downstream code (ReproBuffer, TraceRegion) works with a single
@@ -183,16 +769,24 @@ struct OutParam {
   std::function<void(TraceInfo&)> RegisterHandles;
 };
 
-/// Create an OutParam for any container. Only sets up handle registration
-/// when the container's value_type is a pointer.
+template <typename T, typename = void>
+struct HasValueType : std::false_type {};
+template <typename T>
+struct HasValueType<T, std::void_t<typename T::value_type>> : std::true_type {};
+
+/// Create an OutParam for any container or output struct. Only sets up
+/// handle registration when the container's value_type is a pointer.
 template <typename Container> OutParam MakeOutParam(const Container& C) {
   OutParam OP;
-  using Value = typename Container::value_type;
-  if constexpr (std::is_pointer_v<Value>) {
-    OP.RegisterHandles = [&C](TraceInfo& TI) {
-      for (const auto& Elem : C)
-        TI.getOrRegisterHandle(reinterpret_cast<void*>(Elem));
-    };
+  if constexpr (HasValueType<Container>::value) {
+    using Value = typename Container::value_type;
+    if constexpr (std::is_pointer_v<Value>) {
+      OP.RegisterHandles = [&C](TraceInfo& TI) {
+        for (const auto& Elem : C)
+          TI.getOrRegisterHandle(reinterpret_cast<void*>(Elem),
+                                 /*Declared=*/false);
+      };
+    }
   }
   return OP;
 }
@@ -201,15 +795,29 @@ template <typename Container> OutParam MakeOutParam(const Container& C) {
 struct ReproBuffer {
   llvm::SmallString<128> Buffer;
   llvm::raw_svector_ostream OS;
+  /// An argument could not be written as C++, so the call cannot be replayed.
+  bool Lossy = false;
 
   ReproBuffer() : OS(Buffer) {}
 
   // Opaque handle pointers — resolved to their registered name.
-  void append(void* p) { OS << TraceInfo::TheTraceInfo->lookupHandle(p); }
+  void append(void* p) {
+    TraceInfo& TI = *TraceInfo::TheTraceInfo;
+    Lossy |= !TI.isDeclaredHandle(p);
+    OS << TI.lookupHandle(p);
+  }
 
-  // Strings — quoted.
-  void append(const char* s) { OS << "\"" << s << "\""; }
-  void append(const std::string& s) { OS << "\"" << s << "\""; }
+  // Strings — quoted and escaped, so that the call stays on one line.
+  void append(const char* s) {
+    if (!s) {
+      OS << "nullptr";
+      return;
+    }
+    OS << "\"";
+    OS.write_escaped(s);
+    OS << "\"";
+  }
+  void append(const std::string& s) { append(s.c_str()); }
 
   // Numeric types — printed directly.
   void append(bool v) { OS << (v ? "true" : "false"); }
@@ -222,13 +830,32 @@ struct ReproBuffer {
   void append(double d) { OS << llvm::formatv("{0:f}", d); }
   void append(float f) { OS << llvm::formatv("{0:f}", f); }
 
-  // Containers — not meaningfully printable; emit a placeholder.
-  template <typename T> void append(const std::vector<T>&) { OS << "{...}"; }
+  // Containers — a braced list if the elements are printable, such as
+  // the arguments of CreateInterpreter, otherwise a placeholder.
+  template <typename T> void append(const std::vector<T>& V) {
+    if constexpr (std::is_same_v<T, void*> || std::is_same_v<T, const char*> ||
+                  std::is_same_v<T, std::string> || std::is_arithmetic_v<T>) {
+      OS << "{";
+      for (size_t I = 0; I < V.size(); ++I) {
+        if (I)
+          OS << ", ";
+        append(static_cast<T>(V[I]));
+      }
+      OS << "}";
+    } else {
+      Lossy = true;
+      OS << "{...}";
+    }
+  }
 
   // Anything else we haven't accounted for.
-  template <typename T> void append(const T&) { OS << "?"; }
+  template <typename T> void append(const T&) {
+    Lossy = true;
+    OS << "?";
+  }
 
-  /// Format a comma-separated argument list, skipping OutParam entries.
+  /// Format a comma-separated argument list, skipping OutParam entries. The
+  /// call cannot be replayed without the container an OutParam fills.
   template <typename... Args> void format(Args&&... args) {
     bool first = true;
     auto appendOne = [&](auto&& val) {
@@ -237,6 +864,8 @@ struct ReproBuffer {
           OS << ", ";
         first = false;
         append(std::forward<decltype(val)>(val));
+      } else {
+        Lossy = true;
       }
     };
     (appendOne(std::forward<Args>(args)), ...);
@@ -253,11 +882,36 @@ struct TraceData {
   bool HasPtrResult = false;
   double StartTime = 0;
   bool Returned = false;
+  /// The call is written as a comment, see ReproBuffer::Lossy.
+  bool Lossy = false;
   llvm::SmallVector<std::function<void(TraceInfo&)>, 2> OutCallbacks;
 };
 
 class TraceRegion {
   std::unique_ptr<TraceData> m_Data;
+  /// Used instead of m_Data in TraceMode::Binary. Left uninitialized unless
+  /// m_Binary is set, so disabled tracing does not pay for it.
+  TraceRecord m_Record;
+  bool m_Binary = false;
+  /// Set when this call is sampled for the API statistics.
+  ApiCallSite* m_Site = nullptr;
+  uint64_t m_SiteStart = 0;
+  /// Set when this call has an AllocTracker frame.
+  bool m_Allocs = false;
+#ifdef CPPINTEROP_ENABLE_USDT
+  /// Reported by the api__return probe; cleared when moved from.
+  const char* m_ProbeName = nullptr;
+#endif
+
+  static void checkReturned(const char* Name, bool Returned) {
+    if (Returned)
+      return;
+    llvm::errs() << "ERROR: Function '" << Name
+                 << "' exited without calling INTEROP_RETURN!\n";
+    assert(
+        Returned &&
+        "Unannotated exit branch detected: use `return INTEROP_RETURN(...)`");
+  }
 
   // Capture an OutParam's handle-registration callback; ignore everything else.
   void captureArg(OutParam&& op) {
@@ -267,9 +921,33 @@ class TraceRegion {
   template <typename T> void captureArg(T&&) {}
 
 public:
-  template <typename... Args> TraceRegion(const char* Name, Args&&... args) {
-    if (!TraceInfo::TheTraceInfo)
+  template <typename... Args>
+  TraceRegion(ApiCallSite* Site, const char* Name, Args&&... args) {
+#ifdef CPPINTEROP_ENABLE_USDT
+    m_ProbeName = Name;
+    CPPINTEROP_PROBE1(api__entry, Name);
+#endif
+    // Open the frame before our own bookkeeping, so that a parent region is
+    // not charged for it.
+    if (AllocTracker::isEnabled() &&
+        (TraceInfo::TheTraceInfo || ApiCallSite::getSampling()))
+      m_Allocs = AllocTracker::push();
+    if (Site && Site->beginCall()) {
+      m_Site = Site;
+      m_SiteStart = ReadTimestamp();
+    }
+    if (!TraceInfo::TheTraceInfo) {
+      beginAllocs();
+      return;
+    }
+    if (TraceInfo::TheTraceInfo->getMode() == TraceMode::Binary) {
+      m_Binary = true;
+      m_Record.begin(Name);
+      (m_Record.capture(args), ...);
+      m_Record.Start = ReadTimestamp();
+      beginAllocs();
       return;
+    }
     m_Data = std::make_unique<TraceData>();
     m_Data->Name = Name;
     (captureArg(std::forward<Args>(args)), ...);
@@ -277,45 +955,93 @@ public:
       ReproBuffer RB;
       RB.format(std::forward<Args>(args)...);
       m_Data->ArgStr = RB.Buffer;
+      m_Data->Lossy = RB.Lossy;
     }
     TraceInfo& TI = *TraceInfo::TheTraceInfo;
     TI.pushTimer(&TI.getTimer(Name));
     m_Data->StartTime = llvm::TimeRecord::getCurrentTime(false).getWallTime();
+    // Keep a bare span record as well, for writeChromeTrace().
+    m_Record.begin(Name);
+    m_Record.Start = ReadTimestamp();
+    beginAllocs();
   }
 
   ~TraceRegion() {
-    if (!m_Data)
+#ifdef CPPINTEROP_ENABLE_USDT
+    if (m_ProbeName)
+      CPPINTEROP_PROBE1(api__return, m_ProbeName);
+#endif
+    if (m_Site)
+      m_Site->endCall(ReadTimestamp() - m_SiteStart);
+    if (!m_Allocs) {
+      finish(nullptr);
       return;
+    }
+    AllocCounters Allocs = AllocTracker::end();
+    if (m_Site)
+      m_Site->addAllocs(Allocs);
+    finish(&Allocs);
+    AllocTracker::pop();
+  }
 
-    if (!m_Data->Returned) {
-      llvm::errs() << "ERROR: Function '" << m_Data->Name
-                   << "' exited without calling INTEROP_RETURN!\n";
-      assert(
-          m_Data->Returned &&
-          "Unannotated exit branch detected: use `return INTEROP_RETURN(...)`");
+private:
+  void beginAllocs() {
+    if (m_Allocs)
+      AllocTracker::begin();
+  }
+
+  /// Log or record the finished call. \p Allocs is its exclusive allocation
+  /// usage, if it was accounted.
+  void finish(const AllocCounters* Allocs) {
+    if (m_Binary) {
+      m_Record.End = ReadTimestamp();
+      if (Allocs) {
+        m_Record.HasAllocs = true;
+        m_Record.Allocs = static_cast<uint32_t>(
+            std::min<uint64_t>(Allocs->Allocs, UINT32_MAX));
+        m_Record.AllocBytes = Allocs->Bytes;
+        m_Record.ArenaBytes = Allocs->ArenaBytes;
+      }
+      checkReturned(m_Record.Api, m_Record.Returned);
+      if (TraceInfo* TI = TraceInfo::TheTraceInfo)
+        TI->commitRecord(m_Record);
+      return;
     }
+    if (!m_Data)
+      return;
+
+    checkReturned(m_Data->Name, m_Data->Returned);
 
     auto EndTime = llvm::TimeRecord::getCurrentTime(false).getWallTime();
     auto Dur = static_cast<long long>((EndTime - m_Data->StartTime) * 1e9);
     TraceInfo& TI = *TraceInfo::TheTraceInfo;
     TI.popTimer();
+    m_Record.End = ReadTimestamp();
+    m_Record.Returned = true;
+    TI.commitRecord(m_Record);
 
     // Register out-param handles now that the function has filled them.
     for (auto& cb : m_Data->OutCallbacks)
       cb(TI);
 
+    // A call that cannot be replayed is written as a comment. The handle it
+    // returns is named but not declared, so the calls using it are as well.
     std::string VarPart;
-    if (m_Data->Result) {
-      bool isNew = TI.lookupHandle(m_Data->Result) == "nullptr";
-      std::string HandleName = TI.getOrRegisterHandle(m_Data->Result);
+    if (void* Result = m_Data->Result) {
+      bool isNew = TI.lookupHandle(Result) == "nullptr" ||
+                   !TI.isDeclaredHandle(Result);
+      std::string HandleName = TI.getOrRegisterHandle(Result, !m_Data->Lossy);
       VarPart =
           llvm::formatv(isNew ? "auto {0} = " : "/*{0}*/ ", HandleName).str();
     } else if (m_Data->HasPtrResult) {
       VarPart = "/*nullptr*/ ";
     }
 
-    std::string Call = llvm::formatv("  {0}Cpp::{1}({2}); // [{3} ns]", VarPart,
-                                     m_Data->Name, m_Data->ArgStr, Dur);
+    std::string Call = llvm::formatv(
+        "  {0}{1}Cpp::{2}({3}); // [{4} ns]", m_Data->Lossy ? "// " : "",
+        VarPart, m_Data->Name, m_Data->ArgStr, Dur);
+    if (Allocs)
+      Call += FormatAllocs(*Allocs);
 
     // Store in log for the reproducer file.
     TI.appendToLog(Call);
@@ -323,16 +1049,33 @@ public:
     m_Data.reset();
   }
 
+public:
+
   TraceRegion(const TraceRegion&) = delete;
   TraceRegion& operator=(const TraceRegion&) = delete;
-  TraceRegion(TraceRegion&&) noexcept = default;
+  TraceRegion(TraceRegion&& Other) noexcept
+      : m_Data(std::move(Other.m_Data)), m_Record(Other.m_Record),
+        m_Binary(Other.m_Binary), m_Site(Other.m_Site),
+        m_SiteStart(Other.m_SiteStart), m_Allocs(Other.m_Allocs) {
+    Other.m_Binary = false;
+    Other.m_Site = nullptr;
+    Other.m_Allocs = false;
+#ifdef CPPINTEROP_ENABLE_USDT
+    m_ProbeName = Other.m_ProbeName;
+    Other.m_ProbeName = nullptr;
+#endif
+  }
   TraceRegion& operator=(TraceRegion&&) = delete;
 
-  [[nodiscard]] bool isActive() const { return m_Data != nullptr; }
+  [[nodiscard]] bool isActive() const { return m_Data || m_Binary; }
 
   /// Record a non-void return value. Tracks pointer results for the
   /// reproducer's handle chain (e.g. auto v1 = Cpp::GetScope(...)).
   template <typename T> T record(T val) {
+    if (m_Binary) {
+      m_Record.setResult(val);
+      return val;
+    }
     if (!m_Data)
       return val;
     m_Data->Returned = true;
@@ -347,7 +1090,9 @@ public:
   }
 
   void recordVoid() {
-    if (m_Data)
+    if (m_Binary)
+      m_Record.Returned = true;
+    else if (m_Data)
       m_Data->Returned = true;
   }
 
@@ -407,6 +1152,7 @@ public:
   struct Proxy {
     const char* Name;
     const char* Sig;
+    ApiCallSite* Site;
     template <typename... Args> TraceRegion operator()(Args&&... args) {
 #ifndef NDEBUG
       unsigned expected = countParams(Sig);
@@ -422,11 +1168,38 @@ public:
                "parameters. Update the INTEROP_TRACE call.");
       }
 #endif
-      return TraceRegion(Name, std::forward<Args>(args)...);
+      return TraceRegion(Site, Name, std::forward<Args>(args)...);
     }
   };
 };
 
+/// Times a step inside an API call, such as one stage of wrapper
+/// compilation. Phases show up as nested spans in writeChromeTrace() but are
+/// never written to the reproducer.
+class TracePhase {
+  TraceRecord m_Record;
+  bool m_Active = false;
+
+public:
+  explicit TracePhase(const char* Name) {
+    if (!TraceInfo::TheTraceInfo)
+      return;
+    m_Active = true;
+    m_Record.begin(Name);
+    m_Record.IsPhase = m_Record.Returned = true;
+    m_Record.Start = ReadTimestamp();
+  }
+  ~TracePhase() {
+    if (!m_Active)
+      return;
+    m_Record.End = ReadTimestamp();
+    if (TraceInfo* TI = TraceInfo::TheTraceInfo)
+      TI->commitRecord(m_Record);
+  }
+  TracePhase(const TracePhase&) = delete;
+  TracePhase& operator=(const TracePhase&) = delete;
+};
+
 } // namespace Tracing
 } // namespace CppInterOp
 
@@ -437,9 +1210,10 @@ public:
 #endif
 
 #define INTEROP_TRACE(...)                                                     \
+  static CppInterOp::Tracing::ApiCallSite _TS(__func__);                       \
   CppInterOp::Tracing::TraceRegion _TR =                                       \
-      CppInterOp::Tracing::TraceRegion::Proxy{__func__,                        \
-                                              INTEROP_FUNC_SIG}(__VA_ARGS__)
+      CppInterOp::Tracing::TraceRegion::Proxy{__func__, INTEROP_FUNC_SIG,      \
+                                              &_TS}(__VA_ARGS__)
 
 #define INTEROP_RETURN(Val) _TR.record(Val)
 #define INTEROP_VOID_RETURN() (_TR.recordVoid())
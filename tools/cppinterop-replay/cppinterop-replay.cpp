@@ -0,0 +1,319 @@
+//===- cppinterop-replay.cpp - Replay CppInterOp reproducers --------------===//
+//
+// Part of the compiler-research project, under the Apache License v2.0 with
+// LLVM Exceptions.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Replays a reproducer written by CppInterOp's tracing (CPPINTEROP_LOG or
+// CPPINTEROP_LOG_FILE) as a benchmark. Each iteration compiles the
+// reproducer in a host interpreter, then creates a fresh interpreter, which
+// the calls act on, and times every call it makes. The results are compared
+// with the [N ns] timings recorded in the session.
+//
+//   cppinterop-replay [options] <reproducer.cpp> [-- <interpreter args>]
+//
+// The body of reproducer() is read line by line, the way the tracer writes
+// it: one statement per line. A statement spread over several lines is
+// split at each line and does not compile once instrumented. Calls the
+// tracer wrote as comments, such as those filling an out-parameter, are not
+// replayed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CppInterOp/CppInterOp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// One statement of the reproducer body.
+struct ReplayCall {
+  std::string Text;        ///< The statement without its timing comment.
+  int64_t RecordedNs = -1; ///< The [N ns] annotation, -1 if there is none.
+  std::vector<uint64_t> Samples; ///< Replayed latency per iteration.
+};
+
+struct Reproducer {
+  std::vector<std::string> Prologue; ///< Lines before reproducer().
+  /// Body lines; comments are kept as-is and statements index into Calls.
+  std::vector<std::string> Body;
+  std::vector<int> BodyCall;
+  std::vector<ReplayCall> Calls;
+};
+
+struct Options {
+  std::string Input;
+  unsigned Iterations = 10;
+  bool Summary = false;
+  double MaxSlowdown = -1; ///< Percent; negative disables the check.
+  std::vector<std::string> IncludePaths;
+  std::vector<std::string> InterpArgs;
+};
+
+using Clock = std::chrono::steady_clock;
+std::vector<Clock::time_point> Marks;
+
+/// Called by the instrumented reproducer after every statement.
+void Mark(unsigned Idx) { Marks[Idx] = Clock::now(); }
+
+void PrintUsage(const char* Argv0) {
+  std::fprintf(stderr,
+               "usage: %s [options] <reproducer.cpp> [-- <interpreter args>]\n"
+               "  -n <N>                 replay N times (default 10)\n"
+               "  -I <dir>               add an include path for the "
+               "reproducer\n"
+               "  --summary              print only the totals\n"
+               "  --max-slowdown=<pct>   fail if the median total is more "
+               "than pct%%\n"
+               "                         slower than the recorded total\n",
+               Argv0);
+}
+
+bool ParseOptions(int argc, char** argv, Options& Opts) {
+  for (int i = 1; i < argc; ++i) {
+    std::string Arg = argv[i];
+    if (Arg == "--") {
+      Opts.InterpArgs.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    if (Arg == "-n" && i + 1 < argc) {
+      Opts.Iterations = std::strtoul(argv[++i], nullptr, 10);
+    } else if (Arg == "-I" && i + 1 < argc) {
+      Opts.IncludePaths.push_back(argv[++i]);
+    } else if (Arg.compare(0, 2, "-I") == 0 && Arg.size() > 2) {
+      Opts.IncludePaths.push_back(Arg.substr(2));
+    } else if (Arg == "--summary") {
+      Opts.Summary = true;
+    } else if (Arg.compare(0, 15, "--max-slowdown=") == 0) {
+      Opts.MaxSlowdown = std::strtod(Arg.c_str() + 15, nullptr);
+    } else if (Arg == "-h" || Arg == "--help") {
+      return false;
+    } else if (Arg[0] != '-' && Opts.Input.empty()) {
+      Opts.Input = Arg;
+    } else {
+      std::fprintf(stderr, "error: unknown argument '%s'\n", Arg.c_str());
+      return false;
+    }
+  }
+  return !Opts.Input.empty() && Opts.Iterations > 0;
+}
+
+std::string Trim(const std::string& S) {
+  size_t B = S.find_first_not_of(" \t\r");
+  if (B == std::string::npos)
+    return "";
+  size_t E = S.find_last_not_of(" \t\r");
+  return S.substr(B, E - B + 1);
+}
+
+/// Split "stmt; // [N ns]" into the statement and N.
+void ParseStatement(const std::string& Line, ReplayCall& Call) {
+  Call.Text = Trim(Line);
+  size_t Open = Call.Text.rfind("// [");
+  if (Open == std::string::npos)
+    return;
+  size_t Close = Call.Text.find(" ns]", Open);
+  if (Close == std::string::npos)
+    return;
+  std::string Ns = Call.Text.substr(Open + 4, Close - Open - 4);
+  char* End = nullptr;
+  long long V = std::strtoll(Ns.c_str(), &End, 10);
+  if (End && *End == '\0')
+    Call.RecordedNs = V;
+  Call.Text = Trim(Call.Text.substr(0, Open));
+}
+
+bool ReadReproducer(const std::string& Path, Reproducer& R) {
+  std::ifstream In(Path);
+  if (!In) {
+    std::fprintf(stderr, "error: cannot open '%s'\n", Path.c_str());
+    return false;
+  }
+  enum { InPrologue, InBody, Done } State = InPrologue;
+  std::string Line;
+  while (State != Done && std::getline(In, Line)) {
+    if (State == InPrologue) {
+      if (Trim(Line) == "void reproducer() {")
+        State = InBody;
+      else
+        R.Prologue.push_back(Line);
+      continue;
+    }
+    if (Line == "}") {
+      State = Done;
+      continue;
+    }
+    std::string T = Trim(Line);
+    R.Body.push_back(Line);
+    // The log emits one entry per line; comments carry wrapper sources and
+    // JitCall notes and are not timed.
+    if (T.empty() || T.compare(0, 2, "//") == 0) {
+      R.BodyCall.push_back(-1);
+      continue;
+    }
+    R.BodyCall.push_back(static_cast<int>(R.Calls.size()));
+    R.Calls.emplace_back();
+    ParseStatement(Line, R.Calls.back());
+  }
+  if (State != Done) {
+    std::fprintf(stderr, "error: '%s' has no complete reproducer() body\n",
+                 Path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/// Rewrite the reproducer so that it reports a timestamp after each call.
+std::string Instrument(const Reproducer& R) {
+  std::ostringstream OS;
+  for (const auto& L : R.Prologue)
+    OS << L << "\n";
+  OS << "static void (*const cppinterop_replay_mark)(unsigned) =\n"
+     << "    (void (*)(unsigned))" << reinterpret_cast<uintptr_t>(&Mark)
+     << "ULL;\n\n";
+  OS << "void reproducer() {\n";
+  OS << "  cppinterop_replay_mark(0);\n";
+  for (size_t i = 0; i < R.Body.size(); ++i) {
+    OS << R.Body[i] << "\n";
+    if (R.BodyCall[i] >= 0)
+      OS << "  cppinterop_replay_mark(" << R.BodyCall[i] + 1 << ");\n";
+  }
+  OS << "}\n";
+  return OS.str();
+}
+
+bool ReplayOnce(const Options& Opts, const std::string& Source) {
+  std::vector<const char*> Args;
+  for (const auto& A : Opts.InterpArgs)
+    Args.push_back(A.c_str());
+  if (!Cpp::CreateInterpreter(Args)) {
+    std::fprintf(stderr, "error: cannot create an interpreter\n");
+    return false;
+  }
+  for (const auto& Dir : Opts.IncludePaths)
+    Cpp::AddIncludePath(Dir.c_str());
+
+  bool Ok = true;
+  void (*Run)() = nullptr;
+  if (Cpp::Declare(Source.c_str())) {
+    std::fprintf(stderr, "error: the reproducer does not compile\n");
+    Ok = false;
+  } else if (!(Run = reinterpret_cast<void (*)()>(Cpp::GetFunctionAddress(
+                   Cpp::GetNamed("reproducer"))))) {
+    std::fprintf(stderr, "error: cannot find reproducer()\n");
+    Ok = false;
+  } else if (!Cpp::CreateInterpreter(Args)) {
+    std::fprintf(stderr, "error: cannot create an interpreter\n");
+    Ok = false;
+  } else {
+    // The calls act on the active interpreter, which is now the fresh one;
+    // the host keeps the compiled reproducer alive.
+    Run();
+  }
+
+  // Drop the host interpreter and any the reproducer created itself.
+  while (Cpp::DeleteInterpreter())
+    ;
+  return Ok;
+}
+
+uint64_t Median(std::vector<uint64_t> V) {
+  if (V.empty())
+    return 0;
+  std::nth_element(V.begin(), V.begin() + V.size() / 2, V.end());
+  return V[V.size() / 2];
+}
+
+/// Relative change of \p Now against \p Then, in percent.
+double Change(double Now, double Then) {
+  return Then > 0 ? (Now - Then) * 100.0 / Then : 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options Opts;
+  if (!ParseOptions(argc, argv, Opts)) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+#ifdef CPPINTEROP_DIR
+  // The reproducer includes <CppInterOp/CppInterOp.h>.
+  Opts.IncludePaths.push_back(CPPINTEROP_DIR "/include");
+  // Generated .inc files live under the build tree.
+  Opts.IncludePaths.push_back(CPPINTEROP_BINARY_DIR "/include");
+#endif
+
+  Reproducer R;
+  if (!ReadReproducer(Opts.Input, R))
+    return 1;
+  if (R.Calls.empty()) {
+    std::fprintf(stderr, "error: '%s' makes no calls\n", Opts.Input.c_str());
+    return 1;
+  }
+  std::string Source = Instrument(R);
+
+  std::vector<uint64_t> Totals;
+  for (unsigned It = 0; It < Opts.Iterations; ++It) {
+    Marks.assign(R.Calls.size() + 1, Clock::time_point());
+    if (!ReplayOnce(Opts, Source))
+      return 1;
+    for (size_t i = 0; i < R.Calls.size(); ++i)
+      R.Calls[i].Samples.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Marks[i + 1] -
+                                                               Marks[i])
+              .count());
+    Totals.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         Marks.back() - Marks.front())
+                         .count());
+  }
+
+  uint64_t Recorded = 0;
+  for (const auto& C : R.Calls)
+    Recorded += C.RecordedNs > 0 ? C.RecordedNs : 0;
+
+  if (!Opts.Summary) {
+    std::printf("%12s %12s %12s %9s  %s\n", "recorded-ns", "median-ns",
+                "min-ns", "change", "call");
+    for (const auto& C : R.Calls) {
+      uint64_t Med = Median(C.Samples);
+      uint64_t Min = *std::min_element(C.Samples.begin(), C.Samples.end());
+      if (C.RecordedNs >= 0)
+        std::printf("%12" PRId64 " %12" PRIu64 " %12" PRIu64 " %+8.1f%%  %s\n",
+                    C.RecordedNs, Med, Min, Change(Med, C.RecordedNs),
+                    C.Text.c_str());
+      else
+        std::printf("%12s %12" PRIu64 " %12" PRIu64 " %9s  %s\n", "-", Med,
+                    Min, "-", C.Text.c_str());
+    }
+    std::printf("\n");
+  }
+
+  uint64_t MedTotal = Median(Totals);
+  uint64_t MinTotal = *std::min_element(Totals.begin(), Totals.end());
+  double Delta = Change(MedTotal, Recorded);
+  std::printf("calls: %zu  iterations: %u\n", R.Calls.size(), Opts.Iterations);
+  std::printf("total: recorded %" PRIu64 " ns, median %" PRIu64
+              " ns, min %" PRIu64 " ns (%+.1f%%)\n",
+              Recorded, MedTotal, MinTotal, Delta);
+
+  if (Opts.MaxSlowdown >= 0 && Recorded && Delta > Opts.MaxSlowdown) {
+    std::fprintf(stderr, "error: replay is %.1f%% slower than recorded\n",
+                 Delta);
+    return 1;
+  }
+  return 0;
+}
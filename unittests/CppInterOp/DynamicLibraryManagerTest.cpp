@@ -1,3 +1,4 @@
+#include "ScopedEnv.h"
 #include "Utils.h"
 #include "CppInterOp/CppInterOp.h"
 
@@ -8,6 +9,10 @@
 
 #include "gtest/gtest.h"
 
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
 // This function isn't referenced outside its translation unit, but it
 // can't use the "static" keyword because its address is used for
 // GetMainExecutable (since some platforms don't support taking the
@@ -20,6 +25,49 @@ std::string GetExecutablePath(const char* Argv0) {
   return llvm::sys::fs::getMainExecutable(Argv0, MainAddr);
 }
 
+namespace {
+using TestUtils::ScopedEnv;
+
+#ifdef __APPLE__
+const char* const RetZero = "_ret_zero";
+#else
+const char* const RetZero = "ret_zero";
+#endif // __APPLE__
+
+/// Looks TestSharedLib up next to the test executable, adding its directory
+/// to the search paths of the active interpreter.
+std::string FindTestSharedLib() {
+  std::string BinaryPath = GetExecutablePath(/*Argv0=*/nullptr);
+  llvm::StringRef Dir = llvm::sys::path::parent_path(BinaryPath);
+  Cpp::AddSearchPath(Dir.str().c_str());
+  return Cpp::SearchLibrariesForSymbol(RetZero, /*system_search=*/false);
+}
+
+/// Scans an empty directory, copies TestSharedLib into it and searches
+/// again, returning what the second search found.
+std::string SearchAfterCopy(llvm::StringRef Lib) {
+  llvm::SmallString<128> Dir;
+  EXPECT_FALSE(llvm::sys::fs::createUniqueDirectory("cppinterop-rescan", Dir));
+  Cpp::AddSearchPath(Dir.c_str());
+  EXPECT_EQ("", Cpp::SearchLibrariesForSymbol(RetZero,
+                                              /*system_search=*/false));
+
+  // The copy usually lands within the modification time granularity of the
+  // first listing, the directory must be listed again nevertheless.
+  llvm::SmallString<128> Copy(Dir);
+  llvm::sys::path::append(Copy, llvm::sys::path::filename(Lib));
+  EXPECT_FALSE(llvm::sys::fs::copy_file(Lib, Copy));
+  std::string Found =
+      Cpp::SearchLibrariesForSymbol(RetZero, /*system_search=*/false);
+  if (!Found.empty())
+    EXPECT_TRUE(llvm::sys::fs::equivalent(Found, Copy));
+
+  llvm::sys::fs::remove(Copy);
+  llvm::sys::fs::remove(Dir);
+  return Found;
+}
+} // namespace
+
 TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_Sanity) {
 #ifdef EMSCRIPTEN
   GTEST_SKIP() << "Test fails for Emscipten builds";
@@ -54,6 +102,46 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_Sanity) {
       << "Cannot find: '" << PathToTestSharedLib << "' in '" << Dir.str()
       << "'";
 
+  // Repeated misses are answered from the cached filters and must not
+  // disturb later lookups.
+  for (int i = 0; i < 3; ++i)
+    EXPECT_STREQ("", Cpp::SearchLibrariesForSymbol("cppinterop_no_such_symbol",
+                                                   /*system_search=*/false)
+                         .c_str());
+#ifdef __APPLE__
+  EXPECT_EQ(PathToTestSharedLib, Cpp::SearchLibrariesForSymbol(
+                                     "_ret_zero", /*system_search=*/false));
+#else
+  EXPECT_EQ(PathToTestSharedLib,
+            Cpp::SearchLibrariesForSymbol("ret_zero", /*system_search=*/false));
+#endif // __APPLE__
+
+  // A batch resolves each symbol once and skips the missing ones.
+#ifdef __APPLE__
+  std::string RetZero = "_ret_zero";
+#else
+  std::string RetZero = "ret_zero";
+#endif // __APPLE__
+  Cpp::SymbolLibraryMap_t Found = Cpp::SearchLibrariesForSymbols(
+      {RetZero, "cppinterop_no_such_symbol", RetZero},
+      /*search_system=*/false);
+  EXPECT_EQ(1U, Found.size());
+  EXPECT_EQ(PathToTestSharedLib, Found[RetZero]);
+
+  // C++ symbols can be found by their qualified name.
+#ifndef _WIN32
+  std::vector<Cpp::LibrarySymbol> Symbols;
+  Cpp::SearchLibrariesForQualifiedName("TestSharedLib::ret_one", Symbols,
+                                       /*search_system=*/false);
+  ASSERT_EQ(1U, Symbols.size());
+#ifdef __APPLE__
+  EXPECT_EQ("__ZN13TestSharedLib7ret_oneEv", Symbols[0].MangledName);
+#else
+  EXPECT_EQ("_ZN13TestSharedLib7ret_oneEv", Symbols[0].MangledName);
+#endif // __APPLE__
+  EXPECT_EQ(PathToTestSharedLib, Symbols[0].Library);
+#endif // _WIN32
+
   EXPECT_TRUE(Cpp::LoadLibrary(PathToTestSharedLib.c_str()));
   // Force ExecutionEngine to be created.
   Cpp::Process("");
@@ -69,6 +157,155 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_Sanity) {
   // EXPECT_FALSE(Cpp::GetFunctionAddress("ret_zero"));
 }
 
+TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_Autoload) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+#ifdef CPPINTEROP_USE_CLING
+  GTEST_SKIP() << "Cling has its own library manager";
+#endif
+  if (TypeParam::isOutOfProcess)
+    GTEST_SKIP() << "Test fails for OOP JIT builds";
+
+  ScopedEnv Autoload("CPPINTEROP_AUTOLOAD", "1");
+  EXPECT_TRUE(TestFixture::CreateInterpreter());
+
+  std::string BinaryPath = GetExecutablePath(/*Argv0=*/nullptr);
+  llvm::StringRef Dir = llvm::sys::path::parent_path(BinaryPath);
+  Cpp::AddSearchPath(Dir.str().c_str());
+
+  // The JIT loads the library defining a missing symbol by itself.
+  Cpp::Declare("extern \"C\" int ret_zero();");
+  EXPECT_EQ(0, Cpp::Process("int autoloaded_ret_zero = ret_zero();"));
+}
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_DenyPattern) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+#ifdef CPPINTEROP_USE_CLING
+  GTEST_SKIP() << "Cling has its own library manager";
+#endif
+  if (TypeParam::isOutOfProcess)
+    GTEST_SKIP() << "Test fails for OOP JIT builds";
+
+  ScopedEnv Deny("CPPINTEROP_DYLD_DENY", "*TestSharedLib*");
+  EXPECT_TRUE(TestFixture::CreateInterpreter());
+
+  std::string BinaryPath = GetExecutablePath(/*Argv0=*/nullptr);
+  llvm::StringRef Dir = llvm::sys::path::parent_path(BinaryPath);
+  Cpp::AddSearchPath(Dir.str().c_str());
+
+  EXPECT_EQ("", Cpp::SearchLibrariesForSymbol(RetZero,
+                                              /*system_search=*/false));
+  EXPECT_TRUE(Cpp::SearchLibrariesForSymbols({RetZero},
+                                             /*search_system=*/false)
+                  .empty());
+}
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_Rescan) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+#ifdef CPPINTEROP_USE_CLING
+  GTEST_SKIP() << "Cling has its own library manager";
+#endif
+  if (TypeParam::isOutOfProcess)
+    GTEST_SKIP() << "Test fails for OOP JIT builds";
+
+  EXPECT_TRUE(TestFixture::CreateInterpreter());
+  std::string Lib = FindTestSharedLib();
+  ASSERT_NE("", Lib);
+
+  // A library which appears after the first scan is found by the next search.
+  EXPECT_TRUE(TestFixture::CreateInterpreter());
+  EXPECT_NE("", SearchAfterCopy(Lib));
+}
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_NoRescan) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+#ifdef CPPINTEROP_USE_CLING
+  GTEST_SKIP() << "Cling has its own library manager";
+#endif
+  if (TypeParam::isOutOfProcess)
+    GTEST_SKIP() << "Test fails for OOP JIT builds";
+
+  EXPECT_TRUE(TestFixture::CreateInterpreter());
+  std::string Lib = FindTestSharedLib();
+  ASSERT_NE("", Lib);
+
+  // With rescans disabled the first scan of the directory is final.
+  ScopedEnv Rescan("CPPINTEROP_DYLD_RESCAN", "0");
+  EXPECT_TRUE(TestFixture::CreateInterpreter());
+  EXPECT_EQ("", SearchAfterCopy(Lib));
+}
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_ConcurrentSearch) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+#ifdef CPPINTEROP_USE_CLING
+  GTEST_SKIP() << "Cling has its own library manager";
+#endif
+  if (TypeParam::isOutOfProcess)
+    GTEST_SKIP() << "Test fails for OOP JIT builds";
+
+  // Two interpreters, each finding ret_zero in a library of its own.
+  Cpp::TInterp_t First = TestFixture::CreateInterpreter();
+  ASSERT_TRUE(First);
+  std::string FirstLib = FindTestSharedLib();
+  ASSERT_NE("", FirstLib);
+
+  llvm::SmallString<128> Dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("cppinterop-dyld", Dir));
+  llvm::SmallString<128> SecondLib(Dir);
+  llvm::sys::path::append(SecondLib, llvm::sys::path::filename(FirstLib));
+  ASSERT_FALSE(llvm::sys::fs::copy_file(FirstLib, SecondLib));
+  Cpp::TInterp_t Second = TestFixture::CreateInterpreter();
+  ASSERT_TRUE(Second);
+  Cpp::AddSearchPath(Dir.c_str());
+
+  std::vector<std::string> Results(8);
+  std::vector<std::string> Misses(Results.size());
+  std::vector<std::thread> Threads;
+  for (size_t i = 0; i < Results.size(); ++i)
+    Threads.emplace_back([&, i] {
+      Cpp::TInterp_t I = i % 2 ? Second : First;
+      Misses[i] = Cpp::SearchLibrariesForSymbol(
+          "cppinterop_no_such_symbol", /*system_search=*/false, I);
+      Results[i] =
+          Cpp::SearchLibrariesForSymbol(RetZero, /*system_search=*/false, I);
+    });
+  for (std::thread& T : Threads)
+    T.join();
+
+  for (size_t i = 0; i < Results.size(); ++i) {
+    EXPECT_EQ("", Misses[i]);
+    ASSERT_NE("", Results[i]);
+    llvm::StringRef Expected = i % 2 ? SecondLib.str() : FirstLib;
+    EXPECT_TRUE(llvm::sys::fs::equivalent(Results[i], Expected))
+        << Results[i] << " instead of " << Expected.str();
+  }
+
+  // The other searches take the interpreter as well.
+  Cpp::SymbolLibraryMap_t Found =
+      Cpp::SearchLibrariesForSymbols({RetZero}, /*search_system=*/false, First);
+  ASSERT_EQ(1U, Found.size());
+  EXPECT_TRUE(llvm::sys::fs::equivalent(Found[RetZero], FirstLib));
+#ifndef _WIN32
+  std::vector<Cpp::LibrarySymbol> Symbols;
+  Cpp::SearchLibrariesForQualifiedName("TestSharedLib::ret_one", Symbols,
+                                       /*search_system=*/false, Second);
+  ASSERT_EQ(1U, Symbols.size());
+  EXPECT_TRUE(llvm::sys::fs::equivalent(Symbols[0].Library, SecondLib));
+#endif // _WIN32
+
+  llvm::sys::fs::remove(SecondLib);
+  llvm::sys::fs::remove(Dir);
+}
+
 TYPED_TEST(CPPINTEROP_TEST_MODE, DynamicLibraryManager_BasicSymbolLookup) {
 #ifndef EMSCRIPTEN
   GTEST_SKIP() << "This test is only intended for Emscripten builds.";
@@ -291,6 +291,17 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, EnumReflection_GetEnums) {
         };
     };
 
+    namespace Animals {
+      enum Birds {
+        Eagle
+      };
+      inline namespace v1 {
+        enum Fish {
+          Salmon
+        };
+      }
+    }
+
     int myVariable;
     )";
 
@@ -312,6 +323,13 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, EnumReflection_GetEnums) {
   EXPECT_TRUE(std::find(enumNames1.begin(), enumNames1.end(), "Days") != enumNames1.end());
   EXPECT_TRUE(std::find(enumNames2.begin(), enumNames2.end(), "AnimalType") != enumNames2.end());
   EXPECT_TRUE(std::find(enumNames2.begin(), enumNames2.end(), "Months") != enumNames2.end());
+  // Enums from reopened namespaces are found, the ones of inline namespaces
+  // belong to the inline namespace.
+  EXPECT_TRUE(std::find(enumNames2.begin(), enumNames2.end(), "Birds") != enumNames2.end());
+  EXPECT_EQ(enumNames2.size(), 3U);
+  // Enums are reported in declaration order.
+  std::vector<std::string> Expected2 = {"AnimalType", "Months", "Birds"};
+  EXPECT_EQ(enumNames2, Expected2);
   EXPECT_TRUE(std::find(enumNames3.begin(), enumNames3.end(), "Color") != enumNames3.end());
   EXPECT_TRUE(enumNames4.empty());
 }
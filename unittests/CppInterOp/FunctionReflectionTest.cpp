@@ -8,11 +8,14 @@
 #include "clang/Sema/Sema.h"
 
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
 
 #include "clang-c/CXCppInterOp.h"
 
 #include "gtest/gtest.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -2302,6 +2305,127 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, FunctionReflection_GetFunctionCallWrapper) {
   EXPECT_FALSE(Cpp::IsLambdaClass(Cpp::GetFunctionReturnType(bar)));
 }
 
+TYPED_TEST(CPPINTEROP_TEST_MODE, FunctionReflection_WrapperCompilationStats) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+  // The JIT phases are measured in interpreters created with statistics on.
+  Cpp::SetApiStatisticsSampling(1);
+  std::vector<Decl*> Decls;
+  GetAllTopLevelDecls("int wrapper_stats(int i) { return i; }", Decls);
+
+  Cpp::ResetWrapperCompilationStats();
+  Cpp::JitCall JC = Cpp::MakeFunctionCallable(Decls[0]);
+  EXPECT_TRUE(JC.getKind() == Cpp::JitCall::kGenericCall);
+
+  Cpp::WrapperCompilationStats Stats;
+  Cpp::GetWrapperCompilationStats(Stats);
+  EXPECT_EQ(Stats.Wrappers, 1U);
+  EXPECT_GT(Stats.SourceBytes, 0U);
+  EXPECT_GT(Stats.SourceNs, 0U);
+  EXPECT_GT(Stats.CompileNs, 0U);
+#ifndef CPPINTEROP_USE_CLING
+  EXPECT_GT(Stats.FrontendNs, 0U);
+  EXPECT_GT(Stats.ObjectBytes, 0U);
+  EXPECT_GT(Stats.JitCompileNs, 0U);
+  EXPECT_LE(Stats.FrontendNs + Stats.ExecuteNs + Stats.LookupNs,
+            Stats.CompileNs);
+  EXPECT_LE(Stats.JitCompileNs + Stats.JitLinkNs,
+            Stats.ExecuteNs + Stats.LookupNs);
+#endif
+
+  // Cached wrappers are not compiled again.
+  Cpp::MakeFunctionCallable(Decls[0]);
+  Cpp::GetWrapperCompilationStats(Stats);
+  EXPECT_EQ(Stats.Wrappers, 1U);
+  Cpp::SetApiStatisticsSampling(0);
+}
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, FunctionReflection_JitCallProfile) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+  if (TypeParam::isOutOfProcess)
+    GTEST_SKIP() << "Test fails for OOP JIT builds";
+  std::string code = R"(
+    namespace prof {
+      int hot(int i) { return i; }
+      int cold(int i) { return i; }
+      double cold(double d) { return d; }
+    }
+    )";
+  std::vector<Decl*> Decls;
+  GetAllTopLevelDecls(code, Decls);
+  Cpp::TCppScope_t NS = Cpp::GetNamed("prof");
+  Cpp::TCppFunction_t Hot = Cpp::GetNamed("hot", NS);
+  Cpp::TCppFunction_t Cold = nullptr;
+  for (Cpp::TCppFunction_t F : Cpp::GetFunctionsUsingName(NS, "cold"))
+    if (Cpp::GetTypeAsString(Cpp::GetFunctionArgType(F, 0)) == "int")
+      Cold = F;
+  ASSERT_TRUE(Cold);
+
+  // Only JitCalls made while profiling is on are counted.
+  Cpp::JitCall Unprofiled = Cpp::MakeFunctionCallable(Hot);
+  Cpp::SetJitCallProfiling(true);
+  Cpp::JitCall HotJC = Cpp::MakeFunctionCallable(Hot);
+  Cpp::JitCall ColdJC = Cpp::MakeFunctionCallable(Cold);
+  Cpp::SetJitCallProfiling(false);
+
+  int Arg = 1;
+  int Result = 0;
+  void* Args[] = {&Arg};
+  for (int i = 0; i < 10; ++i)
+    HotJC.Invoke(&Result, {Args, 1});
+  ColdJC.Invoke(&Result, {Args, 1});
+  Unprofiled.Invoke(&Result, {Args, 1});
+  EXPECT_EQ(Result, 1);
+
+  std::vector<Cpp::JitCallProfile> Profile;
+  Cpp::GetJitCallProfile(Profile);
+  ASSERT_EQ(Profile.size(), 2U);
+  std::map<std::string, uint64_t> Calls;
+  for (const auto& P : Profile)
+    Calls[P.Name] = P.Calls;
+  EXPECT_EQ(Calls["prof::hot(int)"], 10U);
+  EXPECT_EQ(Calls["prof::cold(int)"], 1U);
+
+  // The profile survives a round trip through a file.
+  SmallString<128> Path;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("jitcall-profile", "txt", Path));
+  ASSERT_TRUE(Cpp::WriteJitCallProfile(Path.c_str()));
+  std::vector<Cpp::JitCallProfile> Loaded;
+  ASSERT_TRUE(Cpp::LoadJitCallProfile(Path.c_str(), Loaded));
+  llvm::sys::fs::remove(Path);
+  ASSERT_EQ(Loaded.size(), Profile.size());
+  for (size_t i = 0; i < Loaded.size(); ++i) {
+    EXPECT_EQ(Loaded[i].Name, Profile[i].Name);
+    EXPECT_EQ(Loaded[i].Calls, Profile[i].Calls);
+    EXPECT_EQ(Loaded[i].TotalNs, Profile[i].TotalNs);
+  }
+  EXPECT_FALSE(Cpp::LoadJitCallProfile("/nonexistent/profile", Loaded));
+
+  Cpp::ResetJitCallProfile();
+  Cpp::GetJitCallProfile(Profile);
+  EXPECT_TRUE(Profile.empty());
+
+  // A new session compiles the profiled wrappers up front.
+  std::vector<const char*> interpreter_args = {"-include", "new"};
+  Cpp::CreateInterpreter(interpreter_args, {});
+  Cpp::Declare(code.c_str());
+  Loaded.push_back({"prof::missing(int)", 1, 1, 1});
+  Cpp::ResetWrapperCompilationStats();
+  EXPECT_EQ(Cpp::PrewarmJitCalls(Loaded, /*limit=*/1), 1U);
+  EXPECT_EQ(Cpp::PrewarmJitCalls(Loaded), 2U);
+  Cpp::WrapperCompilationStats Stats;
+  Cpp::GetWrapperCompilationStats(Stats);
+  EXPECT_EQ(Stats.Wrappers, 2U);
+  NS = Cpp::GetNamed("prof");
+  EXPECT_TRUE(Cpp::MakeFunctionCallable(Cpp::GetNamed("hot", NS)));
+  Cpp::GetWrapperCompilationStats(Stats);
+  EXPECT_EQ(Stats.Wrappers, 2U);
+}
+
 TYPED_TEST(CPPINTEROP_TEST_MODE, FunctionReflection_IsConstMethod) {
   std::vector<Decl*> Decls, SubDecls;
   std::string code = R"(
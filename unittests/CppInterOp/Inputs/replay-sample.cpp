@@ -0,0 +1,13 @@
+// CppInterOp reproducer
+// A small recorded session for the cppinterop-replay test.
+// Streamed while the session ran.
+#include <CppInterOp/CppInterOp.h>
+
+void reproducer() {
+  Cpp::Declare("namespace Sample { struct S { int i; }; }", false); // [48210 ns]
+  auto v1 = Cpp::GetScope("Sample", nullptr); // [1350 ns]
+  auto v2 = Cpp::GetScope("S", v1); // [940 ns]
+  Cpp::IsClass(v2); // [120 ns]
+}
+
+int main() { reproducer(); return 0; }
@@ -11,6 +11,9 @@
 #include "clang/AST/Type.h"
 #include "clang/Basic/Version.h"
 #include "clang/Frontend/CompilerInstance.h"
+#ifndef CPPINTEROP_USE_CLING
+#include "clang/Interpreter/Interpreter.h"
+#endif
 #include "clang/Sema/Sema.h"
 
 #include "llvm/Support/Valgrind.h"
@@ -947,6 +950,14 @@ CODE;
   std::unique_ptr<G> g(new G());
   EXPECT_EQ(Cpp::GetBaseClassOffset(Decls[6], Decls[0]),
             (char*)(A*)g.get() - (char*)g.get());
+  // Repeated queries are answered from the cached table.
+  EXPECT_EQ(Cpp::GetBaseClassOffset(Decls[6], Decls[5]),
+            (char*)(F*)g.get() - (char*)g.get());
+  EXPECT_EQ(Cpp::GetBaseClassOffset(Decls[6], Decls[0]),
+            (char*)(A*)g.get() - (char*)g.get());
+
+  // Not a base class.
+  EXPECT_EQ(Cpp::GetBaseClassOffset(Decls[4], Decls[2]), -1);
 }
 
 TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_GetAllCppNames) {
@@ -991,6 +1002,123 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_GetAllCppNames) {
   test_get_all_cpp_names(Decls[5], {});
 }
 
+TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_VisitCppNames) {
+  std::vector<Decl*> Decls;
+  std::string code = R"(
+    namespace N {
+      class A { int a; };
+      enum E { e0 };
+      void f();
+      int v;
+      typedef int T;
+      template <typename U> struct Tmpl {};
+      bool operator==(const A&, const A&);
+    }
+  )";
+
+  GetAllTopLevelDecls(code, Decls);
+
+  using Names = std::vector<std::pair<std::string, Cpp::NamedDeclKind>>;
+  auto collect = [](const char* name, size_t size, Cpp::NamedDeclKind kind,
+                    Cpp::TCppScope_t, void* data) {
+    static_cast<Names*>(data)->emplace_back(std::string(name, size), kind);
+    return true;
+  };
+
+  Names names;
+  Cpp::VisitCppNames(Decls[0], collect, &names);
+  Names expected = {{"A", Cpp::kClass},       {"E", Cpp::kEnum},
+                    {"f", Cpp::kFunction},    {"v", Cpp::kVariable},
+                    {"T", Cpp::kTypedef},     {"Tmpl", Cpp::kTemplate},
+                    {"operator==", Cpp::kFunction}};
+  EXPECT_EQ(names, expected);
+
+  names.clear();
+  Cpp::VisitCppNames(Decls[0], collect, &names,
+                     Cpp::kClass | Cpp::kTemplate);
+  expected = {{"A", Cpp::kClass}, {"Tmpl", Cpp::kTemplate}};
+  EXPECT_EQ(names, expected);
+
+  // Returning false stops the enumeration.
+  size_t count = 0;
+  Cpp::VisitCppNames(
+      Decls[0],
+      [](const char*, size_t, Cpp::NamedDeclKind, Cpp::TCppScope_t,
+         void* data) {
+        ++*static_cast<size_t*>(data);
+        return false;
+      },
+      &count);
+  EXPECT_EQ(count, 1U);
+}
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_FindNames) {
+#ifdef EMSCRIPTEN
+  GTEST_SKIP() << "Test fails for Emscipten builds";
+#endif
+  TestFixture::CreateInterpreter();
+  EXPECT_EQ(Cpp::Declare(R"(
+    namespace Physics { struct Particle {}; }
+    struct ParticleGun {};
+    int particleCount;
+    enum Flavour { Up, Down };
+  )"), 0);
+  EXPECT_EQ(Cpp::Declare(R"(
+    extern "C" int particle_id();
+    namespace Physics { double Parton; }
+  )"), 0);
+
+  auto names = [](const std::vector<Cpp::TCppScope_t>& decls) {
+    std::vector<std::string> result;
+    for (auto* D : decls)
+      result.push_back(Cpp::GetQualifiedName(D));
+    return result;
+  };
+
+  std::vector<Cpp::TCppScope_t> decls;
+  Cpp::FindNamesWithPrefix("Part", decls);
+  EXPECT_EQ(names(decls), std::vector<std::string>({"Physics::Particle",
+                                                    "ParticleGun",
+                                                    "Physics::Parton"}));
+  decls.clear();
+  Cpp::FindNamesWithPrefix("Part", decls, Cpp::kVariable);
+  EXPECT_EQ(names(decls), std::vector<std::string>({"Physics::Parton"}));
+
+  decls.clear();
+  Cpp::FindNamesContaining("article", decls);
+  EXPECT_EQ(names(decls),
+            std::vector<std::string>({"Physics::Particle", "ParticleGun",
+                                      "particleCount", "particle_id"}));
+
+  decls.clear();
+  Cpp::FindSimilarNames("Dwn", decls);
+  ASSERT_EQ(decls.size(), 1U);
+  EXPECT_EQ(Cpp::GetName(decls[0]), "Down");
+  decls.clear();
+  Cpp::FindSimilarNames("Phisycs", decls, /*max_distance=*/1);
+  EXPECT_TRUE(decls.empty());
+  Cpp::FindSimilarNames("Phisycs", decls, /*max_distance=*/2,
+                        Cpp::kNamespace);
+  EXPECT_EQ(names(decls), std::vector<std::string>({"Physics"}));
+
+  // New declarations are picked up, undone ones are dropped.
+  EXPECT_EQ(Cpp::Declare("int Particles;"), 0);
+  decls.clear();
+  Cpp::FindNamesWithPrefix("Particles", decls);
+  EXPECT_EQ(names(decls), std::vector<std::string>({"Particles"}));
+  Cpp::Undo();
+  decls.clear();
+  Cpp::FindNamesWithPrefix("Particles", decls);
+  EXPECT_TRUE(decls.empty());
+  // The names of the earlier inputs survive the undo.
+  EXPECT_EQ(Cpp::Declare("int Partition;"), 0);
+  decls.clear();
+  Cpp::FindNamesWithPrefix("Part", decls);
+  EXPECT_EQ(names(decls),
+            std::vector<std::string>({"Physics::Particle", "ParticleGun",
+                                      "Partition", "Physics::Parton"}));
+}
+
 TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_InstantiateNNTPClassTemplate) {
   std::vector<Decl *> Decls;
   std::string code = R"(
@@ -1024,6 +1152,39 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_InstantiateNNTPClassTemplate) {
   clang_Interpreter_dispose(I);
 }
 
+#ifndef CPPINTEROP_USE_CLING
+TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_InstantiateTemplateCAPI) {
+  // Interpreters made by the C API are not registered with the C++ API and
+  // must not share its template instance cache.
+  TestFixture::CreateInterpreter();
+  const char* code = "template <typename T> struct Box { T value; };";
+  Cpp::Declare(code);
+  Cpp::TCppScope_t Box = Cpp::GetNamed("Box");
+  ASSERT_TRUE(Box);
+  Cpp::TemplateArgInfo IntArg(Cpp::GetType("int"));
+  EXPECT_TRUE(Cpp::InstantiateTemplate(Box, &IntArg, 1));
+
+  const char* argv[] = {"-std=c++17"};
+  for (int i = 0; i < 2; ++i) {
+    auto* CXI = clang_createInterpreter(argv, 1);
+    ASSERT_EQ(clang_Interpreter_declare(CXI, code, /*silent=*/false),
+              CXError_Success);
+    auto* CLI = static_cast<clang::Interpreter*>(
+        clang_Interpreter_getClangInterpreter(CXI));
+    ASTContext& C = CLI->getCompilerInstance()->getASTContext();
+    auto R = C.getTranslationUnitDecl()->lookup(&C.Idents.get("Box"));
+    ASSERT_TRUE(R.isSingleResult());
+
+    CXTemplateArgInfo Args[] = {{C.IntTy.getAsOpaquePtr(), nullptr}};
+    CXScope S = clang_instantiateTemplate(make_scope(R.front(), CXI), Args, 1);
+    auto* D = static_cast<Decl*>(S.data[0]);
+    ASSERT_TRUE(D);
+    EXPECT_EQ(&D->getASTContext(), &C);
+    clang_Interpreter_dispose(CXI);
+  }
+}
+#endif
+
 TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_InstantiateVarTemplate) {
   std::vector<Decl*> Decls;
   std::string code = R"(
@@ -1173,6 +1334,57 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_InstantiateTemplate) {
   EXPECT_TRUE(TA4_1.getAsIntegral() == 3);
 }
 
+TYPED_TEST(CPPINTEROP_TEST_MODE, ScopeReflection_InstantiateTemplates) {
+  std::vector<Decl*> Decls;
+  std::string code = R"(
+    template<typename T, unsigned N>
+    class Arr { T m_data[N]; };
+
+    template<typename T> T Zero() { return T(); }
+
+    typedef int MyInt;
+  )";
+
+  GetAllTopLevelDecls(code, Decls);
+  ASTContext& C = Interp->getCI()->getASTContext();
+  Cpp::TCppType_t IntTy = C.IntTy.getAsOpaquePtr();
+  Cpp::TCppType_t DoubleTy = C.DoubleTy.getAsOpaquePtr();
+  Cpp::TCppType_t MyIntTy =
+      C.getTypeDeclType(cast<TypeDecl>(Decls[2])).getAsOpaquePtr();
+
+  std::vector<std::vector<Cpp::TemplateArgInfo>> args = {
+      {IntTy, {IntTy, "3"}}, {DoubleTy, {IntTy, "3"}}, {IntTy, {IntTy, "4"}}};
+  std::vector<Cpp::TCppScope_t> instances;
+  Cpp::InstantiateTemplates(Decls[0], args, instances);
+  ASSERT_EQ(instances.size(), 3U);
+  for (auto* Instance : instances) {
+    EXPECT_TRUE(
+        isa<ClassTemplateSpecializationDecl>(static_cast<Decl*>(Instance)));
+    EXPECT_TRUE(Cpp::IsComplete(Instance));
+  }
+  EXPECT_NE(instances[0], instances[1]);
+  EXPECT_NE(instances[0], instances[2]);
+
+  // Canonically equal argument lists resolve to the same specialization.
+  std::vector<Cpp::TemplateArgInfo> args1 = {MyIntTy, {IntTy, "3"}};
+  EXPECT_EQ(Cpp::InstantiateTemplate(Decls[0], args1.data(), args1.size()),
+            instances[0]);
+  std::vector<Cpp::TCppScope_t> instances1;
+  Cpp::InstantiateTemplates(Decls[0], args, instances1);
+  EXPECT_EQ(instances, instances1);
+
+  // A cached declaration-only function instance gets its body on request.
+  std::vector<Cpp::TemplateArgInfo> args2 = {IntTy};
+  auto* Zero = Cpp::InstantiateTemplate(Decls[1], args2.data(), args2.size());
+  EXPECT_TRUE(Zero);
+  std::vector<Cpp::TCppScope_t> functions;
+  Cpp::InstantiateTemplates(Decls[1], {args2}, functions,
+                            /*instantiate_body=*/true);
+  ASSERT_EQ(functions.size(), 1U);
+  EXPECT_EQ(functions[0], Zero);
+  EXPECT_TRUE(cast<FunctionDecl>(static_cast<Decl*>(Zero))->isDefined());
+}
+
 TYPED_TEST(CPPINTEROP_TEST_MODE,
            ScopeReflection_GetClassTemplateInstantiationArgs) {
   std::vector<Decl *> Decls;
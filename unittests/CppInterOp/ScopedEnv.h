@@ -0,0 +1,32 @@
+#ifndef CPPINTEROP_UNITTESTS_LIBCPPINTEROP_SCOPEDENV_H
+#define CPPINTEROP_UNITTESTS_LIBCPPINTEROP_SCOPEDENV_H
+
+#include <cstdlib>
+
+namespace TestUtils {
+/// Sets an environment variable read when an interpreter is created, and
+/// unsets it again at the end of the scope. Shared with the benchmarks.
+class ScopedEnv {
+  const char* m_Name;
+
+public:
+  ScopedEnv(const char* Name, const char* Value) : m_Name(Name) {
+#ifdef _WIN32
+    _putenv_s(Name, Value);
+#else
+    setenv(Name, Value, /*overwrite=*/1);
+#endif
+  }
+  ~ScopedEnv() {
+#ifdef _WIN32
+    _putenv_s(m_Name, "");
+#else
+    unsetenv(m_Name);
+#endif
+  }
+  ScopedEnv(const ScopedEnv&) = delete;
+  ScopedEnv& operator=(const ScopedEnv&) = delete;
+};
+} // namespace TestUtils
+
+#endif // CPPINTEROP_UNITTESTS_LIBCPPINTEROP_SCOPEDENV_H
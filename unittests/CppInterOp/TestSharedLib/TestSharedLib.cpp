@@ -1,3 +1,5 @@
 #include "TestSharedLib.h"
 
 int ret_zero() { return 0; }
+
+int TestSharedLib::ret_one() { return 1; }
@@ -8,4 +8,12 @@ extern "C" __declspec(dllexport) int ret_zero();
 extern "C" int __attribute__((visibility("default"))) ret_zero();
 #endif
 
+namespace TestSharedLib {
+#ifdef _WIN32
+__declspec(dllexport) int ret_one();
+#else
+int __attribute__((visibility("default"))) ret_one();
+#endif
+} // namespace TestSharedLib
+
 #endif // UNITTESTS_CPPINTEROP_TESTSHAREDLIB_TESTSHAREDLIB_H
@@ -3,17 +3,30 @@
 #include "CppInterOp/CppInterOp.h"
 
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/raw_ostream.h"
 
+#if defined(CPPINTEROP_ENABLE_USDT) && defined(__linux__)
+#include "llvm/Object/ELFObjectFile.h"
+
+#include <dlfcn.h>
+#include <set>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
+#include <map>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <regex>
 #include <sstream>
+#include <thread>
 
 using namespace CppInterOp::Tracing;
 using ::testing::HasSubstr;
 using ::testing::Not;
+using ::testing::StartsWith;
 
 // Helper: join the full trace log into a single string for matching.
 static std::string getFullLog() {
@@ -308,18 +321,38 @@ TEST_F(TracingTest, NonPointerReturnNoAnnotation) {
   EXPECT_THAT(output, HasSubstr("Cpp::ReturnInt()"));
 }
 
-// Test: non-streamable types (e.g. std::vector) are formatted as placeholders.
+// Test: containers of printable values are formatted as braced lists.
 void FuncTakingVector(const std::vector<const char*>& args) {
   INTEROP_TRACE(args);
   return INTEROP_VOID_RETURN();
 }
 
-TEST_F(TracingTest, ArgFormattingNonStreamable) {
+TEST_F(TracingTest, ArgFormattingVector) {
   std::vector<const char*> v = {"a", "b"};
   FuncTakingVector(v);
   auto output = TraceInfo::TheTraceInfo->getLastLogEntry();
-  // Non-streamable types should get a {...} placeholder.
-  EXPECT_THAT(output, HasSubstr("Cpp::FuncTakingVector({...})"));
+  EXPECT_THAT(output, StartsWith("  Cpp::FuncTakingVector({\"a\", \"b\"})"));
+}
+
+// Test: non-streamable types get a placeholder and comment out the call.
+struct NotStreamable {};
+void FuncTakingNonStreamable(const std::vector<NotStreamable>& v) {
+  INTEROP_TRACE(v);
+  return INTEROP_VOID_RETURN();
+}
+
+TEST_F(TracingTest, ArgFormattingNonStreamable) {
+  FuncTakingNonStreamable({NotStreamable()});
+  auto output = TraceInfo::TheTraceInfo->getLastLogEntry();
+  EXPECT_THAT(output, StartsWith("  // Cpp::FuncTakingNonStreamable({...})"));
+}
+
+// Test: strings are escaped so that each call stays on one line.
+TEST_F(TracingTest, ArgFormattingEscapesStrings) {
+  FuncTakingString("struct S {\n  const char* s = \"x\";\n};");
+  auto output = TraceInfo::TheTraceInfo->getLastLogEntry();
+  EXPECT_THAT(output, HasSubstr(R"(Cpp::FuncTakingString("struct S {\n  )"
+                                R"(const char* s = \"x\";\n};"))"));
 }
 
 // ---------------------------------------------------------------------------
@@ -449,6 +482,11 @@ TEST_F(TracingTest, ChainedReproducerLogic) {
   EXPECT_THAT(output, HasSubstr("auto v1 ="));
 }
 
+void* ReturnOutParamHandle() {
+  INTEROP_TRACE();
+  return INTEROP_RETURN((void*)0xA);
+}
+
 // ---------------------------------------------------------------------------
 // Tests: out-parameters
 // ---------------------------------------------------------------------------
@@ -465,6 +503,26 @@ TEST_F(TracingTest, OutParamRegistersHandles) {
   EXPECT_NE(TI.lookupHandle((void*)0xC), "nullptr");
 }
 
+// The container an out-param fills is not in the reproducer, so the call and
+// the calls using the handles it produced are written as comments. A handle
+// returned again by a replayable call gets declared then.
+TEST_F(TracingTest, OutParamCallsAreComments) {
+  std::vector<void*> results;
+  FillHandles(results);
+  FuncTakingHandle(results[0]);
+  EXPECT_THAT(TraceInfo::TheTraceInfo->getLastLogEntry(),
+              StartsWith("  // Cpp::FuncTakingHandle(v1)"));
+
+  void* h = ReturnOutParamHandle();
+  ASSERT_EQ(h, results[0]);
+  FuncTakingHandle(h);
+  auto output = getFullLog();
+  EXPECT_THAT(output, HasSubstr("  // Cpp::FillHandles();"));
+  EXPECT_THAT(output, HasSubstr("  auto v1 = Cpp::ReturnOutParamHandle();"));
+  EXPECT_THAT(TraceInfo::TheTraceInfo->getLastLogEntry(),
+              StartsWith("  Cpp::FuncTakingHandle(v1)"));
+}
+
 TEST_F(TracingTest, OutParamHandlesUsableInLaterCalls) {
   TraceInfo& TI = *TraceInfo::TheTraceInfo;
 
@@ -596,6 +654,12 @@ TEST_F(TracingTest, ReproducerCompilesViaInterpreter) {
   Cpp::GetName(Foo);
   Cpp::SizeOf(Foo);
 
+  // Out-param calls and the calls using their results become comments.
+  std::vector<Cpp::TCppScope_t> Members;
+  Cpp::GetDatamembers(Foo, Members);
+  ASSERT_EQ(Members.size(), 1u);
+  Cpp::GetName(Members[0]);
+
   // Write the reproducer.
   TraceInfo& TI = *TraceInfo::TheTraceInfo;
   std::string Path = TI.writeToFile();
@@ -856,6 +920,491 @@ TEST_F(TracingTest, WriteToFileWhenStdErrDisabled) {
   llvm::sys::fs::remove(Path);
 }
 
+// ---------------------------------------------------------------------------
+// Tests: binary trace records
+// ---------------------------------------------------------------------------
+
+class BinaryTracingTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    if (TraceInfo::TheTraceInfo)
+      TraceInfo::TheTraceInfo->clear();
+    TraceInfo::TheTraceInfo = nullptr;
+    InitTracing(TraceMode::Binary);
+  }
+  void TearDown() override {
+    TraceInfo::TheTraceInfo->clear();
+    TraceInfo::TheTraceInfo->setMode(TraceMode::Text);
+  }
+};
+
+TEST_F(BinaryTracingTest, FormattingIsDeferredUntilFlush) {
+  void* h = FuncReturningHandle();
+  FuncTakingMixed(h, "world", 99);
+  EXPECT_TRUE(TraceInfo::TheTraceInfo->getLog().empty());
+
+  TraceInfo::TheTraceInfo->flushRecords();
+  auto output = getFullLog();
+  EXPECT_THAT(output, HasSubstr("auto v1 = Cpp::FuncReturningHandle()"));
+  EXPECT_THAT(output, HasSubstr("Cpp::FuncTakingMixed(v1, \"world\", 99)"));
+  EXPECT_THAT(output, HasSubstr(" ns]"));
+}
+
+TEST_F(BinaryTracingTest, RecordsMatchTextFormatting) {
+  std::vector<const char*> v = {"a", "b"};
+  FuncTakingVector(v);
+  ReturnNull();
+  std::vector<void*> out;
+  FuncWithHandleAndOut(nullptr, out);
+  TraceInfo::TheTraceInfo->flushRecords();
+  auto output = getFullLog();
+  // A record has no room for the elements, unlike the text formatting.
+  EXPECT_THAT(output, HasSubstr("Cpp::FuncTakingVector({...})"));
+  EXPECT_THAT(output, HasSubstr("/*nullptr*/ Cpp::ReturnNull()"));
+  EXPECT_THAT(output, HasSubstr("Cpp::FuncWithHandleAndOut(nullptr)"));
+}
+
+TEST_F(BinaryTracingTest, LossyRecordsAreComments) {
+  std::vector<const char*> v = {"a", "b"};
+  FuncTakingVector(v);
+  std::vector<void*> out;
+  FuncWithHandleAndOut(nullptr, out);
+  FuncTakingString("short");
+  TraceInfo::TheTraceInfo->flushRecords();
+  const auto& Log = TraceInfo::TheTraceInfo->getLog();
+  ASSERT_EQ(Log.size(), 3u);
+  EXPECT_THAT(Log[0], HasSubstr("  // Cpp::FuncTakingVector("));
+  EXPECT_THAT(Log[1], HasSubstr("  // Cpp::FuncWithHandleAndOut("));
+  EXPECT_THAT(Log[2], HasSubstr("  Cpp::FuncTakingString(\"short\")"));
+  EXPECT_THAT(Log[2], Not(HasSubstr("// Cpp::")));
+}
+
+TEST_F(BinaryTracingTest, LongStringsAreTruncated) {
+  std::string Long(100, 'x');
+  FuncTakingString(Long.c_str());
+  TraceInfo::TheTraceInfo->flushRecords();
+  auto output = TraceInfo::TheTraceInfo->getLastLogEntry();
+  EXPECT_THAT(output, HasSubstr("// Cpp::FuncTakingString(\"xxxx"));
+  EXPECT_THAT(output, HasSubstr("...\")"));
+  EXPECT_THAT(output, Not(HasSubstr(Long)));
+}
+
+TEST_F(BinaryTracingTest, RingKeepsMostRecentRecords) {
+  for (uint64_t i = 0; i < TraceRing::kCapacity + 10; ++i)
+    NoArgTrace();
+  TraceInfo::TheTraceInfo->flushRecords();
+  const auto& Log = TraceInfo::TheTraceInfo->getLog();
+  ASSERT_EQ(Log.size(), TraceRing::kCapacity + 1);
+  EXPECT_THAT(Log.front(), HasSubstr("10 trace records were overwritten"));
+}
+
+TEST_F(BinaryTracingTest, RecordsFromManyThreads) {
+  std::vector<std::thread> Threads;
+  for (int t = 0; t < 4; ++t)
+    Threads.emplace_back([] {
+      for (int i = 0; i < 100; ++i)
+        AnnotatedFunction(i);
+    });
+  for (auto& T : Threads)
+    T.join();
+  TraceInfo::TheTraceInfo->flushRecords();
+  EXPECT_EQ(TraceInfo::TheTraceInfo->getLog().size(), 400u);
+}
+
+TEST_F(BinaryTracingTest, StartStopTracingWritesRecords) {
+  NoArgTrace(); // Before the region; must not be written.
+  std::string Path = CppInterOp::Tracing::StartTracing(/*WriteOnStdErr=*/false);
+  ASSERT_FALSE(Path.empty());
+  AnnotatedFunction(123);
+  CppInterOp::Tracing::StopTracing();
+
+  std::string FileContent = ReadFileToString(Path);
+  EXPECT_THAT(FileContent, HasSubstr("Cpp::AnnotatedFunction(123)"));
+  EXPECT_THAT(FileContent, Not(HasSubstr("Cpp::NoArgTrace()")));
+  llvm::sys::fs::remove(Path);
+}
+
+// ---------------------------------------------------------------------------
+// Tests: Chrome trace export
+// ---------------------------------------------------------------------------
+
+void FuncWithPhase() {
+  INTEROP_TRACE();
+  CppInterOp::Tracing::TracePhase Phase("func_phase");
+  return INTEROP_VOID_RETURN();
+}
+
+// Returns the exported events keyed by name, asserting the file is valid.
+static std::map<std::string, llvm::json::Object>
+ReadChromeTrace(const std::string& Path) {
+  std::map<std::string, llvm::json::Object> Events;
+  auto Parsed = llvm::json::parse(ReadFileToString(Path));
+  EXPECT_TRUE(bool(Parsed)) << llvm::toString(Parsed.takeError());
+  if (!Parsed)
+    return Events;
+  const auto* Array = Parsed->getAsObject()->getArray("traceEvents");
+  EXPECT_NE(Array, nullptr);
+  if (Array)
+    for (const auto& E : *Array)
+      if (auto Name = E.getAsObject()->getString("name"))
+        Events[Name->str()] = *E.getAsObject();
+  return Events;
+}
+
+TEST_F(TracingTest, ChromeTraceHasNestedSpans) {
+  FuncWithPhase();
+  std::string Path = CppInterOp::Tracing::WriteChromeTrace();
+  ASSERT_FALSE(Path.empty());
+  auto Events = ReadChromeTrace(Path);
+  llvm::sys::fs::remove(Path);
+
+  ASSERT_TRUE(Events.count("FuncWithPhase"));
+  ASSERT_TRUE(Events.count("func_phase"));
+  auto& Api = Events["FuncWithPhase"];
+  auto& Phase = Events["func_phase"];
+  EXPECT_EQ(Api.getString("ph").value_or("").str(), "X");
+  EXPECT_EQ(Api.getString("cat").value_or("").str(), "api");
+  EXPECT_EQ(Phase.getString("cat").value_or("").str(), "phase");
+  EXPECT_EQ(Api.getInteger("tid"), Phase.getInteger("tid"));
+  EXPECT_LE(*Api.getNumber("ts"), *Phase.getNumber("ts"));
+  EXPECT_GE(*Api.getNumber("ts") + *Api.getNumber("dur"),
+            *Phase.getNumber("ts") + *Phase.getNumber("dur"));
+  EXPECT_TRUE(Events.count("process_name"));
+}
+
+TEST_F(BinaryTracingTest, ChromeTraceSurvivesFlush) {
+  VoidFunc();
+  TraceInfo::TheTraceInfo->flushRecords();
+  std::string Path = CppInterOp::Tracing::WriteChromeTrace();
+  ASSERT_FALSE(Path.empty());
+  auto Events = ReadChromeTrace(Path);
+  llvm::sys::fs::remove(Path);
+  EXPECT_TRUE(Events.count("VoidFunc"));
+}
+
+TEST_F(NoTracingTest, ChromeTraceRequiresTracing) {
+  EXPECT_TRUE(CppInterOp::Tracing::WriteChromeTrace().empty());
+}
+
+// ---------------------------------------------------------------------------
+// Tests: API statistics
+// ---------------------------------------------------------------------------
+
+class ApiStatisticsTest : public ::testing::Test {
+protected:
+  void SetUp() override { Cpp::ResetApiStatistics(); }
+  void TearDown() override { Cpp::SetApiStatisticsSampling(0); }
+
+  static Cpp::ApiStatistics Find(const std::string& Name) {
+    std::vector<Cpp::ApiStatistics> Stats;
+    Cpp::GetApiStatistics(Stats);
+    for (auto& S : Stats)
+      if (S.Name == Name)
+        return S;
+    return {};
+  }
+};
+
+TEST(LatencyHistogramTest, BucketsCoverTheirValues) {
+  for (uint64_t V : {0ULL, 7ULL, 8ULL, 17ULL, 1000ULL, 123456789ULL,
+                     ~0ULL}) {
+    unsigned B = LatencyHistogram::getBucket(V);
+    ASSERT_LT(B, LatencyHistogram::kBuckets);
+    EXPECT_GE(LatencyHistogram::getBucketUpperBound(B), V);
+    if (B)
+      EXPECT_LT(LatencyHistogram::getBucketUpperBound(B - 1), V);
+    // The bucket width bounds the relative error.
+    EXPECT_LE(LatencyHistogram::getBucketUpperBound(B) - V,
+              V / LatencyHistogram::kSub);
+  }
+}
+
+TEST_F(ApiStatisticsTest, CountsEveryCallAndOrdersPercentiles) {
+  Cpp::SetApiStatisticsSampling(1);
+  for (int i = 0; i < 1000; ++i)
+    AnnotatedFunction(i);
+  Cpp::SetApiStatisticsSampling(0);
+
+  Cpp::ApiStatistics S = Find("AnnotatedFunction");
+  EXPECT_EQ(S.Calls, 1000u);
+  EXPECT_EQ(S.Sampled, 1000u);
+  EXPECT_LE(S.MinNs, S.P50Ns);
+  EXPECT_LE(S.P50Ns, S.P99Ns);
+  EXPECT_LE(S.P99Ns, S.P999Ns);
+  EXPECT_LE(S.P999Ns, S.MaxNs);
+  EXPECT_GT(S.MeanNs, 0);
+}
+
+TEST_F(ApiStatisticsTest, SamplesOneInN) {
+  Cpp::SetApiStatisticsSampling(10);
+  for (int i = 0; i < 10000; ++i)
+    NoArgTrace();
+  Cpp::SetApiStatisticsSampling(0);
+
+  Cpp::ApiStatistics S = Find("NoArgTrace");
+  EXPECT_EQ(S.Calls, 10000u);
+  EXPECT_GT(S.Sampled, 500u);
+  EXPECT_LT(S.Sampled, 2000u);
+}
+
+TEST_F(ApiStatisticsTest, ResetAndDisable) {
+  Cpp::SetApiStatisticsSampling(1);
+  VoidFunc();
+  EXPECT_EQ(Find("VoidFunc").Calls, 1u);
+  Cpp::ResetApiStatistics();
+  EXPECT_EQ(Find("VoidFunc").Calls, 0u);
+
+  Cpp::SetApiStatisticsSampling(0);
+  VoidFunc();
+  EXPECT_EQ(Find("VoidFunc").Calls, 0u);
+}
+
+// ---------------------------------------------------------------------------
+// Tests: streamed reproducer
+// ---------------------------------------------------------------------------
+
+TEST_F(TracingTest, StreamedEntriesGoToDiskNotMemory) {
+  TraceInfo& TI = *TraceInfo::TheTraceInfo;
+  std::string Path = TI.startStreaming(/*Path=*/"", /*Version=*/"test");
+  ASSERT_FALSE(Path.empty());
+  EXPECT_TRUE(TI.isStreaming());
+
+  AnnotatedFunction(7);
+  VoidFunc();
+  EXPECT_TRUE(TI.getLog().empty());
+
+  TI.flushStream();
+  std::string content = ReadFileToString(Path);
+  EXPECT_THAT(content, HasSubstr("void reproducer() {"));
+  EXPECT_THAT(content, HasSubstr("Cpp::AnnotatedFunction(7)"));
+  EXPECT_THAT(content, HasSubstr("Cpp::VoidFunc()"));
+  EXPECT_THAT(content, Not(HasSubstr("int main()")));
+
+  // The crash handler path only needs to complete the file.
+  EXPECT_EQ(TI.writeToFile(), Path);
+  EXPECT_FALSE(TI.isStreaming());
+  content = ReadFileToString(Path);
+  EXPECT_THAT(content, HasSubstr("int main() { reproducer(); return 0; }"));
+
+  llvm::sys::fs::remove(Path);
+}
+
+TEST_F(TracingTest, StreamedFlushIsBounded) {
+  TraceInfo& TI = *TraceInfo::TheTraceInfo;
+  std::string Path = TI.startStreaming(/*Path=*/"", /*Version=*/"test");
+  ASSERT_FALSE(Path.empty());
+
+  // Enough entries to force at least one flush without flushStream().
+  for (unsigned i = 0; i < TraceInfo::kStreamFlushLines; ++i)
+    AnnotatedFunction(i);
+  std::string content = ReadFileToString(Path);
+  EXPECT_THAT(content, HasSubstr("Cpp::AnnotatedFunction(0)"));
+
+  TI.stopStreaming();
+  llvm::sys::fs::remove(Path);
+}
+
+TEST_F(TracingTest, StreamIsCompletedAtExit) {
+  llvm::SmallString<128> Path;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("cppinterop-stream", "cpp", Path));
+  EXPECT_EXIT(
+      {
+        TraceInfo::TheTraceInfo->startStreaming(std::string(Path), "test");
+        AnnotatedFunction(5);
+        std::exit(0);
+      },
+      ::testing::ExitedWithCode(0), "");
+
+  std::string content = ReadFileToString(std::string(Path));
+  EXPECT_THAT(content, HasSubstr("Cpp::AnnotatedFunction(5)"));
+  EXPECT_THAT(content, HasSubstr("int main() { reproducer(); return 0; }"));
+  llvm::sys::fs::remove(Path);
+}
+
+TEST_F(TracingTest, RegionWhileStreamingKeepsItsEntries) {
+  TraceInfo& TI = *TraceInfo::TheTraceInfo;
+  std::string Path = TI.startStreaming(/*Path=*/"", /*Version=*/"test");
+  ASSERT_FALSE(Path.empty());
+
+  VoidFunc();
+  std::string RegionPath =
+      CppInterOp::Tracing::StartTracing(/*WriteOnStdErr=*/false);
+  AnnotatedFunction(3);
+  CppInterOp::Tracing::StopTracing(/*Version=*/"test");
+
+  std::string Region = ReadFileToString(RegionPath);
+  EXPECT_THAT(Region, HasSubstr("Cpp::AnnotatedFunction(3)"));
+  EXPECT_THAT(Region, Not(HasSubstr("Cpp::VoidFunc()")));
+
+  TI.stopStreaming();
+  std::string Streamed = ReadFileToString(Path);
+  EXPECT_THAT(Streamed, HasSubstr("Cpp::VoidFunc()"));
+  EXPECT_THAT(Streamed, HasSubstr("Cpp::AnnotatedFunction(3)"));
+
+  llvm::sys::fs::remove(RegionPath);
+  llvm::sys::fs::remove(Path);
+}
+
+// ---------------------------------------------------------------------------
+// Tests: allocation accounting
+// ---------------------------------------------------------------------------
+
+// Stands in for the AST arena, so that the expected numbers are exact.
+static uint64_t FakeArena = 0;
+static uint64_t ReadFakeArena() { return FakeArena; }
+
+// Simulated allocations keep the counts exact with or without the operator
+// new replacement.
+void AllocInner() {
+  INTEROP_TRACE();
+  AllocTracker::noteAlloc(100);
+  FakeArena += 64;
+  return INTEROP_VOID_RETURN();
+}
+
+void AllocOuter() {
+  INTEROP_TRACE();
+  AllocTracker::noteAlloc(10);
+  AllocInner();
+  FakeArena += 8;
+  return INTEROP_VOID_RETURN();
+}
+
+class AllocTrackerTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    if (TraceInfo::TheTraceInfo)
+      TraceInfo::TheTraceInfo->clear();
+    TraceInfo::TheTraceInfo = nullptr;
+    InitTracing();
+    AllocTracker::setArenaProbe(ReadFakeArena);
+    AllocTracker::setEnabled(true);
+  }
+  void TearDown() override {
+    AllocTracker::setEnabled(false);
+    AllocTracker::setArenaProbe(nullptr);
+    TraceInfo::TheTraceInfo->clear();
+    TraceInfo::TheTraceInfo->setMode(TraceMode::Text);
+  }
+};
+
+TEST_F(AllocTrackerTest, ChargesTheInnermostCall) {
+  AllocOuter();
+  auto log = getFullLog();
+  EXPECT_THAT(log, HasSubstr("Cpp::AllocInner();"));
+  EXPECT_THAT(log, HasSubstr("ns] [1 allocs, 100 B heap, 64 B arena]"));
+  EXPECT_THAT(log, HasSubstr("ns] [1 allocs, 10 B heap, 8 B arena]"));
+}
+
+TEST_F(AllocTrackerTest, BinaryRecordsCarryAllocations) {
+  TraceInfo::TheTraceInfo->setMode(TraceMode::Binary);
+  AllocInner();
+  TraceInfo::TheTraceInfo->flushRecords();
+  EXPECT_THAT(getFullLog(), HasSubstr("[1 allocs, 100 B heap, 64 B arena]"));
+}
+
+TEST_F(AllocTrackerTest, AddsUpInApiStatistics) {
+  Cpp::ResetApiStatistics();
+  Cpp::SetApiStatisticsSampling(1);
+  for (int i = 0; i < 10; ++i)
+    AllocOuter();
+  Cpp::SetApiStatisticsSampling(0);
+
+  std::vector<Cpp::ApiStatistics> Stats;
+  Cpp::GetApiStatistics(Stats);
+  auto Inner = std::find_if(Stats.begin(), Stats.end(),
+                            [](auto& S) { return S.Name == "AllocInner"; });
+  ASSERT_NE(Inner, Stats.end());
+  EXPECT_EQ(Inner->Allocs, 10u);
+  EXPECT_EQ(Inner->AllocBytes, 1000u);
+  EXPECT_EQ(Inner->ArenaBytes, 640u);
+}
+
+TEST_F(AllocTrackerTest, DisabledLeavesTimingsAlone) {
+  AllocTracker::setEnabled(false);
+  AllocInner();
+  EXPECT_THAT(TraceInfo::TheTraceInfo->getLastLogEntry(),
+              Not(HasSubstr("allocs")));
+}
+
+#ifdef CPPINTEROP_ENABLE_ALLOC_TRACKING
+void AllocWithNew() {
+  INTEROP_TRACE();
+  int* volatile P = new int(1);
+  delete P;
+  return INTEROP_VOID_RETURN();
+}
+
+TEST_F(AllocTrackerTest, CountsOperatorNew) {
+  AllocWithNew();
+  EXPECT_THAT(TraceInfo::TheTraceInfo->getLastLogEntry(),
+              HasSubstr("ns] [1 allocs, 4 B heap, 0 B arena]"));
+}
+#endif // CPPINTEROP_ENABLE_ALLOC_TRACKING
+
+// ---------------------------------------------------------------------------
+// Tests: USDT probes
+// ---------------------------------------------------------------------------
+
+#if defined(CPPINTEROP_ENABLE_USDT) && defined(__linux__)
+// Collect the names of the SDT notes of \p Provider in the object file that
+// defines CppInterOp.
+static std::set<std::string> ReadUSDTProbes(llvm::StringRef Provider) {
+  std::set<std::string> Probes;
+  Dl_info Info;
+  if (!dladdr(reinterpret_cast<void*>(&Cpp::GetVersion), &Info))
+    return Probes;
+  auto ObjOrErr = llvm::object::ObjectFile::createObjectFile(Info.dli_fname);
+  if (!ObjOrErr) {
+    llvm::consumeError(ObjOrErr.takeError());
+    return Probes;
+  }
+  auto* ELF = llvm::dyn_cast<llvm::object::ELF64LEObjectFile>(
+      ObjOrErr->getBinary());
+  if (!ELF)
+    return Probes;
+  const auto& File = ELF->getELFFile();
+  auto Sections = File.sections();
+  if (!Sections) {
+    llvm::consumeError(Sections.takeError());
+    return Probes;
+  }
+  for (const auto& Shdr : *Sections) {
+    if (Shdr.sh_type != llvm::ELF::SHT_NOTE)
+      continue;
+    llvm::Error Err = llvm::Error::success();
+    for (const auto& Note : File.notes(Shdr, Err)) {
+      // NT_STAPSDT: three addresses, then "provider\0name\0args\0".
+      if (Note.getName() != "stapsdt" || Note.getType() != 3)
+        continue;
+      llvm::ArrayRef<uint8_t> Desc =
+          Note.getDesc(llvm::Align(std::max<uint64_t>(Shdr.sh_addralign, 1)));
+      if (Desc.size() <= 3 * sizeof(uint64_t))
+        continue;
+      llvm::StringRef Rest(reinterpret_cast<const char*>(Desc.data()) +
+                               3 * sizeof(uint64_t),
+                           Desc.size() - 3 * sizeof(uint64_t));
+      auto [Prov, Tail] = Rest.split('\0');
+      if (Prov == Provider)
+        Probes.insert(Tail.split('\0').first.str());
+    }
+    llvm::consumeError(std::move(Err));
+  }
+  return Probes;
+}
+
+TEST(USDTProbeTest, ProbesArePresentInTheELFNotes) {
+  std::set<std::string> Probes = ReadUSDTProbes("cppinterop");
+  for (const char* Name :
+       {"api__entry", "api__return", "wrapper__compile__start",
+        "wrapper__compile__done", "library__load__start",
+        "library__load__done", "symbol__resolve__start",
+        "symbol__resolve__done"})
+    EXPECT_TRUE(Probes.count(Name)) << "missing probe " << Name;
+}
+#endif // CPPINTEROP_ENABLE_USDT && __linux__
+
 // ---------------------------------------------------------------------------
 // Tests: all CPPINTEROP_API functions must have INTEROP_TRACE
 // ---------------------------------------------------------------------------
@@ -3,6 +3,7 @@
 #include "CppInterOp/CppInterOp.h"
 
 #include "clang/AST/ASTContext.h"
+#include "clang/AST/RecordLayout.h"
 #include "clang/Basic/Version.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Sema/Sema.h"
@@ -436,6 +437,43 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, VariableReflection_VariableOffsetsWithInheritan
             ((intptr_t)&(my_k.s)) - ((intptr_t)&(my_k)));
 }
 
+#define CODE                                                                   \
+  struct L0 { int l0; };                                                       \
+  struct L1 : L0 { int l1; };                                                  \
+  struct V : virtual L1 { int v; };                                            \
+  struct L2 : V { int l2; };                                                   \
+  struct L3 : L2 { int l3; };                                                  \
+  struct L4 : L3 { int l4; } deep;
+
+CODE
+
+TYPED_TEST(CPPINTEROP_TEST_MODE,
+           VariableReflection_VariableOffsetsWithDeepInheritance) {
+  std::vector<Decl*> Decls;
+#define Stringify(s) Stringifyx(s)
+#define Stringifyx(...) #__VA_ARGS__
+  GetAllTopLevelDecls(Stringify(CODE), Decls);
+#undef Stringifyx
+#undef Stringify
+#undef CODE
+
+  Cpp::TCppScope_t L4 = Cpp::GetNamed("L4");
+  ASSERT_TRUE(L4);
+  auto offset_of = [](const void* member) {
+    return ((intptr_t)member) - ((intptr_t)&deep);
+  };
+
+  std::vector<std::pair<const char*, const void*>> members = {
+      {"L0", &deep.l0}, {"L1", &deep.l1}, {"V", &deep.v},
+      {"L2", &deep.l2}, {"L3", &deep.l3}};
+  for (const auto& [klass, member] : members) {
+    std::vector<Cpp::TCppScope_t> datamembers;
+    Cpp::GetDatamembers(Cpp::GetNamed(klass), datamembers);
+    ASSERT_EQ(datamembers.size(), 1U);
+    EXPECT_EQ(Cpp::GetVariableOffset(datamembers[0], L4), offset_of(member));
+  }
+}
+
 TYPED_TEST(CPPINTEROP_TEST_MODE, VariableReflection_IsPublicVariable) {
   std::vector<Decl *> Decls, SubDecls;
   std::string code = R"(
@@ -759,3 +797,122 @@ TYPED_TEST(CPPINTEROP_TEST_MODE, VariableReflection_GetPointerType) {
   EXPECT_EQ(Cpp::GetPointerType(Cpp::GetVariableType(Decls[5])),
             Cpp::GetVariableType(Decls[6]));
 }
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, VariableReflection_GetRecordLayout) {
+  std::vector<Decl*> Decls;
+  std::string code = R"(
+    enum class E : short { e0 };
+    struct Base { double d; };
+    struct S : Base {
+      char c;
+      unsigned flag : 3;
+      unsigned mode : 5;
+      union {
+        int i;
+        float f;
+      };
+      int* p;
+      E e;
+      Base b;
+    };
+    template <typename T> struct Dependent {
+      T t;
+      struct Inner { T u; };
+    };
+    struct Incomplete;
+  )";
+
+  GetAllTopLevelDecls(code, Decls);
+  ASTContext& C = Interp->getCI()->getASTContext();
+  auto* S = cast<CXXRecordDecl>(Decls[2]);
+  const ASTRecordLayout& SLayout = C.getASTRecordLayout(S);
+
+  std::vector<Cpp::FieldLayout> fields;
+  EXPECT_TRUE(Cpp::GetRecordLayout(S, fields));
+  ASSERT_EQ(fields.size(), 9U);
+
+  Cpp::FieldKind CharKind = C.CharTy->isSignedIntegerType()
+                                ? Cpp::FieldKind::Char_S
+                                : Cpp::FieldKind::Char_U;
+  std::vector<Cpp::FieldKind> kinds = {
+      Cpp::FieldKind::Double,  CharKind,
+      Cpp::FieldKind::UInt,    Cpp::FieldKind::UInt,
+      Cpp::FieldKind::Int,     Cpp::FieldKind::Float,
+      Cpp::FieldKind::Pointer, Cpp::FieldKind::Short,
+      Cpp::FieldKind::Other};
+  std::vector<std::string> names = {"Base::d", "S::c", "S::flag",
+                                    "S::mode", "S::i", "S::f",
+                                    "S::p",    "S::e", "S::b"};
+  for (size_t i = 0; i < fields.size(); ++i) {
+    EXPECT_EQ(Cpp::GetQualifiedName(fields[i].m_Field), names[i]);
+    EXPECT_EQ(fields[i].m_Kind, kinds[i]);
+    uint64_t BitOffset = fields[i].m_Offset * C.getCharWidth() +
+                         fields[i].m_BitOffset;
+    auto* FD = cast<FieldDecl>(static_cast<Decl*>(fields[i].m_Field));
+    if (i == 0)
+      EXPECT_EQ(BitOffset, 0U);
+    else if (FD->getParent() == S)
+      EXPECT_EQ(BitOffset, SLayout.getFieldOffset(FD->getFieldIndex()));
+  }
+
+  EXPECT_EQ(fields[0].m_Size, sizeof(double));
+  EXPECT_EQ(fields[0].m_Align, alignof(double));
+  EXPECT_EQ(fields[2].m_BitWidth, 3U);
+  EXPECT_EQ(fields[3].m_BitWidth, 5U);
+  EXPECT_EQ(fields[1].m_BitWidth, 0U);
+  // Members of the anonymous union share their storage.
+  EXPECT_EQ(fields[4].m_Offset, fields[5].m_Offset);
+  EXPECT_EQ(fields[4].m_Offset,
+            (uint64_t)Cpp::GetVariableOffset(fields[4].m_Field));
+  EXPECT_EQ(fields[8].m_Size, sizeof(double));
+
+  fields.clear();
+  // The pattern of a class template and its member classes are dependent.
+  auto* Dependent = cast<ClassTemplateDecl>(Decls[3])->getTemplatedDecl();
+  EXPECT_FALSE(Cpp::GetRecordLayout(Dependent, fields));
+  Cpp::TCppScope_t Inner = Cpp::GetNamed("Inner", Dependent);
+  ASSERT_TRUE(Inner);
+  EXPECT_FALSE(Cpp::GetRecordLayout(Inner, fields));
+  EXPECT_FALSE(Cpp::GetRecordLayout(Decls[4], fields));
+  EXPECT_FALSE(Cpp::GetRecordLayout(nullptr, fields));
+  EXPECT_TRUE(fields.empty());
+}
+
+TYPED_TEST(CPPINTEROP_TEST_MODE, VariableReflection_GetRecordLayoutBases) {
+  std::vector<Decl*> Decls;
+  std::string code = R"(
+    struct A { int a; };
+    struct B : A { int b; };
+    struct C : A { int c; };
+    struct D : B, C { int d; };
+    struct VB : virtual A { int vb; };
+    struct VC : virtual A { int vc; };
+    struct VD : VB, VC { int vd; };
+  )";
+
+  GetAllTopLevelDecls(code, Decls);
+  ASTContext& Ctx = Interp->getCI()->getASTContext();
+  auto* D = cast<CXXRecordDecl>(Decls[3]);
+  const ASTRecordLayout& DLayout = Ctx.getASTRecordLayout(D);
+  auto* C = cast<CXXRecordDecl>(Decls[2]);
+
+  // Both A subobjects of D are reported, each at its own offset.
+  std::vector<Cpp::FieldLayout> fields;
+  EXPECT_TRUE(Cpp::GetRecordLayout(D, fields));
+  std::vector<std::string> names = {"A::a", "B::b", "A::a", "C::c", "D::d"};
+  ASSERT_EQ(fields.size(), names.size());
+  for (size_t i = 0; i < fields.size(); ++i)
+    EXPECT_EQ(Cpp::GetQualifiedName(fields[i].m_Field), names[i]);
+  EXPECT_EQ(fields[0].m_Offset, 0U);
+  EXPECT_EQ(fields[2].m_Offset,
+            (uint64_t)DLayout.getBaseClassOffset(C).getQuantity());
+  EXPECT_NE(fields[0].m_Offset, fields[2].m_Offset);
+
+  // The virtual A is shared and reported once.
+  fields.clear();
+  EXPECT_TRUE(Cpp::GetRecordLayout(Decls[6], fields));
+  names = {"A::a", "VB::vb", "VC::vc", "VD::vd"};
+  ASSERT_EQ(fields.size(), names.size());
+  for (size_t i = 0; i < fields.size(); ++i)
+    EXPECT_EQ(Cpp::GetQualifiedName(fields[i].m_Field), names[i]);
+}